@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/resource.h>
+#include <time.h>
+
+//! Helpers shared by the benchmarks
+namespace bench {
+
+using clock = std::chrono::steady_clock;
+
+//! Returns the microseconds elapsed since `start`
+inline auto elapsed_us(clock::time_point start) -> double {
+    return std::chrono::duration<double, std::micro>(clock::now() - start).count();
+}
+
+//! Returns the CPU time consumed so far by the given thread, in microseconds
+inline auto thread_cpu_us(pthread_t thread) -> double {
+    clockid_t cid{};
+    pthread_getcpuclockid(thread, &cid);
+    timespec ts{};
+    clock_gettime(cid, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+//! Returns the CPU time consumed so far by the calling thread, in microseconds
+inline auto thread_cpu_us() -> double { return thread_cpu_us(pthread_self()); }
+
+//! Returns the CPU time consumed so far by all the threads of the process, in microseconds
+inline auto process_cpu_us() -> double {
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+//! Returns the `p`-th percentile (0..100) of the given samples; reorders the samples
+inline auto percentile(std::vector<double>& samples, double p) -> double {
+    if (samples.empty())
+        return 0;
+    auto idx = static_cast<std::size_t>(p / 100 * static_cast<double>(samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + idx, samples.end());
+    return samples[idx];
+}
+
+//! Keeps the compiler from optimizing away the computation of `value`
+template <typename T> inline auto do_not_optimize(const T& value) -> void {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+//! Returns the integer command-line argument at `idx`, or `default_val` if it's not given
+inline auto int_arg(int argc, char** argv, int idx, int default_val) -> int {
+    return idx < argc ? std::atoi(argv[idx]) : default_val;
+}
+
+//! Raises the limit of open file descriptors to the hard limit; returns the new limit
+inline auto raise_fd_limit() -> std::size_t {
+    rlimit lim{};
+    getrlimit(RLIMIT_NOFILE, &lim);
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+    getrlimit(RLIMIT_NOFILE, &lim);
+    return lim.rlim_cur;
+}
+
+} // namespace bench
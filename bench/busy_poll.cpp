@@ -0,0 +1,107 @@
+// Compares the latency distributions of request/response round trips with and without
+// busy-polling (`io_options::max_spin_`).
+//
+// A client thread writes a one-byte request on a socket, and waits for the one-byte response
+// written by the I/O loop. After submitting the read to the loop, and before writing the request,
+// the client does some work (busy-waits), so the loop has to decide between spinning and parking. Reports the p50/p99/p99.9 latency, the CPU time
+// of the loop thread per round trip, and the spin hits vs. parks of the loop.
+//
+// Busy-polling only pays off if the loop has a core of its own; on a machine with fewer cores than
+// busy threads, the spinning loop takes CPU time from the client.
+//
+// Usage: bench_busy_poll [rounds] [work between round trips, in us]
+
+#include "bench_utils.hpp"
+#include "loop_backends.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace io::detail;
+
+namespace {
+
+//! Answers a one-byte request with a one-byte response
+struct echo_oper : oper_body_base {
+    int fd_{-1};
+
+    auto try_run() noexcept -> bool override {
+        char c{};
+        if (read(fd_, &c, 1) != 1)
+            return false;
+        (void)!write(fd_, &c, 1);
+        return true;
+    }
+    auto set_stopped() noexcept -> void override {}
+};
+
+template <typename Loop>
+auto run_one(const char* name, const io::io_options& opts, int rounds, int work_us) -> void {
+    Loop loop{opts};
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    echo_oper echo;
+    echo.fd_ = sv[0];
+
+    std::vector<double> latencies;
+    latencies.reserve(rounds);
+    double cpu = 0;
+    {
+        bench::loop_thread<Loop> th{loop};
+        int warmup = rounds / 10;
+        double cpu_start = 0;
+        for (int i = 0; i < warmup + rounds; i++) {
+            if (i == warmup)
+                cpu_start = bench::thread_cpu_us(th.native_handle());
+            // The loop waits for the request while we work
+            loop.add_io_oper(echo.fd_, oper_type::read, &echo);
+            auto until = bench::clock::now() + std::chrono::microseconds{work_us};
+            while (bench::clock::now() < until) {
+            }
+            auto start = bench::clock::now();
+            char c = 'x';
+            (void)!write(sv[1], &c, 1);
+            (void)!read(sv[1], &c, 1);
+            if (i >= warmup)
+                latencies.push_back(bench::elapsed_us(start));
+        }
+        cpu = bench::thread_cpu_us(th.native_handle()) - cpu_start;
+    }
+    close(sv[0]);
+    close(sv[1]);
+
+    // The stats are only safe to read after the loop stopped
+    const auto& stats = loop.stats();
+    std::printf("%-8s spin %4lld us: p50 %6.1f  p99 %6.1f  p99.9 %7.1f us, loop CPU %5.1f us;"
+                " spin hits %llu, parks %llu\n",
+            name, static_cast<long long>(opts.max_spin_.count()),
+            bench::percentile(latencies, 50), bench::percentile(latencies, 99),
+            bench::percentile(latencies, 99.9), cpu / rounds,
+            static_cast<unsigned long long>(stats.spin_hits_),
+            static_cast<unsigned long long>(stats.parks_));
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    int rounds = bench::int_arg(argc, argv, 1, 20000);
+    int work_us = bench::int_arg(argc, argv, 2, 20);
+    std::printf("%u hardware threads, %d us of work between round trips\n",
+            std::thread::hardware_concurrency(), work_us);
+
+    for (int max_spin : {0, 50, 200}) {
+        io::io_options opts;
+        opts.max_spin_ = std::chrono::microseconds{max_spin};
+        bench::for_each_backend(
+                opts, [&]<typename Loop>(const char* name, const io::io_options& opts) {
+                    run_one<Loop>(name, opts, rounds, work_us);
+                });
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+// Compares the implementations of the delimiter scans (scalar, SSE2, AVX2) on the request heads in
+// `request_corpus.hpp`: finding the line ends of a whole head, and parsing the whole head.
+//
+// Usage: bench_delimiter_scan [iterations per sample]
+
+#include "bench_utils.hpp"
+#include "request_corpus.hpp"
+
+#include "http_server/delimiter_scan.hpp"
+#include "http_server/request_parser.hpp"
+
+#include <cstdio>
+
+namespace scan = http_server::scan;
+
+namespace {
+
+//! Finds the line ends of a head, as the parser does; returns the number of lines
+auto find_lines(std::string_view head) -> std::size_t {
+    std::array<std::uint32_t, http_server::request_headers::max_size + 2> line_ends;
+    return scan::find_line_ends(head, 0, line_ends.data(), line_ends.size());
+}
+
+//! Parses a request head the way the server does it; returns the number of headers
+auto parse(std::string_view head) -> std::size_t {
+    http_server::request_parser parser;
+    parser.parse_head(head);
+    return parser.make_request({}).headers_.size();
+}
+
+//! Returns the average time of `f(head)` over all the samples, in ns per sample
+template <typename F> auto measure(int count, F f) -> double {
+    auto start = bench::clock::now();
+    for (int i = 0; i < count; i++)
+        for (const auto& sample : bench::request_corpus)
+            bench::do_not_optimize(f(sample.head_));
+    return bench::elapsed_us(start) * 1000 / count / bench::request_corpus.size();
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    int count = bench::int_arg(argc, argv, 1, 500000);
+
+    std::size_t corpus_size = 0;
+    for (const auto& sample : bench::request_corpus)
+        corpus_size += sample.head_.size();
+    double avg_size = static_cast<double>(corpus_size) / bench::request_corpus.size();
+    std::printf("%zu request heads, %.0f bytes on average; default implementation: %s\n",
+            bench::request_corpus.size(), avg_size, scan::implementation_name().data());
+
+    for (const char* name : {"scalar", "sse2", "avx2"}) {
+        if (!scan::use_implementation(name)) {
+            std::printf("%-6s: not supported on this CPU\n", name);
+            continue;
+        }
+        measure(count / 10, find_lines);
+        double scan_ns = measure(count, find_lines);
+        measure(count / 10, parse);
+        double parse_ns = measure(count, parse);
+        std::printf("%-6s: line ends %6.1f ns per head (%5.2f GB/s), whole parse %6.1f ns\n", name,
+                scan_ns, avg_size / scan_ns, parse_ns);
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Measures the encoding time and the size of the output of each route, for each of the formats that
+// `img_to_response()` can produce, with the same encoder settings. Marks the formats that the
+// routes choose by default, for clients that send `Accept: */*`, and for the ones that also accept
+// WebP.
+//
+// Uses the given image, or a generated photo-like one.
+//
+// Usage: bench_image_encode [image file] [runs per encoding]
+
+#include "bench_utils.hpp"
+
+#include "img_transform.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+//! An encoding, as done by `img_to_response()`
+struct encoding {
+    std::string_view name_;
+    const char* ext_;
+    std::vector<int> params_;
+    //! Turn the image into black and white first, as for `image_format::mask`
+    bool bilevel_{false};
+};
+
+//! The output of a route, with its default encodings
+struct route_output {
+    std::string_view name_;
+    cv::Mat img_;
+    //! The encodings chosen by default, without and with WebP support
+    std::string_view default_;
+    std::string_view default_webp_;
+};
+
+//! Generates a photo-like image: smooth noise at several scales, shapes, and some grain
+auto generate_photo(int width, int height) -> cv::Mat {
+    cv::RNG rng{3};
+    cv::Mat acc = cv::Mat::zeros(height, width, CV_32FC3);
+    for (int scale : {4, 8, 16, 32, 64, 128}) {
+        cv::Mat noise(std::max(2, height / scale), std::max(2, width / scale), CV_32FC3);
+        rng.fill(noise, cv::RNG::UNIFORM, 0.0, 1.0);
+        cv::Mat resized;
+        cv::resize(noise, resized, acc.size(), 0, 0, cv::INTER_CUBIC);
+        acc += resized * (scale / 64.0);
+    }
+    cv::normalize(acc, acc, 0, 200, cv::NORM_MINMAX);
+    for (int i = 0; i < 40; i++) {
+        cv::Point center{rng.uniform(0, width), rng.uniform(0, height)};
+        cv::Size axes{rng.uniform(20, 250), rng.uniform(20, 250)};
+        cv::Scalar color{
+                rng.uniform(0.0, 255.0), rng.uniform(0.0, 255.0), rng.uniform(0.0, 255.0)};
+        cv::ellipse(acc, center, axes, rng.uniform(0.0, 180.0), 0, 360, color, cv::FILLED);
+    }
+    cv::GaussianBlur(acc, acc, cv::Size{5, 5}, 0);
+    cv::Mat grain(acc.size(), CV_32FC3);
+    rng.fill(grain, cv::RNG::NORMAL, 0.0, 6.0);
+    acc += grain;
+    cv::Mat res;
+    acc.convertTo(res, CV_8UC3);
+    return res;
+}
+
+//! Computes the outputs of the routes, with the default parameters, as the handlers do
+auto compute_outputs(const cv::Mat& src) -> std::vector<route_output> {
+    auto edges = tr_adaptthresh(tr_to_grayscale(tr_blur(src, 3)), 5, 5);
+    auto reduced = tr_reducecolors(src, 5);
+    return {
+            {"blur", tr_blur(src, 3), "jpeg q85", "webp q80"},
+            {"adaptthresh", edges, "png 1-bit", "webp lossless"},
+            {"reducecolors", reduced, "png level 6", "webp lossless"},
+            {"cartoonify", tr_apply_mask(reduced, edges), "png level 6", "webp lossless"},
+            {"oilpainting", tr_oilpainting(src, 10, 1), "jpeg q85", "webp q80"},
+            {"contourpaint", tr_apply_mask(tr_oilpainting(src, 3, 5), edges), "jpeg q85",
+                    "webp q80"},
+    };
+}
+
+auto encode(const cv::Mat& img, const encoding& enc, std::vector<uchar>& out) -> void {
+    cv::Mat bw;
+    if (enc.bilevel_) {
+        if (img.channels() > 1)
+            cv::cvtColor(img, bw, cv::COLOR_BGR2GRAY);
+        cv::threshold(bw.empty() ? img : bw, bw, 127, 255, cv::THRESH_BINARY);
+    }
+    if (!cv::imencode(enc.ext_, bw.empty() ? img : bw, out, enc.params_))
+        std::printf("cannot encode to %s\n", enc.ext_);
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    cv::Mat src;
+    if (argc > 1 && std::string_view{argv[1]} != "-") {
+        src = cv::imread(argv[1], cv::IMREAD_COLOR);
+        if (src.empty()) {
+            std::printf("cannot read %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        src = generate_photo(1280, 960);
+    }
+    int runs = bench::int_arg(argc, argv, 2, 5);
+    std::printf("source image: %dx%d\n", src.cols, src.rows);
+
+    const std::vector<encoding> encodings{
+            {"jpeg q85", ".jpeg", {cv::IMWRITE_JPEG_QUALITY, 85, cv::IMWRITE_JPEG_OPTIMIZE, 1}},
+            {"jpeg q85 progressive", ".jpeg",
+                    {cv::IMWRITE_JPEG_QUALITY, 85, cv::IMWRITE_JPEG_OPTIMIZE, 1,
+                            cv::IMWRITE_JPEG_PROGRESSIVE, 1}},
+            {"png level 1", ".png", {cv::IMWRITE_PNG_COMPRESSION, 1}},
+            {"png level 6", ".png", {cv::IMWRITE_PNG_COMPRESSION, 6}},
+            {"png level 9", ".png", {cv::IMWRITE_PNG_COMPRESSION, 9}},
+            {"png 1-bit", ".png", {cv::IMWRITE_PNG_BILEVEL, 1, cv::IMWRITE_PNG_COMPRESSION, 6},
+                    true},
+            {"webp q80", ".webp", {cv::IMWRITE_WEBP_QUALITY, 80}},
+            {"webp lossless", ".webp", {cv::IMWRITE_WEBP_QUALITY, 101}},
+    };
+    bool have_webp = cv::haveImageWriter(".webp");
+
+    std::vector<uchar> out;
+    for (const auto& route : compute_outputs(src)) {
+        std::printf("%s\n", route.name_.data());
+        for (const auto& enc : encodings) {
+            if (enc.ext_ == std::string_view{".webp"} && !have_webp)
+                continue;
+            // The 1-bit PNGs only make sense for the masks
+            if (enc.bilevel_ && route.img_.channels() > 1)
+                continue;
+            encode(route.img_, enc, out);
+            auto start = bench::clock::now();
+            for (int i = 0; i < runs; i++)
+                encode(route.img_, enc, out);
+            double ms = bench::elapsed_us(start) / 1000 / runs;
+            const char* mark = enc.name_ == route.default_        ? "  (default)"
+                               : enc.name_ == route.default_webp_ ? "  (default with WebP)"
+                                                                  : "";
+            std::printf("  %-22s %8.1f KB %7.1f ms%s\n", enc.name_.data(), out.size() / 1024.0,
+                    ms, mark);
+        }
+    }
+    return 0;
+}
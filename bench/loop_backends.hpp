@@ -0,0 +1,54 @@
+#pragma once
+
+#include "io/detail/epoll_io_loop.hpp"
+#include "io/detail/poll_io_loop.hpp"
+#include "io/detail/uring_io_loop.hpp"
+#include "io/detail/oper_body_base.hpp"
+
+#include <cstdio>
+#include <thread>
+
+namespace bench {
+
+//! Operation that does nothing; used to wake up a loop
+struct nop_oper : io::detail::oper_body_base {
+    auto try_run() noexcept -> bool override { return true; }
+    auto set_stopped() noexcept -> void override {}
+};
+
+//! Runs an I/O loop on its own thread, for the lifetime of this object
+template <typename Loop> class loop_thread {
+public:
+    explicit loop_thread(Loop& loop)
+        : loop_(loop)
+        , thread_([this] { loop_.run(); }) {}
+    ~loop_thread() {
+        // `stop()` doesn't wake up the loop; give it something to do
+        loop_.stop();
+        loop_.add_non_io_oper(&wakeup_);
+        thread_.join();
+    }
+
+    loop_thread(const loop_thread&) = delete;
+    auto operator=(const loop_thread&) -> loop_thread& = delete;
+
+    //! The thread running the loop, to measure its CPU time
+    auto native_handle() -> std::thread::native_handle_type { return thread_.native_handle(); }
+
+private:
+    Loop& loop_;
+    std::thread thread_;
+    nop_oper wakeup_;
+};
+
+//! Calls `f.template operator()<Loop>(name, opts)` for each of the I/O loops
+template <typename F> auto for_each_backend(const io::io_options& opts, F&& f) -> void {
+    f.template operator()<io::detail::poll_io_loop>("poll", opts);
+    f.template operator()<io::detail::epoll_io_loop>("epoll", opts);
+    if (io::detail::uring_io_loop{}.uses_io_uring())
+        f.template operator()<io::detail::uring_io_loop>("io_uring", opts);
+    else
+        std::printf("io_uring: not supported by the kernel, skipped\n");
+}
+
+} // namespace bench
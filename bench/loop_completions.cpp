@@ -0,0 +1,140 @@
+// Measures the cost per completed operation when many parked reads become ready at the same time.
+//
+// The loop parks one read on each of N sockets. While the loop is held by a gate operation, some of
+// the sockets (all of them, or just 10) receive one byte; then we open the gate, and measure the
+// time (and the loop CPU time) until these reads complete.
+//
+// Usage: bench_loop_completions [rounds]
+
+#include "bench_utils.hpp"
+#include "loop_backends.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace io::detail;
+
+namespace {
+
+std::atomic<int> num_parked{0};
+std::atomic<int> num_done{0};
+
+//! Reads one byte from a socket
+struct read_oper : oper_body_base {
+    int fd_{-1};
+
+    auto try_run() noexcept -> bool override {
+        char c{};
+        if (read(fd_, &c, 1) != 1) {
+            num_parked.fetch_add(1, std::memory_order_release);
+            return false;
+        }
+        num_done.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+    auto set_stopped() noexcept -> void override {}
+};
+
+//! Holds the thread of the loop until opened, so that the loop sees all the reads ready at once
+struct gate_oper : oper_body_base {
+    std::atomic<bool> closed_{true};
+    std::atomic<bool> entered_{false};
+    bench::clock::time_point opened_at_;
+    double opened_cpu_{0};
+
+    auto try_run() noexcept -> bool override {
+        entered_.store(true, std::memory_order_release);
+        while (closed_.load(std::memory_order_acquire))
+            std::this_thread::yield();
+        opened_at_ = bench::clock::now();
+        opened_cpu_ = bench::thread_cpu_us();
+        return true;
+    }
+    auto set_stopped() noexcept -> void override {}
+};
+
+template <typename Loop>
+auto run_one(const char* name, const io::io_options& opts, int count, int num_ready, int rounds)
+        -> void {
+    Loop loop{opts};
+    std::vector<read_oper> ops(count);
+    std::vector<int> peers(count);
+    for (int i = 0; i < count; i++) {
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv);
+        ops[i].fd_ = sv[0];
+        peers[i] = sv[1];
+    }
+
+    double wall = 0;
+    double cpu = 0;
+    {
+        bench::loop_thread<Loop> th{loop};
+        // The first round warms up the loop
+        for (int r = 0; r <= rounds; r++) {
+            num_parked = 0;
+            num_done = 0;
+            for (auto& op : ops)
+                loop.add_io_oper(op.fd_, oper_type::read, &op);
+            while (num_parked.load(std::memory_order_acquire) < count)
+                std::this_thread::yield();
+
+            gate_oper gate;
+            loop.add_non_io_oper(&gate);
+            while (!gate.entered_.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            // Spread the ready sockets over the whole set
+            for (int i = 0; i < num_ready; i++)
+                (void)!write(peers[static_cast<std::size_t>(i) * count / num_ready], "x", 1);
+            gate.closed_.store(false, std::memory_order_release);
+            while (num_done.load(std::memory_order_acquire) < num_ready)
+                std::this_thread::yield();
+            if (r > 0) {
+                wall += bench::elapsed_us(gate.opened_at_);
+                cpu += bench::thread_cpu_us(th.native_handle()) - gate.opened_cpu_;
+            }
+
+            // Complete the remaining reads, before parking them again
+            for (int i = 0; i < count; i++)
+                if (i % (count / num_ready) != 0)
+                    (void)!write(peers[i], "x", 1);
+            while (num_done.load(std::memory_order_acquire) < count)
+                std::this_thread::yield();
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        close(ops[i].fd_);
+        close(peers[i]);
+    }
+
+    double completions = static_cast<double>(rounds) * num_ready;
+    std::printf("%-8s %5d of %5d ready: %6.2f us per completion, loop CPU %6.2f us\n", name,
+            num_ready, count, wall / completions, cpu / completions);
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    int rounds = bench::int_arg(argc, argv, 1, 50);
+    auto max_fds = bench::raise_fd_limit();
+
+    bench::for_each_backend({}, [&]<typename Loop>(const char* name, const io::io_options& opts) {
+        for (int count : {10, 100, 1000, 5000, 10000}) {
+            // Two descriptors per socket pair, plus some for the loop itself
+            if (2 * static_cast<std::size_t>(count) + 64 > max_fds) {
+                std::printf("%-8s %14d pending: skipped, limited to %zu file descriptors\n", name,
+                        count, max_fds);
+                continue;
+            }
+            run_one<Loop>(name, opts, count, count, rounds);
+            if (count > 10)
+                run_one<Loop>(name, opts, count, 10, rounds);
+        }
+    });
+    return 0;
+}
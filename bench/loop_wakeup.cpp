@@ -0,0 +1,121 @@
+// Measures how the cost of waking up for one ready connection grows with the number of idle
+// connections that have parked reads in the same I/O loop.
+//
+// One socket does round trips (the loop reads one byte and writes it back), while N other sockets
+// wait for data that never comes. Reports the latency of a round trip, and the CPU time the loop
+// thread spends per round trip.
+//
+// Usage: bench_loop_wakeup [rounds]
+
+#include "bench_utils.hpp"
+#include "loop_backends.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace io::detail;
+
+namespace {
+
+//! Reads one byte and writes it back
+struct echo_oper : oper_body_base {
+    int fd_{-1};
+    std::atomic<bool> parked_{false};
+
+    auto try_run() noexcept -> bool override {
+        char c{};
+        if (read(fd_, &c, 1) != 1) {
+            parked_.store(true, std::memory_order_release);
+            return false;
+        }
+        (void)!write(fd_, &c, 1);
+        return true;
+    }
+    auto set_stopped() noexcept -> void override {}
+};
+
+//! Waits for data on a socket to which nobody writes
+struct idle_oper : oper_body_base {
+    int fd_{-1};
+
+    auto try_run() noexcept -> bool override {
+        char c{};
+        return read(fd_, &c, 1) == 1;
+    }
+    auto set_stopped() noexcept -> void override {}
+};
+
+template <typename Loop>
+auto run_one(const char* name, const io::io_options& opts, int num_idle, int rounds) -> void {
+    Loop loop{opts};
+    std::vector<idle_oper> idle(num_idle);
+    std::vector<int> fds;
+    for (auto& op : idle) {
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv);
+        op.fd_ = sv[0];
+        fds.insert(fds.end(), {sv[0], sv[1]});
+        loop.add_io_oper(op.fd_, oper_type::read, &op);
+    }
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fds.insert(fds.end(), {sv[0], sv[1]});
+
+    double wall = 0;
+    double cpu = 0;
+    {
+        bench::loop_thread<Loop> th{loop};
+        echo_oper echo;
+        echo.fd_ = sv[0];
+        auto round_trip = [&] {
+            echo.parked_ = false;
+            loop.add_io_oper(echo.fd_, oper_type::read, &echo);
+            // Write only after the loop parked the read, so that it needs a wake-up
+            while (!echo.parked_.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            char c = 'x';
+            (void)!write(sv[1], &c, 1);
+            (void)!read(sv[1], &c, 1);
+        };
+        for (int i = 0; i < rounds / 10; i++)
+            round_trip();
+        auto start = bench::clock::now();
+        double cpu_start = bench::thread_cpu_us(th.native_handle());
+        for (int i = 0; i < rounds; i++)
+            round_trip();
+        wall = bench::elapsed_us(start);
+        cpu = bench::thread_cpu_us(th.native_handle()) - cpu_start;
+    }
+    for (int fd : fds)
+        close(fd);
+
+    std::printf("%-8s %6d idle: %7.1f us per round trip, loop CPU %6.1f us\n", name, num_idle,
+            wall / rounds, cpu / rounds);
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    int rounds = bench::int_arg(argc, argv, 1, 2000);
+    auto max_fds = bench::raise_fd_limit();
+
+    bench::for_each_backend({}, [&]<typename Loop>(const char* name, const io::io_options& opts) {
+        for (int num_idle : {0, 10, 100, 1000, 5000, 10000}) {
+            // Two descriptors per socket pair, plus some for the loop itself
+            if (2 * static_cast<std::size_t>(num_idle) + 64 > max_fds) {
+                std::printf("%-8s %6d idle: skipped, limited to %zu file descriptors\n", name,
+                        num_idle, max_fds);
+                continue;
+            }
+            run_one<Loop>(name, opts, num_idle, rounds);
+        }
+    });
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Measures how many request heads per second the request parser handles, for each of the heads in
+// `request_corpus.hpp`, and checks that parsing them doesn't allocate memory.
+//
+// Exits with an error if parsing a request allocated memory.
+//
+// Usage: bench_request_parser [requests per sample]
+
+#include "bench_utils.hpp"
+#include "request_corpus.hpp"
+
+#include "http_server/request_parser.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace {
+//! The number of heap allocations done by the program so far
+std::size_t num_allocs = 0;
+} // namespace
+
+// Count all the allocations done by the program
+auto operator new(std::size_t size) -> void* {
+    num_allocs++;
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc{};
+}
+auto operator new[](std::size_t size) -> void* { return operator new(size); }
+auto operator delete(void* p) noexcept -> void { std::free(p); }
+auto operator delete[](void* p) noexcept -> void { std::free(p); }
+auto operator delete(void* p, std::size_t) noexcept -> void { std::free(p); }
+auto operator delete[](void* p, std::size_t) noexcept -> void { std::free(p); }
+
+namespace {
+
+//! Parses a request head the way the server does it, and returns the number of headers
+auto parse(std::string_view head) -> std::size_t {
+    http_server::request_parser parser;
+    if (parser.parse_head(head) != head.size())
+        std::abort();
+    auto req = parser.make_request({});
+    return req.headers_.size();
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    int count = bench::int_arg(argc, argv, 1, 1000000);
+
+    bool allocated = false;
+    for (const auto& sample : bench::request_corpus) {
+        for (int i = 0; i < count / 10; i++)
+            bench::do_not_optimize(parse(sample.head_));
+
+        std::size_t allocs_start = num_allocs;
+        auto start = bench::clock::now();
+        for (int i = 0; i < count; i++)
+            bench::do_not_optimize(parse(sample.head_));
+        double us = bench::elapsed_us(start);
+        std::size_t allocs = num_allocs - allocs_start;
+        allocated = allocated || allocs != 0;
+
+        std::printf("%-15s %5zu bytes, %2zu headers: %7.1f ns per request, %6.2f M requests/s, "
+                    "%zu allocations\n",
+                sample.name_.data(), sample.head_.size(), parse(sample.head_), us * 1000 / count,
+                count / us, allocs);
+    }
+    if (allocated) {
+        std::printf("error: parsing a request allocated memory\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Measures the cost of routing a request: looking up the path in the route table, and parsing the
+// query into the parameters of the route, as `check_request_head()` does. For comparison, also
+// measures a chain of string comparisons, the way the routes were matched before.
+//
+// Usage: bench_route_table [iterations]
+
+#include "bench_utils.hpp"
+
+#include "routes.hpp"
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+//! Matches the path with a chain of comparisons; returns the index of the route, or `routes.npos`
+auto find_with_comparisons(std::string_view path) -> std::size_t {
+    for (std::size_t i = 0; i < routes.size(); i++)
+        if (path == routes.path(i))
+            return i;
+    return routes.npos;
+}
+
+//! Routes a request URI, as `check_request_head()` does; returns the index of the parameters, or
+//! `routes.npos` if the request is rejected
+auto route(std::string_view uri) -> std::size_t {
+    auto query_pos = uri.find('?');
+    std::string_view path = uri.substr(0, query_pos);
+    std::string_view query;
+    if (query_pos != std::string_view::npos)
+        query = uri.substr(query_pos + 1);
+    std::size_t route_idx = routes.find(path);
+    if (route_idx == routes.npos)
+        return routes.npos;
+    auto params = detail::parse_route_params(route_idx, query);
+    return params ? params->index() : routes.npos;
+}
+
+//! Returns the average time of `f(input)`, in ns
+template <typename F> auto measure(int count, const std::string& input, F f) -> double {
+    for (int i = 0; i < count / 10; i++)
+        bench::do_not_optimize(f(input));
+    auto start = bench::clock::now();
+    for (int i = 0; i < count; i++) {
+        // Keep the compiler from assuming that the input is the same in each iteration
+        std::string_view in = input;
+        bench::do_not_optimize(in);
+        bench::do_not_optimize(f(in));
+    }
+    return bench::elapsed_us(start) * 1000 / count;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    int count = bench::int_arg(argc, argv, 1, 10000000);
+
+    std::vector<std::string> paths;
+    for (std::size_t i = 0; i < routes.size(); i++)
+        paths.emplace_back(routes.path(i));
+    // Unknown paths: short, long, and ones that look like the routes
+    for (const char* p : {"/", "/favicon.ico", "/transform/blurry", "/transform/oilpaintinG",
+                 "/transform/contourpaint/extra/segments/in/the/path"})
+        paths.emplace_back(p);
+
+    std::printf("path lookup, ns:  table  comparisons\n");
+    for (const auto& path : paths) {
+        double table_ns = measure(count, path, [](std::string_view p) { return routes.find(p); });
+        double chain_ns = measure(count, path, find_with_comparisons);
+        std::printf("                 %6.1f %12.1f  %s\n", table_ns, chain_ns, path.c_str());
+    }
+
+    std::printf("\nwhole routing, with the parameters, ns\n");
+    for (const char* uri : {"/transform/blur", "/transform/blur?size=5",
+                 "/transform/contourpaint?blur_size=5&block_size=7&diff=-3&oil_size=4&dyn_ratio=2"
+                 "&format=png&compression=6",
+                 "/transform/cartoonify?format=webp&quality=80", "/transform/blur?size=4",
+                 "/transform/blur?sizes=5", "/transform/blur?size=5x", "/unknown?size=5"}) {
+        std::string input = uri;
+        bool accepted = route(input) != routes.npos;
+        std::printf("  %6.1f  %s  %s\n", measure(count, input, route),
+                accepted ? "accepted" : "rejected", uri);
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+// Measures the CPU time that the sender spends per gigabyte of response bodies, with plain sends
+// (copying the data into the socket buffers) and with `MSG_ZEROCOPY` sends, including waiting for
+// the kernel to release the buffers, as `write_http_response()` does. Also reports the CPU time of
+// the whole process.
+//
+// By default, the data goes over loopback to a sink thread in this process. On loopback the kernel
+// copies the data anyway (the notifications have `SO_EE_CODE_ZEROCOPY_COPIED`): the copy just moves
+// from the sender to the delivery of the data, so only the CPU time of the process is meaningful.
+// To measure the savings, give the address of a sink on another machine, e.g. one started with
+// `nc -lk 9000 > /dev/null`.
+//
+// Usage: bench_zerocopy [GB per run] [ipv4-address port]
+
+#include "bench_utils.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+namespace {
+
+//! Counts the zero-copy sends, and their release by the kernel
+struct zerocopy_counts {
+    std::uint32_t sent_{0};
+    std::uint32_t released_{0};
+    std::uint32_t copied_{0};
+};
+
+//! Waits until the kernel released the buffers of all the zero-copy sends
+auto wait_for_release(int fd, zerocopy_counts& zc) -> void {
+    while (zc.released_ != zc.sent_) {
+        pollfd pfd{fd, 0, 0};
+        ::poll(&pfd, 1, 100);
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            continue;
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            const auto* err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            std::uint32_t n = err->ee_data - err->ee_info + 1;
+            zc.released_ += n;
+            if ((err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0)
+                zc.copied_ += n;
+        }
+    }
+}
+
+//! Sends `body` on `fd`, `count` times; returns the CPU time used by this thread, in us
+auto send_bodies(int fd, const std::string& body, std::size_t count, bool zerocopy,
+        zerocopy_counts& zc) -> double {
+    double cpu_start = bench::thread_cpu_us();
+    for (std::size_t i = 0; i < count; i++) {
+        std::size_t offset = 0;
+        while (offset < body.size()) {
+            ssize_t n = ::send(fd, body.data() + offset, body.size() - offset,
+                    zerocopy ? MSG_ZEROCOPY : 0);
+            if (n < 0) {
+                std::perror("send");
+                std::exit(1);
+            }
+            offset += static_cast<std::size_t>(n);
+            zc.sent_ += zerocopy ? 1 : 0;
+        }
+        // The body must stay alive (and unchanged) until the kernel releases it
+        if (zerocopy)
+            wait_for_release(fd, zc);
+    }
+    return bench::thread_cpu_us() - cpu_start;
+}
+
+auto connect_to(const sockaddr_in& addr) -> int {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::perror("connect");
+        std::exit(1);
+    }
+    return fd;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    int gb = bench::int_arg(argc, argv, 1, 2);
+
+    // Use a sink thread on loopback, unless we are given the address of a remote sink
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    int listener = -1;
+    std::thread sink;
+    if (argc > 3) {
+        inet_pton(AF_INET, argv[2], &addr.sin_addr);
+        addr.sin_port = htons(static_cast<std::uint16_t>(std::atoi(argv[3])));
+        std::printf("sending to %s:%s\n", argv[2], argv[3]);
+    } else {
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        socklen_t len = sizeof(addr);
+        ::getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len);
+        ::listen(listener, 8);
+        sink = std::thread([listener] {
+            std::vector<char> buf(1 << 20);
+            for (int conn; (conn = ::accept(listener, nullptr, nullptr)) >= 0;) {
+                while (::read(conn, buf.data(), buf.size()) > 0) {
+                }
+                ::close(conn);
+            }
+        });
+        std::printf("sending over loopback; the kernel copies the data anyway\n");
+    }
+
+    for (std::size_t mb : {1, 4, 16}) {
+        std::string body(mb << 20, 'x');
+        std::size_t count = (static_cast<std::size_t>(gb) << 10) / mb;
+        for (bool zerocopy : {false, true}) {
+            int fd = connect_to(addr);
+            int one = 1;
+            if (zerocopy && ::setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0) {
+                std::printf("zero-copy sends are not supported\n");
+                return 1;
+            }
+            zerocopy_counts zc;
+            auto start = bench::clock::now();
+            double process_cpu_start = bench::process_cpu_us();
+            double cpu = send_bodies(fd, body, count, zerocopy, zc);
+            double wall = bench::elapsed_us(start);
+            ::close(fd);
+            double process_cpu = bench::process_cpu_us() - process_cpu_start;
+
+            std::printf("%2zu MB bodies, %-9s: per GB, sender CPU %6.1f ms, process CPU %6.1f ms, "
+                        "wall %6.1f ms",
+                    mb, zerocopy ? "zero-copy" : "copy", cpu / 1000 / gb, process_cpu / 1000 / gb,
+                    wall / 1000 / gb);
+            if (zerocopy)
+                std::printf(" (%u sends, %u copied by the kernel)", zc.sent_, zc.copied_);
+            std::printf("\n");
+        }
+    }
+
+    if (sink.joinable()) {
+        ::shutdown(listener, SHUT_RDWR);
+        ::close(listener);
+        sink.join();
+    }
+    return 0;
+}
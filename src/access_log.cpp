@@ -0,0 +1,101 @@
+#include "access_log.hpp"
+#include "profiling.hpp"
+
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+namespace {
+//! How often the flusher writes the records
+constexpr auto flush_interval = std::chrono::milliseconds{100};
+
+//! Appends the text line for the record to `out`
+auto format_record(const access_record& rec, std::string& out) -> void {
+    char line[256];
+    std::string_view route = rec.route_.empty() ? std::string_view{"-"} : rec.route_;
+    int n = std::snprintf(line, sizeof(line),
+            "%llu.%06llu conn=%llu route=%.*s status=%u req_body=%u resp_body=%u body_read_us=%u "
+            "queue_us=%u handle_us=%u write_us=%u\n",
+            static_cast<unsigned long long>(rec.timestamp_us_ / 1000000),
+            static_cast<unsigned long long>(rec.timestamp_us_ % 1000000),
+            static_cast<unsigned long long>(rec.conn_id_), static_cast<int>(route.size()),
+            route.data(), unsigned(rec.status_), rec.request_body_size_, rec.response_body_size_,
+            rec.body_read_us_, rec.queue_us_, rec.handle_us_, rec.write_us_);
+    if (n > 0)
+        out.append(line, std::min<std::size_t>(n, sizeof(line) - 1));
+}
+
+//! Writes all the data to the file descriptor
+auto write_all(int fd, std::string_view data) -> void {
+    while (!data.empty()) {
+        auto rc = ::write(fd, data.data(), data.size());
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return; // Nowhere to report the error; the log is best-effort
+        data.remove_prefix(static_cast<std::size_t>(rc));
+    }
+}
+} // namespace
+
+access_log_ring::access_log_ring(std::size_t capacity)
+    : records_(std::make_unique<access_record[]>(std::bit_ceil(capacity)))
+    , mask_(std::bit_ceil(capacity) - 1) {}
+
+auto access_log_ring::push(const access_record& rec) noexcept -> void {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    auto head = head_.load(std::memory_order_acquire);
+    if (tail - head > mask_) {
+        dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    records_[tail & mask_] = rec;
+    tail_.store(tail + 1, std::memory_order_release);
+}
+
+access_log::access_log(std::size_t num_rings, std::size_t ring_capacity, int fd)
+    : fd_(fd) {
+    for (std::size_t i = 0; i < num_rings; i++)
+        rings_.push_back(std::make_unique<access_log_ring>(ring_capacity));
+    flusher_ = std::thread{[this] { flush_loop(); }};
+}
+
+access_log::~access_log() {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stop_requested_ = true;
+    }
+    cv_.notify_one();
+    flusher_.join();
+}
+
+auto access_log::dropped() const noexcept -> std::uint64_t {
+    std::uint64_t res = 0;
+    for (const auto& r : rings_)
+        res += r->dropped();
+    return res;
+}
+
+auto access_log::flush_loop() -> void {
+    std::unique_lock<std::mutex> lock{mutex_};
+    while (!stop_requested_) {
+        cv_.wait_for(lock, flush_interval, [this] { return stop_requested_; });
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+auto access_log::flush() -> void {
+    PROFILING_SCOPE();
+    std::string out;
+    std::size_t count = 0;
+    for (auto& r : rings_)
+        count += r->consume([&](const access_record& rec) { format_record(rec, out); });
+    if (out.empty())
+        return;
+    write_all(fd_, out);
+    written_.fetch_add(count, std::memory_order_relaxed);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+//! An entry of the access log. It has a fixed size, and it is trivially copyable, so that it can
+//! be logged without allocating memory.
+struct access_record {
+    //! The time at which the response was written, in microseconds since the epoch
+    std::uint64_t timestamp_us_{0};
+    //! The ID of the connection on which the request came
+    std::uint64_t conn_id_{0};
+    //! The path of the route that handled the request; must have static storage.
+    //! Empty for the requests that didn't match any route.
+    std::string_view route_;
+    //! The numeric status code of the response
+    std::uint16_t status_{0};
+    std::uint32_t request_body_size_{0};
+    std::uint32_t response_body_size_{0};
+    //! The time spent on each stage, in microseconds: reading the body, waiting for a worker,
+    //! processing the request on the worker, and writing the response
+    std::uint32_t body_read_us_{0};
+    std::uint32_t queue_us_{0};
+    std::uint32_t handle_us_{0};
+    std::uint32_t write_us_{0};
+};
+
+//! A ring buffer of access records, with a single producer and a single consumer.
+//!
+//! The producer never blocks: if the ring is full, the record is dropped and counted.
+class access_log_ring {
+public:
+    explicit access_log_ring(std::size_t capacity);
+
+    //! Adds a record to the ring; drops it if the ring is full. Called only by the producer.
+    auto push(const access_record& rec) noexcept -> void;
+
+    //! Calls `f` for each record in the ring, and removes the records. Called only by the consumer.
+    template <typename F>
+    auto consume(F&& f) -> std::size_t {
+        auto head = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_acquire);
+        for (auto i = head; i != tail; i++)
+            f(records_[i & mask_]);
+        head_.store(tail, std::memory_order_release);
+        return tail - head;
+    }
+
+    //! The number of records dropped because the ring was full
+    auto dropped() const noexcept -> std::uint64_t {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::unique_ptr<access_record[]> records_;
+    std::size_t mask_;
+    //! The position of the next record to be consumed; written by the consumer
+    alignas(64) std::atomic<std::uint64_t> head_{0};
+    //! The position of the next record to be produced; written by the producer
+    alignas(64) std::atomic<std::uint64_t> tail_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+};
+
+//! Asynchronous access log.
+//!
+//! Each producer (I/O thread) has its own ring buffer, so logging a request is just copying a
+//! record into memory that no other producer touches. A background thread periodically collects
+//! the records from all the rings, formats them, and writes them in batches to a file descriptor.
+class access_log {
+public:
+    //! Creates the log with `num_rings` rings of `ring_capacity` records (rounded up to a power of
+    //! two), writing to `fd`. Starts the flusher thread.
+    access_log(std::size_t num_rings, std::size_t ring_capacity, int fd);
+    //! Stops the flusher thread, after writing all the records
+    ~access_log();
+
+    access_log(const access_log& other) = delete;
+    auto operator=(const access_log& other) -> access_log& = delete;
+
+    //! The ring in which producer `idx` adds its records
+    auto ring(std::size_t idx) noexcept -> access_log_ring& { return *rings_[idx]; }
+
+    //! The total number of records written, and dropped
+    auto written() const noexcept -> std::uint64_t {
+        return written_.load(std::memory_order_relaxed);
+    }
+    auto dropped() const noexcept -> std::uint64_t;
+
+private:
+    std::vector<std::unique_ptr<access_log_ring>> rings_;
+    int fd_;
+    std::atomic<std::uint64_t> written_{0};
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_requested_{false};
+    std::thread flusher_;
+
+    auto flush_loop() -> void;
+    auto flush() -> void;
+};
@@ -0,0 +1,89 @@
+#include "admission_control.hpp"
+
+#include <utility>
+
+admission_controller::ticket::~ticket() {
+    if (!parent_)
+        return;
+    if (queued_ && parent_->queued_.fetch_sub(1, std::memory_order_relaxed) == 1)
+        parent_->dropping_.store(false, std::memory_order_relaxed);
+    parent_->in_flight_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+admission_controller::ticket::ticket(ticket&& other) noexcept
+    : parent_(std::exchange(other.parent_, nullptr))
+    , enqueued_(other.enqueued_)
+    , started_(other.started_)
+    , queued_(std::exchange(other.queued_, false)) {}
+
+auto admission_controller::ticket::operator=(ticket&& other) noexcept -> ticket& {
+    if (this != &other) {
+        ticket tmp{std::move(*this)};
+        parent_ = std::exchange(other.parent_, nullptr);
+        enqueued_ = other.enqueued_;
+        started_ = other.started_;
+        queued_ = std::exchange(other.queued_, false);
+    }
+    return *this;
+}
+
+auto admission_controller::ticket::enqueue() noexcept -> void {
+    if (!parent_ || queued_)
+        return;
+    queued_ = true;
+    enqueued_ = clock::now();
+    parent_->queued_.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto admission_controller::ticket::start() noexcept -> void {
+    if (!parent_ || !queued_)
+        return;
+    queued_ = false;
+    started_ = clock::now();
+    parent_->on_dequeue(started_ - enqueued_);
+}
+
+auto admission_controller::try_admit() noexcept -> ticket {
+    if ((opts_.max_in_flight_ > 0
+                && in_flight_.load(std::memory_order_relaxed) >= opts_.max_in_flight_)
+            || (opts_.max_queued_ > 0
+                    && queued_.load(std::memory_order_relaxed) >= opts_.max_queued_)) {
+        rejected_limits_.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+    if (dropping_.load(std::memory_order_relaxed)) {
+        rejected_delay_.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+    in_flight_.fetch_add(1, std::memory_order_relaxed);
+    admitted_.fetch_add(1, std::memory_order_relaxed);
+    return ticket{this};
+}
+
+auto admission_controller::stats() const noexcept -> admission_stats {
+    return {
+            admitted_.load(std::memory_order_relaxed),
+            rejected_limits_.load(std::memory_order_relaxed),
+            rejected_delay_.load(std::memory_order_relaxed),
+    };
+}
+
+auto admission_controller::on_dequeue(clock::duration delay) noexcept -> void {
+    bool queue_empty = queued_.fetch_sub(1, std::memory_order_relaxed) == 1;
+    if (opts_.target_delay_ <= clock::duration::zero())
+        return;
+
+    // Short bursts are fine; we only react if the delay stays above the target for an interval
+    if (delay < opts_.target_delay_ || queue_empty) {
+        above_deadline_.store(0, std::memory_order_relaxed);
+        dropping_.store(false, std::memory_order_relaxed);
+        return;
+    }
+    auto now = clock::now().time_since_epoch().count();
+    clock::rep expected = 0;
+    auto deadline = now + std::chrono::duration_cast<clock::duration>(opts_.interval_).count();
+    if (above_deadline_.compare_exchange_strong(expected, deadline, std::memory_order_relaxed))
+        return; // First time above the target
+    if (now >= expected)
+        dropping_.store(true, std::memory_order_relaxed);
+}
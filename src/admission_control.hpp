@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+//! The thresholds used by the admission controller. Zero disables the corresponding check.
+struct admission_options {
+    //! The maximum number of admitted requests that didn't complete yet
+    std::size_t max_in_flight_{0};
+    //! The maximum number of requests waiting for a worker thread
+    std::size_t max_queued_{0};
+    //! The queueing delay that we aim for; if the requests wait longer than this for a worker
+    //! during a whole `interval_`, the server is overloaded
+    std::chrono::milliseconds target_delay_{0};
+    std::chrono::milliseconds interval_{1000};
+};
+
+//! Counters of the admission controller
+struct admission_stats {
+    std::uint64_t admitted_{0};
+    //! Requests rejected because there were too many in-flight or queued requests
+    std::uint64_t rejected_limits_{0};
+    //! Requests rejected because the queueing delay stayed above the target
+    std::uint64_t rejected_delay_{0};
+};
+
+//! Decides whether the server can take new requests, so that the worker pool doesn't accumulate
+//! more work than it can handle in a reasonable time.
+//!
+//! Tracks the requests that are in flight, and the ones waiting for a worker thread. Besides the
+//! hard limits on these, it measures how long the requests wait for a worker; as in CoDel, if this
+//! delay stays above the target for a whole interval, the queue is not just absorbing a burst, and
+//! we reject new requests until the delay goes back under the target or the queue empties.
+//!
+//! Requests are admitted on the I/O threads and processed on the worker threads; all the
+//! operations are thread-safe.
+class admission_controller {
+public:
+    using clock = std::chrono::steady_clock;
+
+    //! Tracks an admitted request; when destroyed, the request is no longer in flight
+    class ticket {
+    public:
+        ticket() = default;
+        ~ticket();
+        ticket(ticket&& other) noexcept;
+        auto operator=(ticket&& other) noexcept -> ticket&;
+
+        ticket(const ticket& other) = delete;
+        auto operator=(const ticket& other) -> ticket& = delete;
+
+        //! Check if the request was admitted
+        explicit operator bool() const noexcept { return parent_ != nullptr; }
+
+        //! Called when the request is handed to the worker pool
+        auto enqueue() noexcept -> void;
+        //! Called on the worker thread, when the processing of the request starts
+        auto start() noexcept -> void;
+
+        //! The times at which the request was handed to the worker pool, and at which its
+        //! processing started; set by `enqueue()` and `start()`
+        auto enqueued_at() const noexcept -> clock::time_point { return enqueued_; }
+        auto started_at() const noexcept -> clock::time_point { return started_; }
+
+    private:
+        friend class admission_controller;
+        explicit ticket(admission_controller* parent)
+            : parent_(parent) {}
+
+        admission_controller* parent_{nullptr};
+        clock::time_point enqueued_{};
+        clock::time_point started_{};
+        bool queued_{false};
+    };
+
+    explicit admission_controller(admission_options opts)
+        : opts_(opts) {}
+
+    //! Try to admit a new request; returns an empty ticket if the server is overloaded
+    auto try_admit() noexcept -> ticket;
+
+    //! Get the counters; read them after the work is done
+    auto stats() const noexcept -> admission_stats;
+
+private:
+    admission_options opts_;
+    std::atomic<std::size_t> in_flight_{0};
+    std::atomic<std::size_t> queued_{0};
+    //! Set while we reject the requests because of the queueing delay
+    std::atomic<bool> dropping_{false};
+    //! When the delay went above the target, plus the interval; zero if it is below the target
+    std::atomic<clock::rep> above_deadline_{0};
+
+    std::atomic<std::uint64_t> admitted_{0};
+    std::atomic<std::uint64_t> rejected_limits_{0};
+    std::atomic<std::uint64_t> rejected_delay_{0};
+
+    auto on_dequeue(clock::duration delay) noexcept -> void;
+};
@@ -1,12 +1,103 @@
 #pragma once
 
+#include "access_log.hpp"
+#include "admission_control.hpp"
+#include "http_server/h2/session.hpp"
+#include "io/buffer_pool.hpp"
 #include "io/connection.hpp"
 #include "io/io_context.hpp"
+#include "response_cache.hpp"
 #include "schedulers/static_thread_pool.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+class image_cache;
+
+//! The deadlines applied to the connections of a listener. A zero value means no deadline.
+struct conn_timeouts {
+    //! Time allowed for receiving the request line and the headers
+    std::chrono::milliseconds header_read_{0};
+    //! Time allowed for receiving the body of the request, after the headers
+    std::chrono::milliseconds body_read_{0};
+    //! Time allowed for writing the response
+    std::chrono::milliseconds write_{0};
+    //! Time a persistent connection may stay idle, waiting for the next request
+    std::chrono::milliseconds idle_{0};
+    //! Time we keep discarding what the client sends, when we close a connection whose input we
+    //! didn't read entirely; zero closes the connection right away
+    std::chrono::milliseconds linger_{0};
+};
+
+//! The limits applied to the connections and the requests of a listener. Zero means no limit.
+struct conn_limits {
+    //! The maximum number of requests served on a connection
+    std::size_t max_requests_{0};
+    //! The maximum size of a request body; larger requests are rejected before reading the body
+    std::size_t max_body_size_{0};
+    //! The maximum amount of data that we discard when we close a connection whose input we didn't
+    //! read entirely
+    std::size_t max_linger_size_{0};
+};
+
+//! Counters for the connections of a listener that were closed because a deadline expired.
+//! Only updated from the I/O thread of the listener.
+struct reap_counters {
+    std::uint64_t header_read_{0};
+    std::uint64_t body_read_{0};
+    std::uint64_t write_{0};
+    //! Persistent connections closed because no new request came in time; not an error
+    std::uint64_t idle_{0};
+};
+
+//! Counters for the zero-copy sends made on the connections of a listener.
+//! Only updated from the I/O thread of the listener.
+struct zerocopy_counters {
+    //! The number of sends made with `MSG_ZEROCOPY`
+    std::uint64_t sends_{0};
+    //! The number of those sends for which the kernel had to copy the data anyway
+    std::uint64_t copied_{0};
+};
+
+//! The objects used by the connections of a shard: the state owned by the shard, and the objects
+//! shared by all the shards. Outlives the listener of the shard and all its connections.
+struct shard_context {
+    io::io_context& io_ctx_;
+    example::static_thread_pool& pool_;
+    //! Decides whether we can give more work to `pool_`
+    admission_controller& admission_;
+    const conn_timeouts& timeouts_;
+    const conn_limits& limits_;
+    //! Response bodies of at least this size are sent with `MSG_ZEROCOPY`; zero disables it
+    std::size_t zerocopy_threshold_{0};
+    //! The parameters of the HTTP/2 connections; null if we only serve HTTP/1.x
+    const http_server::h2::session_options* h2_options_{nullptr};
+    //! The cache of the responses, shared by all the shards; null if disabled
+    response_cache* cache_{nullptr};
+    //! The cache of the decoded images and of the intermediate results of the transforms, shared
+    //! by all the shards; null if disabled
+    image_cache* images_{nullptr};
+    //! The ring of the access log in which the I/O thread records the requests; null if the access
+    //! log is disabled
+    access_log_ring* access_log_{nullptr};
+    //! Set when the server starts draining; the connections are no longer kept alive
+    const std::atomic<bool>& draining_;
+
+    // Owned by the shard; only used from its I/O thread
+
+    //! The pool of read buffers of the I/O thread
+    io::buffer_pool buffers_{};
+    reap_counters reaped_{};
+    zerocopy_counters zerocopy_stats_{};
+};
+
 //! Structure packing together important objects for a connection
 struct conn_data {
     io::connection conn_;
-    io::io_context& io_ctx_;
-    example::static_thread_pool& pool_;
+    //! The shard that serves the connection
+    shard_context& shard_;
+    //! Identifies the connection in the access log
+    std::uint64_t id_{0};
 };
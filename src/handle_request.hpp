@@ -7,38 +7,167 @@
 #include "io/io_context.hpp"
 #include "io/connection.hpp"
 #include "conn_data.hpp"
-#include "parsed_uri.hpp"
+#include "hash.hpp"
+#include "image_cache.hpp"
+#include "query_params.hpp"
 #include "profiling.hpp"
+#include "response_cache.hpp"
+#include "routes.hpp"
 
 #include <task.hpp>
 
 #include <cstdio>
-#include <thread>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
 #include <chrono>
 
 using namespace std::chrono_literals;
 
 namespace ex = std::execution;
 
-auto handle_request(const conn_data& cdata, http_server::http_request req)
-        -> task<http_server::http_response> {
-    { PROFILING_SCOPE_N("handle_request -- start"); }
+namespace detail {
+//! Calls the handler for the given parameters, whether it is synchronous or not
+template <typename Params>
+auto call_handler(const conn_data& cdata, http_server::http_request req, Params params,
+        image_key source) -> task<http_server::http_response> {
+    using result_t = decltype(handle_transform(cdata, std::move(req), params, source));
+    if constexpr (std::is_same_v<result_t, http_server::http_response>)
+        co_return handle_transform(cdata, std::move(req), params, source);
+    else
+        co_return co_await handle_transform(cdata, std::move(req), params, source);
+}
+} // namespace detail
+
+//! Routes the request, and checks it before its body is read, so that we don't wait for the upload
+//! of requests that we would reject anyway. Unknown paths get 404, invalid parameters get 400, and
+//! too large bodies get 413. Returns the response for the rejected requests; otherwise, fills in
+//! `params`, to be passed to `handle_request()`.
+//! This is cheap; it runs on the I/O thread.
+auto check_request_head(const conn_data& cdata, const http_server::http_request& req,
+        std::size_t body_size, route_params& params) -> std::optional<http_server::http_response> {
+    PROFILING_SCOPE();
+    auto query_pos = req.uri_.find('?');
+    std::string_view path = req.uri_.substr(0, query_pos);
+    std::string_view query;
+    if (query_pos != std::string_view::npos)
+        query = req.uri_.substr(query_pos + 1);
+
+    std::size_t route_idx = routes.find(path);
+    if (route_idx == routes.npos)
+        return http_server::create_response(http_server::status_code::s_404_not_found);
+    auto parsed = detail::parse_route_params(route_idx, query);
+    if (!parsed)
+        return http_server::create_response(http_server::status_code::s_400_bad_request);
+    if (cdata.shard_.limits_.max_body_size_ > 0 && body_size > cdata.shard_.limits_.max_body_size_)
+        return http_server::create_response(http_server::status_code::s_413_payload_too_large);
+    params = std::move(*parsed);
+    return std::nullopt;
+}
+
+//! Computes the key of the response to a request, from everything that the response depends on:
+//! the route, the parameters (with the defaults filled in), the format of the image, and the body.
+//! The ETag of the response is derived from it, so we know it before processing the request.
+//! Hashes the whole body, once; at several GB/s, this is cheap next to reading it. The hash of the
+//! body is kept in the key, for the image cache.
+auto response_key_of(const http_server::http_request& req, const route_params& params)
+        -> response_key {
+    PROFILING_SCOPE();
+    std::uint64_t body_hash = hash_bytes(req.body_);
+    std::uint64_t h = params.index();
+    std::visit(
+            [&](const auto& p) {
+                using params_t = std::remove_cvref_t<decltype(p)>;
+                for (const auto& spec : params_t::schema())
+                    h = hash_combine(h, static_cast<std::uint64_t>(p.*(spec.field_)));
+                auto format = negotiate_format(req, p, params_t::kind);
+                h = hash_combine(h, static_cast<std::uint64_t>(format));
+            },
+            params);
+    return {hash_combine(h, body_hash), req.body_.size(), body_hash};
+}
 
-#if HAS_OPENCV
-    auto puri = parse_uri(req.uri_);
-    std::printf("URI path: '%s'\n", std::string(puri.path_).c_str());
-    if (puri.path_ == "/transform/blur")
-        co_return handle_blur(cdata, std::move(req), puri);
-    else if (puri.path_ == "/transform/adaptthresh")
-        co_return handle_adaptthresh(cdata, std::move(req), puri);
-    else if (puri.path_ == "/transform/reducecolors")
-        co_return handle_reducecolors(cdata, std::move(req), puri);
-    else if (puri.path_ == "/transform/cartoonify")
-        co_return co_await handle_cartoonify(cdata, std::move(req), puri);
-    else if (puri.path_ == "/transform/oilpainting")
-        co_return handle_oilpainting(cdata, std::move(req), puri);
-    else if (puri.path_ == "/transform/contourpaint")
-        co_return co_await handle_contourpaint(cdata, std::move(req), puri);
-#endif
-    co_return http_server::create_response(http_server::status_code::s_404_not_found);
-}
\ No newline at end of file
+//! Returns the ETag of the response with the given key. It's a weak one: some transforms are not
+//! deterministic (the color reduction starts from random centers), so the same request may get
+//! different bytes, with the same meaning.
+auto etag_of(const response_key& key) -> std::string {
+    char buf[48];
+    std::snprintf(buf, sizeof(buf), "W/\"%016llx-%llx\"",
+            static_cast<unsigned long long>(key.hash_),
+            static_cast<unsigned long long>(key.body_size_));
+    return buf;
+}
+
+namespace detail {
+//! Check if the `If-None-Match` header of the request lists the ETag, with the weak comparison.
+//! A `*` doesn't match: it stands for any current representation, and we answer the requests
+//! without storing anything for their URIs.
+inline auto if_none_match(const http_server::http_request& req, std::string_view etag) -> bool {
+    std::string_view value = req.headers_.find(http_server::header_field::if_none_match);
+    std::string_view tag = etag.substr(2); // Without `W/`
+    while (!value.empty()) {
+        auto comma = value.find(',');
+        auto item = value.substr(0, comma);
+        value.remove_prefix(comma == std::string_view::npos ? value.size() : comma + 1);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t'))
+            item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t'))
+            item.remove_suffix(1);
+        if (item.starts_with("W/"))
+            item.remove_prefix(2);
+        if (item == tag)
+            return true;
+    }
+    return false;
+}
+} // namespace detail
+
+//! Answers a request without processing it, if we can: when the client already has the response,
+//! as told by `If-None-Match`, or with the response from the cache.
+//! A matching `If-None-Match` gets `304 Not Modified` for GET and HEAD requests, and, as RFC 9110
+//! requires, `412 Precondition Failed` for the other methods (the transforms are usually POSTs).
+//! Both come with the response cache; without it, every request is processed.
+//! This runs on the I/O thread, and saves the work of the worker pool.
+auto answer_without_processing(const conn_data& cdata, const http_server::http_request& req,
+        const route_params& params, const response_key& key)
+        -> std::optional<http_server::http_response> {
+    PROFILING_SCOPE();
+    if (!cdata.shard_.cache_)
+        return std::nullopt;
+    std::string etag = etag_of(key);
+    if (detail::if_none_match(req, etag)) {
+        using http_server::http_method;
+        if (req.method_ != http_method::get && req.method_ != http_method::head)
+            return http_server::create_response(
+                    http_server::status_code::s_412_precondition_failed);
+        // A 304 has the validator and the `Vary` of the response that it stands for
+        http_server::headers hs{{"ETag", std::move(etag)}};
+        if (std::visit([](const auto& p) { return p.format_ == 0; }, params))
+            hs.push_back({"Vary", "Accept"});
+        return http_server::create_response(
+                http_server::status_code::s_304_not_modified, std::move(hs));
+    }
+    auto cached = cdata.shard_.cache_->find(key);
+    if (!cached)
+        return std::nullopt;
+    return *cached;
+}
+
+//! Handles a request that passed `check_request_head()`, with the parameters given by it.
+//! If the response cache is enabled, the successful responses get their ETag, and are added to it.
+auto handle_request(const conn_data& cdata, http_server::http_request req, route_params params,
+        response_key key) -> task<http_server::http_response> {
+    { PROFILING_SCOPE_N("handle_request -- start"); }
+    image_key source = source_key(key.body_hash_, key.body_size_);
+    auto handler = std::visit(
+            [&](const auto& p) { return detail::call_handler(cdata, std::move(req), p, source); },
+            params);
+    auto resp = co_await std::move(handler);
+    if (cdata.shard_.cache_ && resp.status_code_ == http_server::status_code::s_200_ok) {
+        resp.headers_.push_back({"ETag", etag_of(key)});
+        cdata.shard_.cache_->insert(key, resp);
+    }
+    co_return resp;
+}
@@ -5,190 +5,390 @@
 #if HAS_OPENCV
 
 #include "http_server/http_request.hpp"
+#include "image_cache.hpp"
 #include "profiling.hpp"
 
 #include <execution.hpp>
 
 #include <opencv2/imgcodecs.hpp>
 
+#include <cstring>
+#include <string_view>
+#include <strings.h>
+#include <vector>
+
 namespace ex = std::execution;
 
 namespace {
 
-auto sv_to_int(std::string_view value) -> int {
-    int res = 0;
-    for (char c : value)
-        res = res * 10 + (c - '0');
+auto to_cv(const std::string& bytes) -> cv::Mat {
+    PROFILING_SCOPE();
+    cv::Mat raw_data(1, bytes.size(), CV_8UC1, (void*)bytes.data());
+    return cv::imdecode(raw_data, cv::IMREAD_COLOR);
+}
+
+//! Returns the result of a stage from the image cache, or computes it and adds it to the cache.
+//! Requests for the same image may compute a stage at the same time; the first result is kept.
+template <typename F>
+auto memoized(const conn_data& cdata, const image_key& key, F&& compute) -> cv::Mat {
+    if (!cdata.shard_.images_)
+        return compute();
+    cv::Mat res = cdata.shard_.images_->find(key);
+    if (res.empty()) {
+        res = compute();
+        if (!res.empty())
+            cdata.shard_.images_->insert(key, res);
+    }
     return res;
 }
 
-auto get_param_int(const parsed_uri& uri, std::string_view name, int default_val) -> int {
-    for (auto p : uri.params_)
-        if (p.name_ == name)
-            return sv_to_int(p.value_);
-    return default_val;
+//! Decodes the image in the request body, whose key is `source`
+auto decode(const conn_data& cdata, const std::string& body, const image_key& source) -> cv::Mat {
+    auto key = stage_key(source, image_stage::decoded, {});
+    return memoized(cdata, key, [&] { return to_cv(body); });
 }
 
-auto to_cv(const std::string& bytes) -> cv::Mat {
-    PROFILING_SCOPE();
-    cv::Mat raw_data(1, bytes.size(), CV_8UC1, (void*)bytes.data());
-    return cv::imdecode(raw_data, cv::IMREAD_COLOR);
+//! Computes the edges of the image: the mask of `adaptthresh`, on which `cartoonify` and
+//! `contourpaint` draw
+auto compute_edges(const conn_data& cdata, const cv::Mat& src, const image_key& source,
+        int blur_size, int block_size, int diff) -> cv::Mat {
+    auto key = stage_key(source, image_stage::edges, {blur_size, block_size, diff});
+    return memoized(cdata, key, [&] {
+        auto blurred = tr_blur(src, blur_size);
+        auto gray = tr_to_grayscale(blurred);
+        return tr_adaptthresh(gray, block_size, diff);
+    });
+}
+
+auto reduce_colors(const conn_data& cdata, const cv::Mat& src, const image_key& source,
+        int num_colors) -> cv::Mat {
+    auto key = stage_key(source, image_stage::reduced_colors, {num_colors});
+    return memoized(cdata, key, [&] { return tr_reducecolors(src, num_colors); });
 }
 
-auto img_to_response(const cv::Mat& img) -> http_server::http_response {
+auto oil_painting(const conn_data& cdata, const cv::Mat& src, const image_key& source, int size,
+        int dyn_ratio) -> cv::Mat {
+    auto key = stage_key(source, image_stage::oil_painting, {size, dyn_ratio});
+    return memoized(cdata, key, [&] { return tr_oilpainting(src, size, dyn_ratio); });
+}
+
+//! How we encode an image, with the parameters of the format
+struct image_encoding {
+    image_format format_;
+    int quality_;
+    bool progressive_;
+    int compression_;
+    //! Set if the format was chosen from the `Accept` header
+    bool negotiated_;
+};
+
+//! Returns the preference of the client for the media type, from the `Accept` header, in
+//! thousandths; zero if the client doesn't accept it. WebP needs to be listed explicitly, as the
+//! clients that send `*/*` may not support it.
+auto accept_weight(std::string_view accept, std::string_view media_type) -> int {
+    auto trim = [](std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+            s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+            s.remove_suffix(1);
+        return s;
+    };
+    auto iequals = [](std::string_view a, std::string_view b) {
+        return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+    };
+    bool explicit_only = media_type == "image/webp";
+    // The most specific range that matches decides the weight
+    int best_specificity = -1;
+    int weight = 0;
+    while (!accept.empty()) {
+        auto comma = accept.find(',');
+        auto item = accept.substr(0, comma);
+        accept.remove_prefix(comma == std::string_view::npos ? accept.size() : comma + 1);
+
+        auto semicolon = item.find(';');
+        auto range = trim(item.substr(0, semicolon));
+        int specificity = -1;
+        if (iequals(range, media_type))
+            specificity = 2;
+        else if (!explicit_only && iequals(range, "image/*"))
+            specificity = 1;
+        else if (!explicit_only && range == "*/*")
+            specificity = 0;
+        if (specificity <= best_specificity)
+            continue;
+        best_specificity = specificity;
+
+        // The weight comes from the `q` parameter: a number from 0 to 1, with up to 3 decimals
+        weight = 1000;
+        while (semicolon != std::string_view::npos) {
+            item.remove_prefix(semicolon + 1);
+            semicolon = item.find(';');
+            auto param = trim(item.substr(0, semicolon));
+            if (param.size() < 3 || (param[0] != 'q' && param[0] != 'Q') || param[1] != '=')
+                continue;
+            param.remove_prefix(2);
+            weight = param[0] == '1' ? 1000 : 0;
+            if (param.size() > 2 && param[0] == '0' && param[1] == '.') {
+                int scale = 100;
+                for (std::size_t i = 2; i < param.size() && i < 5 && scale > 0; i++, scale /= 10)
+                    if (param[i] >= '0' && param[i] <= '9')
+                        weight += (param[i] - '0') * scale;
+            }
+        }
+    }
+    return weight;
+}
+
+//! Chooses how to encode the resulting image, with the parameters of the format
+auto choose_encoding(const http_server::http_request& req, const output_params& params,
+        image_kind kind) -> image_encoding {
+    image_format format = negotiate_format(req, params, kind);
+    image_encoding res{format, params.quality_, params.progressive_ != 0, params.compression_,
+            params.format_ == 0};
+    if (res.quality_ == 0) {
+        // For WebP, above 100 means lossless
+        if (format == image_format::webp)
+            res.quality_ = kind == image_kind::photo ? 80 : 101;
+        else
+            res.quality_ = 85;
+    }
+    if (res.compression_ < 0)
+        res.compression_ = 6;
+    return res;
+}
+
+auto img_to_response(const cv::Mat& img, const image_encoding& enc) -> http_server::http_response {
     PROFILING_SCOPE();
+    const char* ext = ".jpeg";
+    std::string_view content_type = "image/jpeg";
+    std::vector<int> params;
+    cv::Mat bw;
+    switch (enc.format_) {
+    case image_format::automatic:
+    case image_format::jpeg:
+        // Optimizing the Huffman tables makes the images smaller, for little time
+        params = {cv::IMWRITE_JPEG_QUALITY, enc.quality_, cv::IMWRITE_JPEG_OPTIMIZE, 1,
+                cv::IMWRITE_JPEG_PROGRESSIVE, enc.progressive_ ? 1 : 0};
+        break;
+    case image_format::png:
+        ext = ".png";
+        content_type = "image/png";
+        params = {cv::IMWRITE_PNG_COMPRESSION, enc.compression_};
+        break;
+    case image_format::webp:
+        ext = ".webp";
+        content_type = "image/webp";
+        params = {cv::IMWRITE_WEBP_QUALITY, enc.quality_};
+        break;
+    case image_format::mask:
+        // The pixels are written as white if they are not black; turn them into black and white
+        ext = ".png";
+        content_type = "image/png";
+        if (img.channels() > 1) {
+            cv::cvtColor(img, bw, cv::COLOR_BGR2GRAY);
+            cv::threshold(bw, bw, 127, 255, cv::THRESH_BINARY);
+        } else {
+            cv::threshold(img, bw, 127, 255, cv::THRESH_BINARY);
+        }
+        params = {cv::IMWRITE_PNG_BILEVEL, 1, cv::IMWRITE_PNG_COMPRESSION, enc.compression_};
+        break;
+    }
+
     std::vector<uchar> buf;
-    if (!cv::imencode(".jpeg", img, buf))
+    if (!cv::imencode(ext, bw.empty() ? img : bw, buf, params))
         throw std::logic_error("Cannot encode OpenCV image");
     std::string body;
     body.resize(buf.size());
     std::memcpy(body.data(), buf.data(), buf.size());
     PROFILING_SET_TEXT_FMT(32, "body_size=%d", int(buf.size()));
+    // If we chose the format from the `Accept` header, caches need to know it
+    http_server::headers hs;
+    if (enc.negotiated_)
+        hs.push_back({"Vary", "Accept"});
     return http_server::create_response(
-            http_server::status_code::s_200_ok, "application/jpeg", std::move(body));
+            http_server::status_code::s_200_ok, std::move(hs), content_type, std::move(body));
 }
 
 } // namespace
 
-auto handle_blur(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response {
-    PROFILING_SCOPE();
-    int size = get_param_int(puri, "size", 3);
-    auto src = to_cv(req.body_);
-    auto res = tr_blur(src, size);
-    return img_to_response(res);
+//! Unless the client asks for a format in the parameters, we pick the smallest output for the
+//! kind of image, among the formats that the client accepts:
+//!   - photos: lossy WebP, or JPEG;
+//!   - flat colors: lossless WebP, or PNG; JPEG blurs the edges between the colors, and is larger;
+//!   - masks: lossless WebP, or 1-bit PNG.
+auto negotiate_format(const http_server::http_request& req, const output_params& params,
+        image_kind kind) -> image_format {
+    auto format = static_cast<image_format>(params.format_);
+    if (format == image_format::automatic) {
+        static const bool have_webp = cv::haveImageWriter(".webp");
+        std::string_view accept = req.headers_.find(http_server::header_field::accept);
+        if (accept.empty())
+            accept = "*/*";
+        // Our preferences for each kind of image; the second one is the default, if the client
+        // doesn't accept any of them
+        static constexpr image_format preferences[][3] = {
+                {image_format::webp, image_format::jpeg, image_format::png},
+                {image_format::webp, image_format::png, image_format::jpeg},
+                {image_format::webp, image_format::mask, image_format::jpeg},
+        };
+        const auto& candidates = preferences[static_cast<int>(kind)];
+        format = candidates[1];
+        int best_weight = 0;
+        for (image_format f : candidates) {
+            if (f == image_format::webp && !have_webp)
+                continue;
+            int weight = accept_weight(accept, f == image_format::webp   ? "image/webp"
+                                               : f == image_format::jpeg ? "image/jpeg"
+                                                                         : "image/png");
+            if (weight > best_weight) {
+                best_weight = weight;
+                format = f;
+            }
+        }
+    }
+    return format;
 }
 
-auto handle_adaptthresh(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response {
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const blur_params& params, const image_key& source) -> http_server::http_response {
     PROFILING_SCOPE();
-    int blur_size = get_param_int(puri, "blur_size", 3);
-    int block_size = get_param_int(puri, "block_size", 5);
-    int diff = get_param_int(puri, "diff", 5);
+    auto src = decode(cdata, req.body_, source);
+    auto res = tr_blur(src, params.size_);
+    return img_to_response(res, choose_encoding(req, params, params.kind));
+}
 
-    auto src = to_cv(req.body_);
-    auto blurred = tr_blur(src, blur_size);
-    auto gray = tr_to_grayscale(blurred);
-    auto res = tr_adaptthresh(gray, block_size, diff);
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const adaptthresh_params& params, const image_key& source) -> http_server::http_response {
+    PROFILING_SCOPE();
+    auto src = decode(cdata, req.body_, source);
+    auto res =
+            compute_edges(cdata, src, source, params.blur_size_, params.block_size_, params.diff_);
 
-    return img_to_response(res);
+    return img_to_response(res, choose_encoding(req, params, params.kind));
 }
 
-auto handle_reducecolors(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response {
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const reducecolors_params& params, const image_key& source) -> http_server::http_response {
     PROFILING_SCOPE();
-    int num_colors = get_param_int(puri, "num_colors", 5);
-    auto src = to_cv(req.body_);
-    auto res = tr_reducecolors(src, num_colors);
-    return img_to_response(res);
+    auto src = decode(cdata, req.body_, source);
+    auto res = reduce_colors(cdata, src, source, params.num_colors_);
+    return img_to_response(res, choose_encoding(req, params, params.kind));
 }
 
-auto handle_cartoonify(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> task<http_server::http_response> {
-    int blur_size = get_param_int(puri, "blur_size", 3);
-    int num_colors = get_param_int(puri, "num_colors", 5);
-    int block_size = get_param_int(puri, "block_size", 5);
-    int diff = get_param_int(puri, "diff", 5);
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const cartoonify_params& params,
+        const image_key& source) -> task<http_server::http_response> {
+    int blur_size = params.blur_size_;
+    int num_colors = params.num_colors_;
+    int block_size = params.block_size_;
+    int diff = params.diff_;
 
-    auto src = to_cv(req.body_);
+    auto enc = choose_encoding(req, params, params.kind);
+    auto src = decode(cdata, req.body_, source);
 
     ex::sender auto snd =                                               //
             ex::when_all(                                               //
-                    ex::transfer_just(cdata.pool_.get_scheduler(), src) //
-                            | ex::then([=](const cv::Mat& src) {
+                    ex::transfer_just(cdata.shard_.pool_.get_scheduler(), src) //
+                            | ex::then([=, &cdata](const cv::Mat& src) {
                                   PROFILING_SCOPE_N("compute edges");
-                                  auto blurred = tr_blur(src, blur_size);
-                                  auto gray = tr_to_grayscale(blurred);
-                                  auto edges = tr_adaptthresh(gray, block_size, diff);
-                                  return edges;
+                                  return compute_edges(
+                                          cdata, src, source, blur_size, block_size, diff);
                               }),
-                    ex::transfer_just(cdata.pool_.get_scheduler(), src) //
-                            | ex::then([=](const cv::Mat& src) {        //
+                    ex::transfer_just(cdata.shard_.pool_.get_scheduler(), src) //
+                            | ex::then([=, &cdata](const cv::Mat& src) { //
                                   PROFILING_SCOPE_N("reduce colors");
-                                  return tr_reducecolors(src, num_colors);
+                                  return reduce_colors(cdata, src, source, num_colors);
                               })                                                 //
                     )                                                            //
             | ex::then([](const cv::Mat& edges, const cv::Mat& reduced_colors) { //
                   PROFILING_SCOPE_N("apply mask");
                   return tr_apply_mask(reduced_colors, edges);
               }) //
-            | ex::then(img_to_response);
+            | ex::then([enc](const cv::Mat& img) { return img_to_response(img, enc); });
     co_return co_await std::move(snd);
 }
 
-auto handle_oilpainting(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response {
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const oilpainting_params& params, const image_key& source) -> http_server::http_response {
     PROFILING_SCOPE();
-    int size = get_param_int(puri, "size", 10);
-    int dyn_ratio = get_param_int(puri, "dyn_ratio", 1);
-    auto src = to_cv(req.body_);
-    auto res = tr_oilpainting(src, size, dyn_ratio);
-    return img_to_response(res);
+    auto src = decode(cdata, req.body_, source);
+    auto res = oil_painting(cdata, src, source, params.size_, params.dyn_ratio_);
+    return img_to_response(res, choose_encoding(req, params, params.kind));
 }
 
-auto handle_contourpaint(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> task<http_server::http_response> {
-    int blur_size = get_param_int(puri, "blur_size", 3);
-    int block_size = get_param_int(puri, "block_size", 5);
-    int diff = get_param_int(puri, "diff", 5);
-    int oil_size = get_param_int(puri, "oil_size", 3);
-    int dyn_ratio = get_param_int(puri, "dyn_ratio", 5);
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const contourpaint_params& params,
+        const image_key& source) -> task<http_server::http_response> {
+    int blur_size = params.blur_size_;
+    int block_size = params.block_size_;
+    int diff = params.diff_;
+    int oil_size = params.oil_size_;
+    int dyn_ratio = params.dyn_ratio_;
 
-    auto src = to_cv(req.body_);
+    auto enc = choose_encoding(req, params, params.kind);
+    auto src = decode(cdata, req.body_, source);
 
     ex::sender auto snd =                                               //
             ex::when_all(                                               //
-                    ex::transfer_just(cdata.pool_.get_scheduler(), src) //
-                            | ex::then([=](const cv::Mat& src) {
+                    ex::transfer_just(cdata.shard_.pool_.get_scheduler(), src) //
+                            | ex::then([=, &cdata](const cv::Mat& src) {
                                   PROFILING_SCOPE_N("compute edges");
-                                  auto blurred = tr_blur(src, blur_size);
-                                  auto gray = tr_to_grayscale(blurred);
-                                  auto edges = tr_adaptthresh(gray, block_size, diff);
-                                  return edges;
+                                  return compute_edges(
+                                          cdata, src, source, blur_size, block_size, diff);
                               }),
-                    ex::transfer_just(cdata.pool_.get_scheduler(), src) //
-                            | ex::then([=](const cv::Mat& src) {        //
+                    ex::transfer_just(cdata.shard_.pool_.get_scheduler(), src) //
+                            | ex::then([=, &cdata](const cv::Mat& src) { //
                                   PROFILING_SCOPE_N("oil painting");
-                                  return tr_oilpainting(src, oil_size, dyn_ratio);
+                                  return oil_painting(cdata, src, source, oil_size, dyn_ratio);
                               })                                                 //
                     )                                                            //
             | ex::then([](const cv::Mat& edges, const cv::Mat& reduced_colors) { //
                   PROFILING_SCOPE_N("apply mask");
                   return tr_apply_mask(reduced_colors, edges);
               }) //
-            | ex::then(img_to_response);
+            | ex::then([enc](const cv::Mat& img) { return img_to_response(img, enc); });
     co_return co_await std::move(snd);
 }
 
 #else
 
-auto handle_blur(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response {
+auto negotiate_format(const http_server::http_request& /*req*/, const output_params& params,
+        image_kind /*kind*/) -> image_format {
+    return static_cast<image_format>(params.format_);
+}
+
+auto handle_transform(const conn_data& /*cdata*/, http_server::http_request&& /*req*/,
+        const blur_params& /*params*/, const image_key& /*source*/) -> http_server::http_response {
     return http_server::create_response(http_server::status_code::s_500_internal_server_error);
 }
 
-auto handle_adaptthresh(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response {
+auto handle_transform(const conn_data& /*cdata*/, http_server::http_request&& /*req*/,
+        const adaptthresh_params& /*params*/,
+        const image_key& /*source*/) -> http_server::http_response {
     return http_server::create_response(http_server::status_code::s_500_internal_server_error);
 }
 
-auto handle_reducecolors(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response {
+auto handle_transform(const conn_data& /*cdata*/, http_server::http_request&& /*req*/,
+        const reducecolors_params& /*params*/,
+        const image_key& /*source*/) -> http_server::http_response {
     return http_server::create_response(http_server::status_code::s_500_internal_server_error);
 }
 
-auto handle_cartoonify(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> task<http_server::http_response> {
+auto handle_transform(const conn_data& /*cdata*/, http_server::http_request&& /*req*/,
+        const cartoonify_params& /*params*/,
+        const image_key& /*source*/) -> task<http_server::http_response> {
     co_return http_server::create_response(http_server::status_code::s_500_internal_server_error);
 }
 
-auto handle_oilpainting(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response {
+auto handle_transform(const conn_data& /*cdata*/, http_server::http_request&& /*req*/,
+        const oilpainting_params& /*params*/,
+        const image_key& /*source*/) -> http_server::http_response {
     return http_server::create_response(http_server::status_code::s_500_internal_server_error);
 }
 
-auto handle_contourpaint(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> task<http_server::http_response> {
+auto handle_transform(const conn_data& /*cdata*/, http_server::http_request&& /*req*/,
+        const contourpaint_params& /*params*/,
+        const image_key& /*source*/) -> task<http_server::http_response> {
     co_return http_server::create_response(http_server::status_code::s_500_internal_server_error);
 }
 
@@ -2,7 +2,8 @@
 
 #include "img_transform.hpp"
 #include "conn_data.hpp"
-#include "parsed_uri.hpp"
+#include "image_cache.hpp"
+#include "transform_params.hpp"
 
 #include <task.hpp>
 
@@ -11,20 +12,30 @@ struct http_request;
 struct http_response;
 } // namespace http_server
 
-auto handle_blur(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response;
+//! Returns the format of the image in the response to the request: the one given in the
+//! parameters, or the best one for the kind of image, among the ones that the client accepts
+auto negotiate_format(const http_server::http_request& req, const output_params& params,
+        image_kind kind) -> image_format;
 
-auto handle_adaptthresh(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response;
+// The handlers; the type of the parameters selects the transform. `source` is the key of the
+// image in the request body, in the image cache.
 
-auto handle_reducecolors(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response;
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const blur_params& params, const image_key& source) -> http_server::http_response;
 
-auto handle_cartoonify(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> task<http_server::http_response>;
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const adaptthresh_params& params, const image_key& source) -> http_server::http_response;
 
-auto handle_oilpainting(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> http_server::http_response;
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const reducecolors_params& params, const image_key& source) -> http_server::http_response;
 
-auto handle_contourpaint(const conn_data& cdata, http_server::http_request&& req, parsed_uri puri)
-        -> task<http_server::http_response>;
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const cartoonify_params& params,
+        const image_key& source) -> task<http_server::http_response>;
+
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const oilpainting_params& params, const image_key& source) -> http_server::http_response;
+
+auto handle_transform(const conn_data& cdata, http_server::http_request&& req,
+        const contourpaint_params& params,
+        const image_key& source) -> task<http_server::http_response>;
@@ -0,0 +1,89 @@
+#include "hash.hpp"
+
+#include <cstring>
+
+namespace {
+
+constexpr std::uint64_t prime1 = 0x9e3779b185ebca87ULL;
+constexpr std::uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+constexpr std::uint64_t prime3 = 0x165667b19e3779f9ULL;
+constexpr std::uint64_t prime4 = 0x85ebca77c2b2ae63ULL;
+constexpr std::uint64_t prime5 = 0x27d4eb2f165667c5ULL;
+
+inline auto rotl(std::uint64_t x, int r) -> std::uint64_t { return (x << r) | (x >> (64 - r)); }
+
+// The input is read as little-endian words, like all the targets that we build for
+inline auto read64(const char* p) -> std::uint64_t {
+    std::uint64_t res;
+    std::memcpy(&res, p, sizeof(res));
+    return res;
+}
+inline auto read32(const char* p) -> std::uint64_t {
+    std::uint32_t res;
+    std::memcpy(&res, p, sizeof(res));
+    return res;
+}
+
+inline auto round(std::uint64_t acc, std::uint64_t input) -> std::uint64_t {
+    acc += input * prime2;
+    acc = rotl(acc, 31);
+    return acc * prime1;
+}
+inline auto merge_round(std::uint64_t acc, std::uint64_t val) -> std::uint64_t {
+    acc ^= round(0, val);
+    return acc * prime1 + prime4;
+}
+
+} // namespace
+
+auto hash_bytes(std::string_view data, std::uint64_t seed) noexcept -> std::uint64_t {
+    const char* p = data.data();
+    const char* end = p + data.size();
+    std::uint64_t h;
+
+    if (data.size() >= 32) {
+        // Four independent lanes, 32 bytes at a time
+        std::uint64_t v1 = seed + prime1 + prime2;
+        std::uint64_t v2 = seed + prime2;
+        std::uint64_t v3 = seed;
+        std::uint64_t v4 = seed - prime1;
+        const char* limit = end - 32;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    } else {
+        h = seed + prime5;
+    }
+    h += static_cast<std::uint64_t>(data.size());
+
+    // The remaining bytes
+    for (; p + 8 <= end; p += 8) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * prime1 + prime4;
+    }
+    if (p + 4 <= end) {
+        h ^= read32(p) * prime1;
+        h = rotl(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= static_cast<unsigned char>(*p) * prime5;
+        h = rotl(h, 11) * prime1;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
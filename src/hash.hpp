@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+//! Hashes the bytes with XXH64; fast (several GB/s), with a good distribution, but not meant to
+//! resist attacks. Different seeds give independent hashes.
+auto hash_bytes(std::string_view data, std::uint64_t seed = 0) noexcept -> std::uint64_t;
+
+//! Mixes a value into a hash, for keys made of several values
+inline auto hash_combine(std::uint64_t hash, std::uint64_t value) noexcept -> std::uint64_t {
+    // The finalizer of SplitMix64 / MurmurHash3, applied to the combination
+    std::uint64_t x = hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
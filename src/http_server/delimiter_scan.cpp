@@ -0,0 +1,165 @@
+#include "delimiter_scan.hpp"
+
+// SSE2 is part of x86-64, so it needs no runtime check; AVX2 is chosen at runtime
+#if defined(__GNUC__) && defined(__SSE2__)
+#define HTTP_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace http_server::scan {
+
+namespace {
+
+//! Check if the line end at `pos` ends an empty line
+inline bool ends_empty_line(std::string_view data, std::size_t pos) noexcept {
+    return pos >= 2 && data[pos - 1] == '\r' && data[pos - 2] == '\n';
+}
+
+//! Records the line ends found in a block, given as a bitmask relative to `base`.
+//! Returns true if we need to stop.
+inline bool add_line_ends(std::string_view data, std::size_t base, std::uint32_t mask,
+        std::uint32_t* out, std::size_t max_out, std::size_t& count) noexcept {
+    while (mask != 0) {
+        std::size_t pos = base + static_cast<std::size_t>(__builtin_ctz(mask));
+        mask &= mask - 1;
+        out[count++] = static_cast<std::uint32_t>(pos);
+        if (count == max_out || ends_empty_line(data, pos))
+            return true;
+    }
+    return false;
+}
+
+std::size_t find_line_ends_scalar(std::string_view data, std::size_t from, std::uint32_t* out,
+        std::size_t max_out) noexcept {
+    std::size_t count = 0;
+    for (std::size_t i = from; i < data.size() && count < max_out; i++) {
+        if (data[i] != '\n')
+            continue;
+        out[count++] = static_cast<std::uint32_t>(i);
+        if (ends_empty_line(data, i))
+            break;
+    }
+    return count;
+}
+
+std::size_t find_char_scalar(std::string_view data, char c) noexcept { return data.find(c); }
+
+#if HTTP_SCAN_X86
+
+std::size_t find_line_ends_sse2(
+        std::string_view data, std::size_t from, std::uint32_t* out, std::size_t max_out) noexcept {
+    std::size_t count = 0;
+    if (max_out == 0)
+        return 0;
+    const __m128i nl = _mm_set1_epi8('\n');
+    std::size_t i = from;
+    for (; i + 16 <= data.size(); i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data.data() + i));
+        auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, nl)));
+        if (add_line_ends(data, i, mask, out, max_out, count))
+            return count;
+    }
+    return count + find_line_ends_scalar(data, i, out + count, max_out - count);
+}
+
+std::size_t find_char_sse2(std::string_view data, char c) noexcept {
+    const __m128i needle = _mm_set1_epi8(c);
+    std::size_t i = 0;
+    for (; i + 16 <= data.size(); i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data.data() + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask != 0)
+            return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+    auto pos = data.substr(i).find(c);
+    return pos == std::string_view::npos ? pos : i + pos;
+}
+
+__attribute__((target("avx2"))) std::size_t find_line_ends_avx2(
+        std::string_view data, std::size_t from, std::uint32_t* out, std::size_t max_out) noexcept {
+    std::size_t count = 0;
+    if (max_out == 0)
+        return 0;
+    const __m256i nl = _mm256_set1_epi8('\n');
+    std::size_t i = from;
+    for (; i + 32 <= data.size(); i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data.data() + i));
+        auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl)));
+        if (add_line_ends(data, i, mask, out, max_out, count))
+            return count;
+    }
+    // The SSE2 code doesn't use the VEX encoding; without clearing the upper halves of the
+    // registers, each of its instructions pays for the transition
+    _mm256_zeroupper();
+    return count + find_line_ends_sse2(data, i, out + count, max_out - count);
+}
+
+__attribute__((target("avx2"))) std::size_t find_char_avx2(std::string_view data, char c) noexcept {
+    const __m256i needle = _mm256_set1_epi8(c);
+    std::size_t i = 0;
+    for (; i + 32 <= data.size(); i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data.data() + i));
+        auto mask = static_cast<std::uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+        if (mask != 0)
+            return i + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+    _mm256_zeroupper();
+    auto pos = find_char_sse2(data.substr(i), c);
+    return pos == std::string_view::npos ? pos : i + pos;
+}
+
+#endif
+
+//! The implementation of the scans, chosen based on the CPU features
+struct scan_impl {
+    std::size_t (*find_line_ends_)(
+            std::string_view, std::size_t, std::uint32_t*, std::size_t) noexcept;
+    std::size_t (*find_char_)(std::string_view, char) noexcept;
+    std::string_view name_;
+};
+
+scan_impl choose_impl() noexcept {
+#if HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {&find_line_ends_avx2, &find_char_avx2, "avx2"};
+    return {&find_line_ends_sse2, &find_char_sse2, "sse2"};
+#else
+    return {&find_line_ends_scalar, &find_char_scalar, "scalar"};
+#endif
+}
+
+//! Chosen once, at startup; this way, the scans don't need to check if it was initialized
+scan_impl g_impl = choose_impl();
+
+} // namespace
+
+std::size_t find_line_ends(
+        std::string_view data, std::size_t from, std::uint32_t* out, std::size_t max_out) noexcept {
+    return g_impl.find_line_ends_(data, from, out, max_out);
+}
+
+std::size_t find_char(std::string_view data, char c) noexcept { return g_impl.find_char_(data, c); }
+
+std::string_view implementation_name() noexcept { return g_impl.name_; }
+
+bool use_implementation(std::string_view name) noexcept {
+    if (name == "scalar") {
+        g_impl = {&find_line_ends_scalar, &find_char_scalar, "scalar"};
+        return true;
+    }
+#if HTTP_SCAN_X86
+    if (name == "sse2") {
+        g_impl = {&find_line_ends_sse2, &find_char_sse2, "sse2"};
+        return true;
+    }
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        g_impl = {&find_line_ends_avx2, &find_char_avx2, "avx2"};
+        return true;
+    }
+#endif
+    return false;
+}
+
+} // namespace http_server::scan
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+//! Scanning for the delimiters of an HTTP request head.
+//!
+//! On x86, the scans use AVX2 if the CPU supports it, SSE2 otherwise; the implementation is chosen
+//! at runtime, at startup. Other platforms use scalar code.
+namespace http_server::scan {
+
+//! Finds the line ends (the '\n' characters) in `data`, starting at position `from`.
+//! Stores the positions in `out`, in order. Stops after the end of an empty line (the `\n\r\n`
+//! sequence that ends a request head), or when `out` is full.
+//! Returns the number of positions stored.
+std::size_t find_line_ends(
+        std::string_view data, std::size_t from, std::uint32_t* out, std::size_t max_out) noexcept;
+
+//! Returns the position of the first occurrence of `c` in `data`, or `std::string_view::npos`.
+std::size_t find_char(std::string_view data, char c) noexcept;
+
+//! Returns the name of the implementation used: "avx2", "sse2" or "scalar"
+std::string_view implementation_name() noexcept;
+
+//! Switches to the implementation with the given name, to compare the implementations in
+//! benchmarks. Returns false if the CPU doesn't support it. Must not be called while other threads
+//! are scanning.
+bool use_implementation(std::string_view name) noexcept;
+
+} // namespace http_server::scan
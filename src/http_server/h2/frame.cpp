@@ -0,0 +1,23 @@
+#include "frame.hpp"
+
+namespace http_server::h2 {
+
+frame_header parse_frame_header(const char* data) noexcept {
+    auto b = [&](int i) { return static_cast<std::uint32_t>(static_cast<unsigned char>(data[i])); };
+    frame_header res;
+    res.length_ = (b(0) << 16) | (b(1) << 8) | b(2);
+    res.type_ = static_cast<frame_type>(data[3]);
+    res.flags_ = static_cast<std::uint8_t>(data[4]);
+    // The most significant bit is reserved, and ignored
+    res.stream_id_ = read_u32(data + 5) & 0x7fffffff;
+    return res;
+}
+
+void append_frame_header(std::string& out, const frame_header& hdr) {
+    char bytes[5] = {char(hdr.length_ >> 16), char(hdr.length_ >> 8), char(hdr.length_),
+            static_cast<char>(hdr.type_), static_cast<char>(hdr.flags_)};
+    out.append(bytes, 5);
+    append_u32(out, hdr.stream_id_);
+}
+
+} // namespace http_server::h2
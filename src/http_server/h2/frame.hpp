@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <string_view>
+
+//! HTTP/2 (RFC 9113), over cleartext connections with prior knowledge (h2c)
+namespace http_server::h2 {
+
+//! What the client sends first on an HTTP/2 connection, before its SETTINGS frame
+constexpr std::string_view client_preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+//! The size of the header that starts every frame
+constexpr std::size_t frame_header_size = 9;
+
+//! The frame size that all endpoints must accept; we never advertise a larger one
+constexpr std::uint32_t default_max_frame_size = 16384;
+
+//! The initial size of the flow-control windows, before the SETTINGS frames change it
+constexpr std::int64_t default_window_size = 65535;
+//! The maximum size of a flow-control window
+constexpr std::int64_t max_window_size = 0x7fffffff;
+
+enum class frame_type : std::uint8_t {
+    data = 0x0,
+    headers = 0x1,
+    priority = 0x2,
+    rst_stream = 0x3,
+    settings = 0x4,
+    push_promise = 0x5,
+    ping = 0x6,
+    goaway = 0x7,
+    window_update = 0x8,
+    continuation = 0x9,
+};
+
+//! The flags of the frames; their meaning depends on the frame type
+namespace flags {
+constexpr std::uint8_t end_stream = 0x1;
+constexpr std::uint8_t ack = 0x1;
+constexpr std::uint8_t end_headers = 0x4;
+constexpr std::uint8_t padded = 0x8;
+constexpr std::uint8_t priority = 0x20;
+} // namespace flags
+
+//! The identifiers of the parameters in a SETTINGS frame
+enum class setting_id : std::uint16_t {
+    header_table_size = 0x1,
+    enable_push = 0x2,
+    max_concurrent_streams = 0x3,
+    initial_window_size = 0x4,
+    max_frame_size = 0x5,
+    max_header_list_size = 0x6,
+};
+
+//! The error codes used in RST_STREAM and GOAWAY frames
+enum class error_code : std::uint32_t {
+    no_error = 0x0,
+    protocol_error = 0x1,
+    internal_error = 0x2,
+    flow_control_error = 0x3,
+    settings_timeout = 0x4,
+    stream_closed = 0x5,
+    frame_size_error = 0x6,
+    refused_stream = 0x7,
+    cancel = 0x8,
+    compression_error = 0x9,
+    connect_error = 0xa,
+    enhance_your_calm = 0xb,
+    inadequate_security = 0xc,
+    http_1_1_required = 0xd,
+};
+
+//! An error that ends the whole connection; we send GOAWAY with the code, and close it
+struct connection_error : std::exception {
+    error_code code_;
+
+    explicit connection_error(error_code code)
+        : code_(code) {}
+    const char* what() const noexcept override { return "HTTP/2 connection error"; }
+};
+
+//! An error that ends a single stream; we send RST_STREAM with the code
+struct stream_error : std::exception {
+    error_code code_;
+
+    explicit stream_error(error_code code)
+        : code_(code) {}
+    const char* what() const noexcept override { return "HTTP/2 stream error"; }
+};
+
+//! The header of a frame
+struct frame_header {
+    //! The size of the payload, after the header
+    std::uint32_t length_{0};
+    frame_type type_{frame_type::data};
+    std::uint8_t flags_{0};
+    std::uint32_t stream_id_{0};
+
+    bool has_flag(std::uint8_t f) const noexcept { return (flags_ & f) != 0; }
+};
+
+//! Parses the frame header at the start of `data`, which has at least `frame_header_size` bytes
+frame_header parse_frame_header(const char* data) noexcept;
+
+//! Appends the frame header to `out`
+void append_frame_header(std::string& out, const frame_header& hdr);
+
+//! Reads the big-endian 32-bit integer at `data`
+inline std::uint32_t read_u32(const char* data) noexcept {
+    auto b = [&](int i) { return static_cast<std::uint32_t>(static_cast<unsigned char>(data[i])); };
+    return (b(0) << 24) | (b(1) << 16) | (b(2) << 8) | b(3);
+}
+
+//! Appends a big-endian 32-bit integer to `out`
+inline void append_u32(std::string& out, std::uint32_t value) {
+    char bytes[4] = {char(value >> 24), char(value >> 16), char(value >> 8), char(value)};
+    out.append(bytes, 4);
+}
+
+} // namespace http_server::h2
@@ -0,0 +1,299 @@
+#include "hpack.hpp"
+#include "frame.hpp"
+#include "huffman.hpp"
+#include "http_server/to_buffers.hpp"
+
+#include <array>
+#include <strings.h>
+
+namespace http_server::h2 {
+
+namespace {
+
+using namespace std::literals;
+
+//! The static table of HPACK (RFC 7541, Appendix A); index 1 is the first entry
+constexpr std::array static_table = {
+        std::pair{":authority"sv, ""sv},
+        std::pair{":method"sv, "GET"sv},
+        std::pair{":method"sv, "POST"sv},
+        std::pair{":path"sv, "/"sv},
+        std::pair{":path"sv, "/index.html"sv},
+        std::pair{":scheme"sv, "http"sv},
+        std::pair{":scheme"sv, "https"sv},
+        std::pair{":status"sv, "200"sv},
+        std::pair{":status"sv, "204"sv},
+        std::pair{":status"sv, "206"sv},
+        std::pair{":status"sv, "304"sv},
+        std::pair{":status"sv, "400"sv},
+        std::pair{":status"sv, "404"sv},
+        std::pair{":status"sv, "500"sv},
+        std::pair{"accept-charset"sv, ""sv},
+        std::pair{"accept-encoding"sv, "gzip, deflate"sv},
+        std::pair{"accept-language"sv, ""sv},
+        std::pair{"accept-ranges"sv, ""sv},
+        std::pair{"accept"sv, ""sv},
+        std::pair{"access-control-allow-origin"sv, ""sv},
+        std::pair{"age"sv, ""sv},
+        std::pair{"allow"sv, ""sv},
+        std::pair{"authorization"sv, ""sv},
+        std::pair{"cache-control"sv, ""sv},
+        std::pair{"content-disposition"sv, ""sv},
+        std::pair{"content-encoding"sv, ""sv},
+        std::pair{"content-language"sv, ""sv},
+        std::pair{"content-length"sv, ""sv},
+        std::pair{"content-location"sv, ""sv},
+        std::pair{"content-range"sv, ""sv},
+        std::pair{"content-type"sv, ""sv},
+        std::pair{"cookie"sv, ""sv},
+        std::pair{"date"sv, ""sv},
+        std::pair{"etag"sv, ""sv},
+        std::pair{"expect"sv, ""sv},
+        std::pair{"expires"sv, ""sv},
+        std::pair{"from"sv, ""sv},
+        std::pair{"host"sv, ""sv},
+        std::pair{"if-match"sv, ""sv},
+        std::pair{"if-modified-since"sv, ""sv},
+        std::pair{"if-none-match"sv, ""sv},
+        std::pair{"if-range"sv, ""sv},
+        std::pair{"if-unmodified-since"sv, ""sv},
+        std::pair{"last-modified"sv, ""sv},
+        std::pair{"link"sv, ""sv},
+        std::pair{"location"sv, ""sv},
+        std::pair{"max-forwards"sv, ""sv},
+        std::pair{"proxy-authenticate"sv, ""sv},
+        std::pair{"proxy-authorization"sv, ""sv},
+        std::pair{"range"sv, ""sv},
+        std::pair{"referer"sv, ""sv},
+        std::pair{"refresh"sv, ""sv},
+        std::pair{"retry-after"sv, ""sv},
+        std::pair{"server"sv, ""sv},
+        std::pair{"set-cookie"sv, ""sv},
+        std::pair{"strict-transport-security"sv, ""sv},
+        std::pair{"transfer-encoding"sv, ""sv},
+        std::pair{"user-agent"sv, ""sv},
+        std::pair{"vary"sv, ""sv},
+        std::pair{"via"sv, ""sv},
+        std::pair{"www-authenticate"sv, ""sv},
+};
+
+//! The size of an entry in the dynamic table, as defined by HPACK
+constexpr std::size_t entry_size(std::string_view name, std::string_view value) noexcept {
+    return name.size() + value.size() + 32;
+}
+
+connection_error compression_error() { return connection_error{error_code::compression_error}; }
+
+//! Decodes an integer with an N-bit prefix (RFC 7541, 5.1), advancing `pos`
+std::size_t decode_int(std::string_view block, std::size_t& pos, int prefix_bits) {
+    if (pos >= block.size())
+        throw compression_error();
+    std::size_t max_prefix = (std::size_t{1} << prefix_bits) - 1;
+    std::size_t value = static_cast<unsigned char>(block[pos++]) & max_prefix;
+    if (value < max_prefix)
+        return value;
+    // Larger values continue in 7-bit groups; we don't need values that take more than 28 bits
+    for (int shift = 0; shift <= 21; shift += 7) {
+        if (pos >= block.size())
+            throw compression_error();
+        auto byte = static_cast<unsigned char>(block[pos++]);
+        value += std::size_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+    throw compression_error();
+}
+
+//! Decodes a string literal (RFC 7541, 5.2), appending it to `out`, and advancing `pos`
+void decode_string(std::string_view block, std::size_t& pos, std::string& out) {
+    if (pos >= block.size())
+        throw compression_error();
+    bool huffman = (block[pos] & 0x80) != 0;
+    std::size_t size = decode_int(block, pos, 7);
+    if (size > block.size() - pos)
+        throw compression_error();
+    auto str = block.substr(pos, size);
+    pos += size;
+    if (!huffman)
+        out.append(str);
+    else if (!huffman_decode(str, out))
+        throw compression_error();
+}
+
+//! Appends an integer with an N-bit prefix to `out`; `first_byte` has the bits before the prefix
+void encode_int(std::string& out, std::uint8_t first_byte, int prefix_bits, std::size_t value) {
+    std::size_t max_prefix = (std::size_t{1} << prefix_bits) - 1;
+    if (value < max_prefix) {
+        out.push_back(static_cast<char>(first_byte | value));
+        return;
+    }
+    out.push_back(static_cast<char>(first_byte | max_prefix));
+    value -= max_prefix;
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+//! Appends a string literal, without the Huffman code, to `out`
+void encode_string(std::string& out, std::string_view str) {
+    encode_int(out, 0, 7, str.size());
+    out.append(str);
+}
+
+//! Check if the header only makes sense for HTTP/1.1 connections; they are not allowed in HTTP/2
+bool is_connection_specific(std::string_view name) {
+    for (auto h : {"connection"sv, "keep-alive"sv, "proxy-connection"sv, "transfer-encoding"sv,
+                 "upgrade"sv})
+        if (name.size() == h.size() && strncasecmp(name.data(), h.data(), h.size()) == 0)
+            return true;
+    return false;
+}
+
+} // namespace
+
+bool hpack_decoder::decode(std::string_view block, header_block& out, std::size_t max_list_size) {
+    auto append_field = [&out](std::size_t name_pos, std::size_t value_pos) {
+        auto end = out.data_.size();
+        out.fields_.push_back({static_cast<std::uint32_t>(name_pos),
+                static_cast<std::uint32_t>(value_pos - name_pos),
+                static_cast<std::uint32_t>(value_pos),
+                static_cast<std::uint32_t>(end - value_pos)});
+    };
+
+    std::size_t pos = 0;
+    bool at_start = true;
+    bool too_large = false;
+    while (pos < block.size()) {
+        auto first = static_cast<unsigned char>(block[pos]);
+        auto field_start = out.data_.size();
+        if (first & 0x80) {
+            // Indexed header field
+            auto [name, value] = lookup(decode_int(block, pos, 7));
+            auto name_pos = out.data_.size();
+            out.data_.append(name);
+            auto value_pos = out.data_.size();
+            out.data_.append(value);
+            append_field(name_pos, value_pos);
+        } else if ((first & 0xe0) == 0x20) {
+            // Dynamic table size update; only allowed at the start of the block
+            std::size_t size = decode_int(block, pos, 5);
+            if (!at_start || size > settings_max_table_size_)
+                throw compression_error();
+            max_table_size_ = size;
+            evict(max_table_size_);
+            continue;
+        } else {
+            // Literal header field: with incremental indexing, without indexing, or never indexed
+            bool indexing = (first & 0xc0) == 0x40;
+            std::size_t name_index = decode_int(block, pos, indexing ? 6 : 4);
+            auto name_pos = out.data_.size();
+            if (name_index != 0)
+                out.data_.append(lookup(name_index).first);
+            else
+                decode_string(block, pos, out.data_);
+            auto value_pos = out.data_.size();
+            decode_string(block, pos, out.data_);
+            append_field(name_pos, value_pos);
+            if (indexing)
+                add_entry(out.name(out.size() - 1), out.value(out.size() - 1));
+        }
+        at_start = false;
+        // Past the limit, we only keep the fields for as long as it takes to update the table
+        if (too_large || out.list_size() > max_list_size) {
+            too_large = true;
+            out.data_.resize(field_start);
+            out.fields_.pop_back();
+        }
+    }
+    return !too_large;
+}
+
+void hpack_decoder::add_entry(std::string_view name, std::string_view value) {
+    // Make room for the entry; if it's too large, the table ends up empty
+    std::size_t size = entry_size(name, value);
+    if (size > max_table_size_) {
+        evict(0);
+        return;
+    }
+    evict(max_table_size_ - size);
+    dynamic_table_.push_front({std::string{name}, std::string{value}});
+    table_size_ += size;
+}
+
+void hpack_decoder::evict(std::size_t max_size) noexcept {
+    while (table_size_ > max_size) {
+        const auto& e = dynamic_table_.back();
+        table_size_ -= entry_size(e.name_, e.value_);
+        dynamic_table_.pop_back();
+    }
+}
+
+std::pair<std::string_view, std::string_view> hpack_decoder::lookup(std::size_t index) const {
+    if (index == 0)
+        throw compression_error();
+    if (index <= static_table.size())
+        return static_table[index - 1];
+    index -= static_table.size() + 1;
+    if (index >= dynamic_table_.size())
+        throw compression_error();
+    const auto& e = dynamic_table_[index];
+    return {e.name_, e.value_};
+}
+
+void encode_response_head(const http_response& resp, std::string& out) {
+    // The status codes that are in the static table take a single byte
+    int status = status_code_value(resp.status_code_);
+    std::size_t status_index = 0;
+    switch (status) {
+    case 200:
+        status_index = 8;
+        break;
+    case 204:
+        status_index = 9;
+        break;
+    case 304:
+        status_index = 11;
+        break;
+    case 400:
+        status_index = 12;
+        break;
+    case 404:
+        status_index = 13;
+        break;
+    case 500:
+        status_index = 14;
+        break;
+    }
+    if (status_index != 0) {
+        encode_int(out, 0x80, 7, status_index);
+    } else {
+        // Literal without indexing, with the name of the `:status` entries
+        char digits[3] = {char('0' + status / 100), char('0' + status / 10 % 10),
+                char('0' + status % 10)};
+        encode_int(out, 0x00, 4, 8);
+        encode_string(out, {digits, 3});
+    }
+
+    bool has_length = false;
+    for (const auto& h : resp.headers_) {
+        if (is_connection_specific(h.name_))
+            continue;
+        if (strcasecmp(h.name_.c_str(), "content-length") == 0)
+            has_length = true;
+        // Literal without indexing, with a new name; names must be lowercase in HTTP/2
+        out.push_back(0x00);
+        encode_int(out, 0, 7, h.name_.size());
+        for (char c : h.name_)
+            out.push_back((c >= 'A' && c <= 'Z') ? char(c + 32) : c);
+        encode_string(out, h.value_);
+    }
+    if (!has_length && has_content_length(resp.status_code_)) {
+        // Literal without indexing, with the name of the static `content-length` entry
+        encode_int(out, 0x00, 4, 28);
+        encode_string(out, std::to_string(resp.body_.size()));
+    }
+}
+
+} // namespace http_server::h2
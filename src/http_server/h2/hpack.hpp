@@ -0,0 +1,99 @@
+#pragma once
+
+#include "http_server/http_response.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace http_server::h2 {
+
+//! The header fields decoded from a header block.
+//! The names and the values are stored one after the other in a single buffer, so a block is
+//! decoded with a couple of allocations, regardless of the number of fields.
+class header_block {
+public:
+    std::size_t size() const noexcept { return fields_.size(); }
+    std::string_view name(std::size_t i) const noexcept {
+        return {data_.data() + fields_[i].name_pos_, fields_[i].name_size_};
+    }
+    std::string_view value(std::size_t i) const noexcept {
+        return {data_.data() + fields_[i].value_pos_, fields_[i].value_size_};
+    }
+
+    //! The size of the header list, as limited by `SETTINGS_MAX_HEADER_LIST_SIZE`: the sizes of
+    //! the names and the values, plus 32 bytes per field
+    std::size_t list_size() const noexcept { return data_.size() + 32 * fields_.size(); }
+
+    void clear() noexcept {
+        data_.clear();
+        fields_.clear();
+    }
+
+private:
+    friend class hpack_decoder;
+
+    struct field {
+        std::uint32_t name_pos_;
+        std::uint32_t name_size_;
+        std::uint32_t value_pos_;
+        std::uint32_t value_size_;
+    };
+    std::string data_;
+    std::vector<field> fields_;
+};
+
+//! Decodes the header blocks of a connection, compressed with HPACK (RFC 7541).
+//! Keeps the dynamic table, which is shared by all the header blocks that the peer sends on the
+//! connection; the blocks need to be decoded in the order in which they were received.
+class hpack_decoder {
+public:
+    //! Creates a decoder whose dynamic table is limited to `max_table_size`, the value that we
+    //! advertise in `SETTINGS_HEADER_TABLE_SIZE`
+    explicit hpack_decoder(std::size_t max_table_size = 4096)
+        : max_table_size_(max_table_size)
+        , settings_max_table_size_(max_table_size) {}
+
+    //! Decodes a complete header block, appending the fields to `out`.
+    //! Returns false if the header list would be larger than `max_list_size`; the rest of the
+    //! block is still decoded, to keep the dynamic table in sync, but its fields are dropped, so a
+    //! small block can't expand into a large header list.
+    //! Throws `connection_error` with `compression_error` if the block is invalid; the dynamic
+    //! table is then unusable, and so is the connection.
+    bool decode(std::string_view block, header_block& out, std::size_t max_list_size);
+
+    //! The current size of the dynamic table, as defined by HPACK
+    std::size_t table_size() const noexcept { return table_size_; }
+
+private:
+    struct entry {
+        std::string name_;
+        std::string value_;
+    };
+    //! The dynamic table; the newest entry is first
+    std::deque<entry> dynamic_table_;
+    std::size_t table_size_{0};
+    //! The maximum size of the dynamic table, as set by the encoder
+    std::size_t max_table_size_;
+    //! The limit for `max_table_size_`
+    std::size_t settings_max_table_size_;
+
+    void add_entry(std::string_view name, std::string_view value);
+    void evict(std::size_t max_size) noexcept;
+    //! Returns the name and the value of the entry with the given index, in the static table
+    //! followed by the dynamic table (the first index is 1)
+    std::pair<std::string_view, std::string_view> lookup(std::size_t index) const;
+};
+
+//! Encodes the head of a response as a header block, appending it to `out`.
+//! Adds `content-length`, if the response doesn't have it and its status allows it (see
+//! `has_content_length()`), and leaves out the headers that are specific to HTTP/1.1 connections.
+//! Doesn't use the dynamic table or the Huffman code: responses have few headers, and most of the
+//! bytes we send are in the bodies.
+void encode_response_head(const http_response& resp, std::string& out);
+
+} // namespace http_server::h2
@@ -0,0 +1,112 @@
+#include "huffman.hpp"
+
+#include <array>
+#include <cstdint>
+
+namespace http_server::h2 {
+
+namespace {
+
+//! The lengths of the codes of the 256 byte values, and of EOS (256), from RFC 7541. The code is
+//! canonical: the codes are assigned in the order of their lengths, and then of the symbols. So the
+//! lengths are enough to know the codes.
+constexpr std::array<std::uint8_t, 257> code_lengths = {
+        13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+        28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+        6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+        5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+        13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+        7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+        15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+        6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+        20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+        24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+        22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+        21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+        26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+        19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+        20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+        26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+        30,
+};
+
+constexpr int min_code_length = 5;
+constexpr int max_code_length = 30;
+constexpr int eos = 256;
+
+//! The tables for decoding the canonical code.
+//! All the codes with the same length are consecutive numbers. If we look at the next 32 bits of
+//! the input, the code has the smallest length `len` for which these bits are below `limit_[len]`.
+struct decoding_tables {
+    //! The first code of each length, and the position of its symbol in `symbols_`
+    std::array<std::uint32_t, max_code_length + 1> first_code_{};
+    std::array<std::uint32_t, max_code_length + 1> first_index_{};
+    //! One past the last code of each length, aligned to the left of 32 bits
+    std::array<std::uint64_t, max_code_length + 1> limit_{};
+    //! The symbols, sorted by the length of their codes
+    std::array<std::uint16_t, 257> symbols_{};
+};
+
+consteval decoding_tables make_decoding_tables() {
+    decoding_tables res;
+    std::array<std::uint32_t, max_code_length + 1> count{};
+    for (auto len : code_lengths)
+        count[len]++;
+    std::uint32_t code = 0;
+    std::uint32_t index = 0;
+    for (int len = 1; len <= max_code_length; len++) {
+        res.first_code_[len] = code;
+        res.first_index_[len] = index;
+        res.limit_[len] = std::uint64_t(code + count[len]) << (32 - len);
+        code = (code + count[len]) << 1;
+        index += count[len];
+    }
+    std::array<std::uint32_t, max_code_length + 1> next = res.first_index_;
+    for (int sym = 0; sym < 257; sym++)
+        res.symbols_[next[code_lengths[sym]]++] = static_cast<std::uint16_t>(sym);
+    return res;
+}
+
+constexpr decoding_tables tables = make_decoding_tables();
+
+} // namespace
+
+bool huffman_decode(std::string_view in, std::string& out) {
+    // The bits that we didn't decode yet, aligned to the left
+    std::uint64_t bits = 0;
+    int num_bits = 0;
+    std::size_t pos = 0;
+    while (true) {
+        // Keep at least 32 bits in the buffer, while we have input
+        while (num_bits <= 56 && pos < in.size()) {
+            bits |= std::uint64_t(static_cast<unsigned char>(in[pos++])) << (56 - num_bits);
+            num_bits += 8;
+        }
+        if (num_bits < min_code_length)
+            break;
+
+        // Find the length of the next code; the bits past `num_bits` are zero, but the length is
+        // right as long as it is not past `num_bits`
+        std::uint64_t next = bits >> 32;
+        int len = min_code_length;
+        while (len < max_code_length && next >= tables.limit_[len])
+            len++;
+        if (len > num_bits)
+            break;
+        auto code = static_cast<std::uint32_t>(next >> (32 - len));
+        std::uint32_t index = tables.first_index_[len] + code - tables.first_code_[len];
+        std::uint16_t sym = tables.symbols_[index];
+        if (sym == eos)
+            return false;
+        out.push_back(static_cast<char>(sym));
+        bits <<= len;
+        num_bits -= len;
+    }
+    // What remains is padding: up to 7 bits, all ones (the start of the EOS code)
+    if (num_bits > 7)
+        return false;
+    std::uint64_t padding_mask = num_bits > 0 ? ~std::uint64_t(0) << (64 - num_bits) : 0;
+    return (bits & padding_mask) == padding_mask;
+}
+
+} // namespace http_server::h2
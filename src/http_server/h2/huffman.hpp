@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace http_server::h2 {
+
+//! Decodes a string encoded with the Huffman code of HPACK (RFC 7541, Appendix B), appending it
+//! to `out`. Returns false if the encoding is invalid.
+bool huffman_decode(std::string_view in, std::string& out);
+
+} // namespace http_server::h2
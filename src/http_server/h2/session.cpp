@@ -0,0 +1,710 @@
+#include "session.hpp"
+#include "http_server/request_parser.hpp"
+#include "profiling.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+namespace http_server::h2 {
+
+namespace {
+
+//! The maximum amount of response data collected for one write
+constexpr std::size_t max_batch_bytes = 256 * 1024;
+//! The maximum number of DATA frames collected for one write
+constexpr std::size_t max_batch_frames = 64;
+
+connection_error protocol_error() { return connection_error{error_code::protocol_error}; }
+
+//! Removes the padding from the payload of a DATA or HEADERS frame; for HEADERS, also removes the
+//! priority information, that we ignore
+std::string_view strip_padding(const frame_header& hdr, std::string_view payload) {
+    std::size_t start = 0;
+    std::size_t pad = 0;
+    if (hdr.has_flag(flags::padded)) {
+        if (payload.empty())
+            throw protocol_error();
+        pad = static_cast<unsigned char>(payload[0]);
+        start = 1;
+    }
+    if (hdr.type_ == frame_type::headers && hdr.has_flag(flags::priority))
+        start += 5;
+    if (start + pad > payload.size())
+        throw protocol_error();
+    return payload.substr(start, payload.size() - start - pad);
+}
+
+void append_setting(std::string& out, setting_id id, std::uint32_t value) {
+    auto id_value = static_cast<std::uint16_t>(id);
+    out.push_back(static_cast<char>(id_value >> 8));
+    out.push_back(static_cast<char>(id_value));
+    append_u32(out, value);
+}
+
+} // namespace
+
+session::session(const session_options& opts)
+    : opts_(opts)
+    , decoder_(4096) {
+    // Our settings go first, right after we receive the client preface
+    std::string settings;
+    append_setting(settings, setting_id::enable_push, 0);
+    append_setting(settings, setting_id::max_concurrent_streams, opts_.max_concurrent_streams_);
+    append_setting(settings, setting_id::initial_window_size, opts_.initial_window_size_);
+    append_setting(settings, setting_id::max_header_list_size, opts_.max_header_list_size_);
+    send_frame({static_cast<std::uint32_t>(settings.size()), frame_type::settings, 0, 0}, settings);
+
+    // The connection window can only be enlarged with WINDOW_UPDATE
+    if (opts_.connection_window_size_ > default_window_size) {
+        std::string increment;
+        append_u32(increment, opts_.connection_window_size_ - default_window_size);
+        send_frame({4, frame_type::window_update, 0, 0}, increment);
+        conn_recv_window_ = opts_.connection_window_size_;
+    }
+}
+
+void session::receive(std::string_view data) {
+    PROFILING_SCOPE();
+    if (failed_)
+        return;
+    try {
+        // Continue the frame that we have partially received, if any
+        std::string_view in = data;
+        if (!in_buf_.empty()) {
+            in_buf_.append(data);
+            in = in_buf_;
+        }
+        std::size_t pos = 0;
+        if (!preface_received_) {
+            std::size_t n = std::min(in.size(), client_preface.size());
+            if (in.substr(0, n) != client_preface.substr(0, n))
+                throw protocol_error();
+            if (n == client_preface.size()) {
+                preface_received_ = true;
+                pos = n;
+            } else {
+                if (in_buf_.empty())
+                    in_buf_.assign(in);
+                return;
+            }
+        }
+        while (in.size() - pos >= frame_header_size) {
+            frame_header hdr = parse_frame_header(in.data() + pos);
+            if (hdr.length_ > default_max_frame_size)
+                throw connection_error{error_code::frame_size_error};
+            if (in.size() - pos - frame_header_size < hdr.length_)
+                break;
+            process_frame(hdr, in.substr(pos + frame_header_size, hdr.length_));
+            pos += frame_header_size + hdr.length_;
+            if (failed_)
+                return;
+        }
+        // Keep the incomplete frame for later
+        if (in_buf_.empty())
+            in_buf_.assign(in.substr(pos));
+        else
+            in_buf_.erase(0, pos);
+    } catch (const connection_error& e) {
+        fail(e.code_);
+    }
+}
+
+std::optional<event> session::next_event() {
+    while (!events_.empty()) {
+        event ev = events_.front();
+        events_.pop_front();
+        if (ev.kind_ == event_kind::stream_reset)
+            return ev;
+        // Skip the events of the streams that were abandoned in the meantime
+        auto it = streams_.find(ev.stream_id_);
+        if (it == streams_.end() || it->second.retired_)
+            continue;
+        stream& s = it->second;
+        if (ev.kind_ == event_kind::request_head) {
+            if (s.state_ == stream_state::responding || s.reset_)
+                continue;
+            return ev;
+        }
+        if (s.state_ != stream_state::processing)
+            continue;
+        if (s.reset_) {
+            // The client reset the stream before we could process the request
+            retire_stream(ev.stream_id_);
+            return event{event_kind::stream_reset, ev.stream_id_};
+        }
+        return ev;
+    }
+    return std::nullopt;
+}
+
+http_request& session::request(std::uint32_t stream_id) { return *streams_.at(stream_id).req_; }
+
+std::size_t session::declared_body_size(std::uint32_t stream_id) const {
+    return streams_.at(stream_id).declared_size_.value_or(0);
+}
+
+void session::submit_response(std::uint32_t stream_id, http_response resp) {
+    PROFILING_SCOPE();
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end() || it->second.retired_)
+        return;
+    stream& s = it->second;
+    if (s.state_ == stream_state::responding)
+        return; // Already responded
+    if (failed_ || s.reset_) {
+        retire_stream(stream_id);
+        return;
+    }
+
+    // The head goes in a HEADERS frame, followed by CONTINUATION frames if it's too large
+    bool end_stream = resp.body_.empty();
+    std::string block;
+    encode_response_head(resp, block);
+    std::string_view rest = block;
+    bool first = true;
+    do {
+        std::size_t n = std::min<std::size_t>(rest.size(), peer_max_frame_size_);
+        std::uint8_t frame_flags = n == rest.size() ? flags::end_headers : 0;
+        if (first && end_stream)
+            frame_flags |= flags::end_stream;
+        send_frame({static_cast<std::uint32_t>(n),
+                           first ? frame_type::headers : frame_type::continuation, frame_flags,
+                           stream_id},
+                rest.substr(0, n));
+        rest.remove_prefix(n);
+        first = false;
+    } while (!rest.empty());
+
+    s.state_ = stream_state::responding;
+    if (end_stream) {
+        // If the client is still sending the request body, tell it to stop
+        if (!s.remote_closed_)
+            send_rst_stream(stream_id, error_code::no_error);
+        retire_stream(stream_id);
+        return;
+    }
+    s.resp_.emplace(std::move(resp));
+    enqueue_stream(stream_id, s);
+}
+
+bool session::want_write() const noexcept {
+    return !control_.empty() || (conn_send_window_ > 0 && !send_queue_.empty());
+}
+
+void session::collect_output(std::vector<std::string_view>& buffers) {
+    PROFILING_SCOPE();
+    writing_ = true;
+    batch_control_.swap(control_);
+    control_.clear();
+    batch_frames_.clear();
+    batch_pieces_.clear();
+    if (!batch_control_.empty())
+        batch_pieces_.push_back({batch_control_.data(), 0, batch_control_.size()});
+
+    // Take a DATA frame from each stream in turn, as long as the windows allow
+    std::size_t budget = max_batch_bytes;
+    std::size_t num_frames = 0;
+    while (budget > 0 && num_frames < max_batch_frames && conn_send_window_ > 0
+            && !send_queue_.empty()) {
+        std::uint32_t id = send_queue_.front();
+        send_queue_.pop_front();
+        stream& s = streams_.at(id);
+        s.queued_ = false;
+
+        const std::string& body = s.resp_->body_;
+        std::size_t n = std::min({body.size() - s.body_sent_, std::size_t{peer_max_frame_size_},
+                static_cast<std::size_t>(s.send_window_),
+                static_cast<std::size_t>(conn_send_window_), budget});
+        bool last = s.body_sent_ + n == body.size();
+        batch_pieces_.push_back({nullptr, batch_frames_.size(), frame_header_size});
+        append_frame_header(batch_frames_, {static_cast<std::uint32_t>(n), frame_type::data,
+                                                   last ? flags::end_stream : std::uint8_t{0}, id});
+        batch_pieces_.push_back({body.data() + s.body_sent_, 0, n});
+        s.body_sent_ += n;
+        s.send_window_ -= static_cast<std::int64_t>(n);
+        conn_send_window_ -= static_cast<std::int64_t>(n);
+        budget -= n;
+        num_frames++;
+
+        if (last) {
+            // If the client is still sending the request body, tell it to stop
+            if (!s.remote_closed_) {
+                std::size_t offset = batch_frames_.size();
+                append_frame_header(batch_frames_, {4, frame_type::rst_stream, 0, id});
+                append_u32(batch_frames_, static_cast<std::uint32_t>(error_code::no_error));
+                batch_pieces_.push_back({nullptr, offset, batch_frames_.size() - offset});
+            }
+            retire_stream(id);
+        } else {
+            enqueue_stream(id, s);
+        }
+    }
+
+    for (const auto& p : batch_pieces_) {
+        const char* data = p.data_ ? p.data_ : batch_frames_.data() + p.offset_;
+        buffers.emplace_back(data, p.size_);
+    }
+}
+
+void session::output_written() {
+    writing_ = false;
+    for (std::uint32_t id : to_erase_)
+        streams_.erase(id);
+    to_erase_.clear();
+    batch_control_.clear();
+    batch_frames_.clear();
+    batch_pieces_.clear();
+}
+
+void session::shutdown() {
+    if (!goaway_sent_ && !failed_)
+        send_goaway(error_code::no_error);
+}
+
+bool session::closed() const noexcept {
+    if (writing_ || !control_.empty())
+        return false;
+    return failed_ || ((goaway_sent_ || peer_goaway_) && streams_.empty());
+}
+
+void session::process_frame(const frame_header& hdr, std::string_view payload) {
+    // The client starts with its settings; a header block can't be interrupted
+    if (!settings_received_) {
+        if (hdr.type_ != frame_type::settings || hdr.has_flag(flags::ack))
+            throw protocol_error();
+        settings_received_ = true;
+    }
+    if (expect_continuation_ && hdr.type_ != frame_type::continuation)
+        throw protocol_error();
+
+    try {
+        switch (hdr.type_) {
+        case frame_type::data:
+            on_data(hdr, payload);
+            break;
+        case frame_type::headers:
+            on_headers(hdr, payload);
+            break;
+        case frame_type::priority:
+            // We don't prioritize the streams, but the frame still needs to be valid
+            if (hdr.stream_id_ == 0)
+                throw protocol_error();
+            if (payload.size() != 5)
+                throw connection_error{error_code::frame_size_error};
+            break;
+        case frame_type::rst_stream:
+            on_rst_stream(hdr, payload);
+            break;
+        case frame_type::settings:
+            on_settings(hdr, payload);
+            break;
+        case frame_type::push_promise:
+            // Only servers can push
+            throw protocol_error();
+        case frame_type::ping:
+            on_ping(hdr, payload);
+            break;
+        case frame_type::goaway:
+            on_goaway(hdr, payload);
+            break;
+        case frame_type::window_update:
+            on_window_update(hdr, payload);
+            break;
+        case frame_type::continuation:
+            on_continuation(hdr, payload);
+            break;
+        default:
+            // Unknown frame types are ignored
+            break;
+        }
+    } catch (const stream_error& e) {
+        reset_stream(hdr.stream_id_, e.code_);
+    }
+}
+
+void session::on_data(const frame_header& hdr, std::string_view payload) {
+    std::uint32_t id = hdr.stream_id_;
+    if (id == 0)
+        throw protocol_error();
+
+    // The whole payload counts for flow control, padding included
+    auto size = static_cast<std::int64_t>(payload.size());
+    if (size > conn_recv_window_)
+        throw connection_error{error_code::flow_control_error};
+    conn_recv_window_ -= size;
+    if (conn_recv_window_ < opts_.connection_window_size_ / 2) {
+        std::string increment;
+        append_u32(increment, opts_.connection_window_size_ - conn_recv_window_);
+        send_frame({4, frame_type::window_update, 0, 0}, increment);
+        conn_recv_window_ = opts_.connection_window_size_;
+    }
+    std::string_view data = strip_padding(hdr, payload);
+
+    auto it = streams_.find(id);
+    if (it == streams_.end() || it->second.retired_) {
+        // Data for streams that we closed may still be in flight; data for new streams is wrong
+        if (id > last_stream_id_)
+            throw protocol_error();
+        return;
+    }
+    stream& s = it->second;
+    if (s.remote_closed_)
+        throw stream_error{error_code::stream_closed};
+    if (size > s.recv_window_)
+        throw stream_error{error_code::flow_control_error};
+    s.recv_window_ -= size;
+
+    // If we already responded, we don't need the rest of the body
+    if (s.state_ == stream_state::body) {
+        std::string& body = s.req_->body_;
+        std::size_t new_size = body.size() + data.size();
+        if (s.declared_size_ && new_size > *s.declared_size_)
+            throw stream_error{error_code::protocol_error};
+        if (!s.declared_size_ && opts_.max_body_size_ > 0 && new_size > opts_.max_body_size_)
+            throw stream_error{error_code::cancel};
+        body.append(data);
+    }
+
+    if (hdr.has_flag(flags::end_stream)) {
+        end_of_body(id, s);
+    } else if (s.recv_window_ < opts_.initial_window_size_ / 2) {
+        auto recv_window = static_cast<std::uint32_t>(s.recv_window_);
+        std::string increment;
+        append_u32(increment, opts_.initial_window_size_ - recv_window);
+        send_frame({4, frame_type::window_update, 0, id}, increment);
+        s.recv_window_ = opts_.initial_window_size_;
+    }
+}
+
+void session::on_headers(const frame_header& hdr, std::string_view payload) {
+    if (hdr.stream_id_ == 0)
+        throw protocol_error();
+    std::string_view fragment = strip_padding(hdr, payload);
+    if (fragment.size() > opts_.max_header_list_size_)
+        throw connection_error{error_code::enhance_your_calm};
+    header_buf_.assign(fragment);
+    headers_stream_id_ = hdr.stream_id_;
+    headers_flags_ = hdr.flags_;
+    if (hdr.has_flag(flags::end_headers))
+        finish_headers();
+    else
+        expect_continuation_ = true;
+}
+
+void session::on_continuation(const frame_header& hdr, std::string_view payload) {
+    if (!expect_continuation_ || hdr.stream_id_ != headers_stream_id_)
+        throw protocol_error();
+    if (header_buf_.size() + payload.size() > opts_.max_header_list_size_)
+        throw connection_error{error_code::enhance_your_calm};
+    header_buf_.append(payload);
+    if (hdr.has_flag(flags::end_headers))
+        finish_headers();
+}
+
+void session::on_rst_stream(const frame_header& hdr, std::string_view payload) {
+    if (hdr.stream_id_ == 0)
+        throw protocol_error();
+    if (payload.size() != 4)
+        throw connection_error{error_code::frame_size_error};
+    if (hdr.stream_id_ > last_stream_id_)
+        throw protocol_error();
+    abandon_stream(hdr.stream_id_);
+}
+
+void session::on_settings(const frame_header& hdr, std::string_view payload) {
+    if (hdr.stream_id_ != 0)
+        throw protocol_error();
+    if (hdr.has_flag(flags::ack)) {
+        if (!payload.empty())
+            throw connection_error{error_code::frame_size_error};
+        return;
+    }
+    if (payload.size() % 6 != 0)
+        throw connection_error{error_code::frame_size_error};
+
+    for (std::size_t pos = 0; pos < payload.size(); pos += 6) {
+        auto id = static_cast<setting_id>((static_cast<unsigned char>(payload[pos]) << 8)
+                                          | static_cast<unsigned char>(payload[pos + 1]));
+        std::uint32_t value = read_u32(payload.data() + pos + 2);
+        switch (id) {
+        case setting_id::enable_push:
+            if (value > 1)
+                throw protocol_error();
+            break;
+        case setting_id::initial_window_size: {
+            if (value > max_window_size)
+                throw connection_error{error_code::flow_control_error};
+            // Applies to the streams that are already open, too
+            std::int64_t delta = static_cast<std::int64_t>(value) - peer_initial_window_;
+            peer_initial_window_ = value;
+            for (auto& [stream_id, s] : streams_) {
+                s.send_window_ += delta;
+                if (s.send_window_ > max_window_size)
+                    throw connection_error{error_code::flow_control_error};
+                enqueue_stream(stream_id, s);
+            }
+            break;
+        }
+        case setting_id::max_frame_size:
+            if (value < default_max_frame_size || value > 0xffffff)
+                throw protocol_error();
+            peer_max_frame_size_ = value;
+            break;
+        default:
+            // We don't use the dynamic table when encoding, and we don't start streams; the other
+            // settings don't matter to us
+            break;
+        }
+    }
+    send_frame({0, frame_type::settings, flags::ack, 0}, {});
+}
+
+void session::on_ping(const frame_header& hdr, std::string_view payload) {
+    if (hdr.stream_id_ != 0)
+        throw protocol_error();
+    if (payload.size() != 8)
+        throw connection_error{error_code::frame_size_error};
+    if (!hdr.has_flag(flags::ack))
+        send_frame({8, frame_type::ping, flags::ack, 0}, payload);
+}
+
+void session::on_goaway(const frame_header& hdr, std::string_view payload) {
+    if (hdr.stream_id_ != 0)
+        throw protocol_error();
+    if (payload.size() < 8)
+        throw connection_error{error_code::frame_size_error};
+    // The client won't start new streams; we finish the ones in progress
+    peer_goaway_ = true;
+}
+
+void session::on_window_update(const frame_header& hdr, std::string_view payload) {
+    if (payload.size() != 4)
+        throw connection_error{error_code::frame_size_error};
+    std::uint32_t increment = read_u32(payload.data()) & 0x7fffffff;
+    if (hdr.stream_id_ == 0) {
+        if (increment == 0)
+            throw protocol_error();
+        conn_send_window_ += increment;
+        if (conn_send_window_ > max_window_size)
+            throw connection_error{error_code::flow_control_error};
+        return;
+    }
+    auto it = streams_.find(hdr.stream_id_);
+    if (it == streams_.end() || it->second.retired_)
+        return;
+    if (increment == 0)
+        throw stream_error{error_code::protocol_error};
+    stream& s = it->second;
+    s.send_window_ += increment;
+    if (s.send_window_ > max_window_size)
+        throw stream_error{error_code::flow_control_error};
+    enqueue_stream(hdr.stream_id_, s);
+}
+
+void session::finish_headers() {
+    expect_continuation_ = false;
+    // Decode the block even if we ignore it; the dynamic table must stay in sync with the client
+    header_block head;
+    bool fits = decoder_.decode(header_buf_, head, opts_.max_header_list_size_);
+    std::uint32_t id = headers_stream_id_;
+    bool end_stream = (headers_flags_ & flags::end_stream) != 0;
+    if (id % 2 == 0)
+        throw protocol_error();
+
+    auto it = streams_.find(id);
+    if (it != streams_.end()) {
+        // Trailers, after the body; we ignore them
+        stream& s = it->second;
+        if (s.retired_)
+            return;
+        if (s.remote_closed_)
+            throw stream_error{error_code::stream_closed};
+        if (!end_stream)
+            throw stream_error{error_code::protocol_error};
+        end_of_body(id, s);
+        return;
+    }
+    if (id <= last_stream_id_)
+        return; // A stream that we already closed
+    last_stream_id_ = id;
+
+    // After GOAWAY, we don't start new streams
+    if (goaway_sent_ && id > goaway_last_stream_id_)
+        return;
+    if (streams_.size() >= opts_.max_concurrent_streams_) {
+        send_rst_stream(id, error_code::refused_stream);
+        return;
+    }
+    if (!fits) {
+        send_rst_stream(id, error_code::refused_stream);
+        return;
+    }
+    start_stream(id, std::move(head), end_stream);
+}
+
+void session::start_stream(std::uint32_t id, header_block&& head, bool end_stream) {
+    stream& s = streams_[id];
+    s.send_window_ = peer_initial_window_;
+    s.recv_window_ = opts_.initial_window_size_;
+    s.head_ = std::move(head);
+    build_request(s);
+    events_.push_back({event_kind::request_head, id});
+    if (end_stream)
+        end_of_body(id, s);
+}
+
+void session::end_of_body(std::uint32_t id, stream& s) {
+    s.remote_closed_ = true;
+    if (s.state_ != stream_state::body)
+        return; // We already responded
+    if (s.declared_size_ && s.req_->body_.size() != *s.declared_size_)
+        throw stream_error{error_code::protocol_error};
+    s.state_ = stream_state::processing;
+    events_.push_back({event_kind::request_complete, id});
+}
+
+void session::build_request(stream& s) {
+    // Malformed requests are stream errors
+    auto malformed = [] { return stream_error{error_code::protocol_error}; };
+    std::optional<http_method> method;
+    std::string_view path;
+    bool has_scheme = false;
+    bool seen_regular = false;
+    request_headers headers;
+    for (std::size_t i = 0; i < s.head_.size(); i++) {
+        std::string_view name = s.head_.name(i);
+        std::string_view value = s.head_.value(i);
+        if (name.empty())
+            throw malformed();
+
+        // The pseudo-headers come first, and replace the request line
+        if (name[0] == ':') {
+            if (seen_regular)
+                throw malformed();
+            if (name == ":method") {
+                auto [m, ok] = parse_method(value);
+                if (!ok)
+                    throw malformed();
+                method = m;
+            } else if (name == ":path") {
+                path = value;
+            } else if (name == ":scheme") {
+                has_scheme = true;
+            } else if (name != ":authority") {
+                throw malformed();
+            }
+            continue;
+        }
+        seen_regular = true;
+
+        // Header names are lowercase, and there are no connection-specific headers
+        if (std::any_of(name.begin(), name.end(), [](char c) { return c >= 'A' && c <= 'Z'; }))
+            throw malformed();
+        header_field field = lookup_header_field(name);
+        switch (field) {
+        case header_field::connection:
+        case header_field::keep_alive:
+        case header_field::transfer_encoding:
+        case header_field::upgrade:
+            throw malformed();
+        case header_field::te:
+            if (value != "trailers")
+                throw malformed();
+            break;
+        case header_field::content_length: {
+            std::size_t size = 0;
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), size);
+            if (ec != std::errc{} || ptr != value.data() + value.size())
+                throw malformed();
+            s.declared_size_ = size;
+            break;
+        }
+        default:
+            break;
+        }
+        if (!headers.push_back(header_view{field, name, value}))
+            throw stream_error{error_code::refused_stream};
+    }
+    if (!method || path.empty() || !has_scheme)
+        throw malformed();
+    s.req_.emplace(http_request{*method, path, headers, {}, http_version::http_2});
+}
+
+void session::send_frame(const frame_header& hdr, std::string_view payload) {
+    append_frame_header(control_, hdr);
+    control_.append(payload);
+}
+
+void session::send_rst_stream(std::uint32_t id, error_code code) {
+    append_frame_header(control_, {4, frame_type::rst_stream, 0, id});
+    append_u32(control_, static_cast<std::uint32_t>(code));
+}
+
+void session::send_goaway(error_code code) {
+    append_frame_header(control_, {8, frame_type::goaway, 0, 0});
+    append_u32(control_, last_stream_id_);
+    append_u32(control_, static_cast<std::uint32_t>(code));
+    goaway_sent_ = true;
+    goaway_last_stream_id_ = last_stream_id_;
+}
+
+void session::reset_stream(std::uint32_t id, error_code code) {
+    send_rst_stream(id, code);
+    abandon_stream(id);
+}
+
+void session::abandon_stream(std::uint32_t id) {
+    auto it = streams_.find(id);
+    if (it == streams_.end() || it->second.retired_)
+        return;
+    stream& s = it->second;
+    switch (s.state_) {
+    case stream_state::body:
+        // The application may be waiting for the body
+        events_.push_back({event_kind::stream_reset, id});
+        retire_stream(id);
+        break;
+    case stream_state::processing:
+        // The request is processed; we forget about the stream once the response comes
+        s.reset_ = true;
+        break;
+    case stream_state::responding:
+        retire_stream(id);
+        break;
+    }
+}
+
+void session::retire_stream(std::uint32_t id) {
+    auto it = streams_.find(id);
+    if (it == streams_.end())
+        return;
+    it->second.retired_ = true;
+    if (it->second.queued_) {
+        send_queue_.erase(std::find(send_queue_.begin(), send_queue_.end(), id));
+        it->second.queued_ = false;
+    }
+    // The data we're writing may point into the stream
+    if (writing_)
+        to_erase_.push_back(id);
+    else
+        streams_.erase(it);
+}
+
+void session::enqueue_stream(std::uint32_t id, stream& s) {
+    if (s.queued_ || s.retired_ || s.state_ != stream_state::responding || !s.resp_
+            || s.send_window_ <= 0 || s.body_sent_ == s.resp_->body_.size())
+        return;
+    s.queued_ = true;
+    send_queue_.push_back(id);
+}
+
+void session::fail(error_code code) {
+    send_goaway(code);
+    failed_ = true;
+    in_buf_.clear();
+    for (std::uint32_t id : send_queue_)
+        streams_.at(id).queued_ = false;
+    send_queue_.clear();
+}
+
+} // namespace http_server::h2
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "frame.hpp"
+#include "hpack.hpp"
+#include "http_server/http_request.hpp"
+#include "http_server/http_response.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace http_server::h2 {
+
+//! The parameters of an HTTP/2 connection, advertised to the client in our SETTINGS frame
+struct session_options {
+    //! The maximum number of requests that the client can have in flight on the connection
+    std::uint32_t max_concurrent_streams_{100};
+    //! The flow-control window of each request body; at least the default of 64 KB
+    std::uint32_t initial_window_size_{1024 * 1024};
+    //! The flow-control window of the connection, shared by all the request bodies
+    std::uint32_t connection_window_size_{16 * 1024 * 1024};
+    //! The maximum size of a request head, both encoded and decoded
+    std::uint32_t max_header_list_size_{64 * 1024};
+    //! The maximum size of a request body that doesn't declare its size; zero means no limit
+    std::size_t max_body_size_{0};
+};
+
+//! What happened on a stream, as reported by `session::next_event()`
+enum class event_kind {
+    //! The head of a request was received; the body may follow
+    request_head,
+    //! The whole request was received
+    request_complete,
+    //! The client reset the stream; the request is abandoned
+    stream_reset,
+};
+
+struct event {
+    event_kind kind_;
+    std::uint32_t stream_id_;
+};
+
+//! The protocol state of an HTTP/2 connection, on the server side.
+//!
+//! The session doesn't do any I/O: it is given the bytes received from the client, and it tells
+//! what to send back. This keeps the protocol logic separate from the way we wait for the
+//! connection, and from the way we process the requests.
+//!
+//! The requests come as events: first the head of the request, then the complete request. The
+//! responses can be submitted in any order, at any time after the head. The response bodies are
+//! sent as DATA frames, interleaved between the streams in round-robin, within the flow-control
+//! windows given by the client; so a large image doesn't hold back the other responses.
+//!
+//! Not thread-safe; the owner needs to use it from a single thread.
+class session {
+public:
+    explicit session(const session_options& opts);
+
+    //! Processes data received from the client, starting with the client preface.
+    //! Connection errors don't throw: the session sends GOAWAY, and reports itself as closed once
+    //! that is written.
+    void receive(std::string_view data);
+
+    //! Returns the next event on the streams, if there is any
+    std::optional<event> next_event();
+
+    //! The request on the stream, for the `request_head` and the `request_complete` events.
+    //! The URI and the headers point into the stream; the request stays valid until the response
+    //! is submitted. The body is added before `request_complete`.
+    http_request& request(std::uint32_t stream_id);
+    //! The size of the body of the request, as declared by `content-length`; zero if not declared
+    std::size_t declared_body_size(std::uint32_t stream_id) const;
+
+    //! Submits the response for a stream. If the body of the request is still coming, the client
+    //! is told to stop sending it, once the response is sent.
+    void submit_response(std::uint32_t stream_id, http_response resp);
+
+    //! Check if we have something to send
+    bool want_write() const noexcept;
+    //! Collects the data to send next, as a list of buffers to be written in order. The buffers
+    //! remain valid until `output_written()`, which must be called before collecting more.
+    void collect_output(std::vector<std::string_view>& buffers);
+    //! Called after the collected data was written
+    void output_written();
+
+    //! Starts a graceful shutdown: tells the client that we don't take new requests, but keeps
+    //! serving the ones that already started
+    void shutdown();
+    //! Check if the connection can be closed: after a GOAWAY, all the streams are done, and
+    //! everything was written; or a connection error was reported
+    bool closed() const noexcept;
+    //! The number of streams that are not done yet
+    std::size_t num_streams() const noexcept { return streams_.size(); }
+
+private:
+    enum class stream_state {
+        //! Receiving the body of the request
+        body,
+        //! The request is complete, and processed by the application
+        processing,
+        //! Sending the response
+        responding,
+    };
+
+    struct stream {
+        stream_state state_{stream_state::body};
+        //! Set when the client finished sending the request (END_STREAM)
+        bool remote_closed_{false};
+        //! Set if the client reset the stream while the request was processed
+        bool reset_{false};
+        //! Set while the stream is in `send_queue_`
+        bool queued_{false};
+        //! Set once we are done with the stream; it is only kept while we write its data
+        bool retired_{false};
+        //! The decoded head of the request, into which the request points
+        header_block head_;
+        std::optional<http_request> req_;
+        std::optional<std::size_t> declared_size_;
+        //! The flow-control windows of the stream: how much we can send, and receive
+        std::int64_t send_window_{0};
+        std::int64_t recv_window_{0};
+        std::optional<http_response> resp_;
+        //! How much of the response body was sent
+        std::size_t body_sent_{0};
+    };
+
+    //! A piece of the output: either a part of `batch_frames_`, or data somewhere else
+    struct piece {
+        const char* data_;
+        std::size_t offset_;
+        std::size_t size_;
+    };
+
+    session_options opts_;
+    hpack_decoder decoder_;
+    std::unordered_map<std::uint32_t, stream> streams_;
+    std::deque<event> events_;
+
+    //! The received data that doesn't make a complete frame yet
+    std::string in_buf_;
+    bool preface_received_{false};
+    bool settings_received_{false};
+    //! The highest stream ID started by the client
+    std::uint32_t last_stream_id_{0};
+    //! The header block being received, if it continues in CONTINUATION frames
+    std::string header_buf_;
+    std::uint32_t headers_stream_id_{0};
+    std::uint8_t headers_flags_{0};
+    bool expect_continuation_{false};
+
+    //! The settings of the client that matter to us
+    std::int64_t peer_initial_window_{default_window_size};
+    std::uint32_t peer_max_frame_size_{default_max_frame_size};
+
+    //! The flow-control windows of the connection
+    std::int64_t conn_send_window_{default_window_size};
+    std::int64_t conn_recv_window_{default_window_size};
+
+    //! The frames to send, other than DATA frames
+    std::string control_;
+    //! The streams with response data to send, and a window to send it
+    std::deque<std::uint32_t> send_queue_;
+    //! The output collected, but not written yet, and the streams to erase once it's written
+    bool writing_{false};
+    std::string batch_control_;
+    std::string batch_frames_;
+    std::vector<piece> batch_pieces_;
+    std::vector<std::uint32_t> to_erase_;
+
+    bool goaway_sent_{false};
+    std::uint32_t goaway_last_stream_id_{0};
+    bool peer_goaway_{false};
+    bool failed_{false};
+
+    void process_frame(const frame_header& hdr, std::string_view payload);
+    void on_data(const frame_header& hdr, std::string_view payload);
+    void on_headers(const frame_header& hdr, std::string_view payload);
+    void on_continuation(const frame_header& hdr, std::string_view payload);
+    void on_rst_stream(const frame_header& hdr, std::string_view payload);
+    void on_settings(const frame_header& hdr, std::string_view payload);
+    void on_ping(const frame_header& hdr, std::string_view payload);
+    void on_goaway(const frame_header& hdr, std::string_view payload);
+    void on_window_update(const frame_header& hdr, std::string_view payload);
+
+    void finish_headers();
+    void start_stream(std::uint32_t id, header_block&& head, bool end_stream);
+    void end_of_body(std::uint32_t id, stream& s);
+    void build_request(stream& s);
+
+    void send_frame(const frame_header& hdr, std::string_view payload);
+    void send_rst_stream(std::uint32_t id, error_code code);
+    void send_goaway(error_code code);
+    //! Resets the stream because of an error; the client is told about it
+    void reset_stream(std::uint32_t id, error_code code);
+    //! Gives up on a stream, which was reset by us or by the client
+    void abandon_stream(std::uint32_t id);
+    //! Forgets about a stream, as soon as the data we're writing doesn't need it anymore
+    void retire_stream(std::uint32_t id);
+    void enqueue_stream(std::uint32_t id, stream& s);
+    void fail(error_code code);
+};
+
+} // namespace http_server::h2
@@ -0,0 +1,87 @@
+#include "header_field.hpp"
+
+#include <array>
+
+namespace http_server {
+
+namespace {
+
+using namespace std::literals;
+
+//! The names of the well-known headers, in the order of `header_field`
+constexpr std::array field_names = {
+        ""sv,
+        "accept"sv,
+        "accept-encoding"sv,
+        "authorization"sv,
+        "cache-control"sv,
+        "connection"sv,
+        "content-encoding"sv,
+        "content-length"sv,
+        "content-type"sv,
+        "cookie"sv,
+        "date"sv,
+        "expect"sv,
+        "host"sv,
+        "http2-settings"sv,
+        "if-modified-since"sv,
+        "if-none-match"sv,
+        "keep-alive"sv,
+        "range"sv,
+        "te"sv,
+        "transfer-encoding"sv,
+        "upgrade"sv,
+        "user-agent"sv,
+};
+static_assert(field_names.size() == static_cast<std::size_t>(header_field::user_agent) + 1);
+
+constexpr char ascii_lower(char c) noexcept { return (c >= 'A' && c <= 'Z') ? char(c + 32) : c; }
+
+//! The hash of a (non-empty) header name; it looks at the length and at three characters.
+//! The coefficients are chosen such as there are no collisions between the well-known names.
+constexpr std::size_t table_size = 32;
+constexpr std::size_t name_hash(std::string_view name) noexcept {
+    std::size_t h = name.size();
+    h += static_cast<unsigned char>(ascii_lower(name.front()));
+    h += 7 * static_cast<unsigned char>(ascii_lower(name.back()));
+    h += 8 * static_cast<unsigned char>(ascii_lower(name[name.size() / 2]));
+    return h % table_size;
+}
+
+//! Maps hashes to the well-known headers; empty slots hold `header_field::unknown`
+constexpr auto make_table() {
+    std::array<header_field, table_size> table{};
+    for (std::size_t i = 1; i < field_names.size(); i++)
+        table[name_hash(field_names[i])] = static_cast<header_field>(i);
+    return table;
+}
+constexpr auto field_table = make_table();
+
+constexpr bool is_perfect_hash() {
+    for (std::size_t i = 1; i < field_names.size(); i++)
+        if (field_table[name_hash(field_names[i])] != static_cast<header_field>(i))
+            return false;
+    return true;
+}
+static_assert(is_perfect_hash(), "the hash of the well-known header names has collisions");
+
+} // namespace
+
+header_field lookup_header_field(std::string_view name) noexcept {
+    if (name.empty())
+        return header_field::unknown;
+    header_field candidate = field_table[name_hash(name)];
+    std::string_view expected = field_names[static_cast<std::size_t>(candidate)];
+    if (expected.size() != name.size())
+        return header_field::unknown;
+    for (std::size_t i = 0; i < name.size(); i++)
+        if (ascii_lower(name[i]) != expected[i])
+            return header_field::unknown;
+    return candidate;
+}
+
+std::string_view header_field_name(header_field f) noexcept {
+    return field_names[static_cast<std::size_t>(f)];
+}
+
+} // namespace http_server
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string_view>
+
+namespace http_server {
+
+//! The well-known header names. Knowing the header through this enum avoids string comparisons
+//! when we look for a particular header.
+enum class header_field : unsigned char {
+    unknown,
+    accept,
+    accept_encoding,
+    authorization,
+    cache_control,
+    connection,
+    content_encoding,
+    content_length,
+    content_type,
+    cookie,
+    date,
+    expect,
+    host,
+    http2_settings,
+    if_modified_since,
+    if_none_match,
+    keep_alive,
+    range,
+    te,
+    transfer_encoding,
+    upgrade,
+    user_agent,
+};
+
+//! Returns the well-known header with the given name (case-insensitive), or
+//! `header_field::unknown`. Uses a perfect hash, so at most one name is compared.
+header_field lookup_header_field(std::string_view name) noexcept;
+
+//! Returns the name of a well-known header, in lowercase
+std::string_view header_field_name(header_field f) noexcept;
+
+} // namespace http_server
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "header_field.hpp"
+
+#include <array>
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace http_server {
@@ -14,4 +19,45 @@ struct header {
 //! A list of headers to be included in the request of in the response
 using headers = std::vector<header>;
 
-} // namespace http_server
\ No newline at end of file
+//! A header of a received request. The name and the value point into the buffer that holds the
+//! request head.
+struct header_view {
+    //! The well-known header that this is, or `header_field::unknown`
+    header_field field_;
+    std::string_view name_;
+    std::string_view value_;
+};
+
+//! The headers of a received request. Has a fixed capacity, so that it doesn't allocate memory.
+class request_headers {
+public:
+    //! The maximum number of headers that a request can have
+    static constexpr std::size_t max_size = 64;
+
+    auto begin() const noexcept { return items_.begin(); }
+    auto end() const noexcept { return items_.begin() + size_; }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+
+    //! Adds a header; returns false if there is no more room for it
+    bool push_back(header_view h) noexcept {
+        if (size_ == max_size)
+            return false;
+        items_[size_++] = h;
+        return true;
+    }
+
+    //! Returns the value of the first header of the given well-known kind, or an empty view
+    std::string_view find(header_field f) const noexcept {
+        for (const auto& h : *this)
+            if (h.field_ == f)
+                return h.value_;
+        return {};
+    }
+
+private:
+    std::array<header_view, max_size> items_;
+    std::size_t size_{0};
+};
+
+} // namespace http_server
@@ -3,6 +3,7 @@
 #include "headers.hpp"
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace http_server {
@@ -21,16 +22,33 @@ enum class http_method {
     patch,
 };
 
+//! The version of the HTTP protocol used by a request
+enum class http_version {
+    http_1_0,
+    http_1_1,
+    //! HTTP/2, on a cleartext connection
+    http_2,
+};
+
 //! Structure describing an HTTP request coming from the clients.
-//! We aim for a simple representation here, not the most efficient one.
+//!
+//! The URI and the headers point into the buffer in which the request head was read; the request
+//! must be handled before the next request is read from the same connection.
 struct http_request {
     //! The method of the request; `GET`, `POST`, etc.
-    const http_method method_;
+    http_method method_;
     //! The URI for the resource we need to access
-    const std::string uri_;
+    std::string_view uri_;
     //! The headers present in the request
-    const headers headers_;
+    request_headers headers_;
     //! The body of the request, if we have one
-    const std::string body_;
+    std::string body_;
+    //! The protocol version from the request line
+    http_version version_{http_version::http_1_1};
 };
+
+//! Check if the client wants the connection to stay open after the response to this request.
+//! HTTP/1.1 connections are persistent unless the client sends `Connection: close`; HTTP/1.0
+//! connections are persistent only if the client sends `Connection: keep-alive`.
+bool wants_keep_alive(const http_request& req);
 } // namespace http_server
\ No newline at end of file
@@ -21,6 +21,8 @@ enum class status_code {
     s_401_unauthorized,
     s_403_forbidden,
     s_404_not_found,
+    s_412_precondition_failed,
+    s_413_payload_too_large,
     s_500_internal_server_error,
     s_501_not_implemented,
     s_502_bad_gateway,
@@ -31,10 +33,10 @@ enum class status_code {
 //! We aim for a simple representation here, not the most efficient one.
 struct http_response {
     //! The status code of the response; e.g., 200 OK
-    const status_code status_code_;
+    status_code status_code_;
     //! The headers of the response
-    const headers headers_;
+    headers headers_;
     //! The body of the response, if we have one
-    const std::string body_;
+    std::string body_;
 };
 } // namespace http_server
\ No newline at end of file
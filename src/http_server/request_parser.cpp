@@ -1,12 +1,12 @@
 #include "request_parser.hpp"
+#include "delimiter_scan.hpp"
 #include "profiling.hpp"
 
 #include <algorithm>
-#include <cctype>
+#include <charconv>
 
 namespace http_server {
 
-namespace {
 std::pair<http_method, bool> parse_method(std::string_view method_str) {
     if (method_str == "GET")
         return {http_method::get, true};
@@ -28,100 +28,133 @@ std::pair<http_method, bool> parse_method(std::string_view method_str) {
         return {http_method::patch, true};
     return {http_method::get, false};
 }
+
+namespace {
+//! Removes the optional whitespace around a header value
+std::string_view trim_ows(std::string_view str) {
+    // There is typically one space at the start, and none at the end; simple loops are best
+    auto is_ows = [](char c) { return c == ' ' || c == '\t'; };
+    while (!str.empty() && is_ows(str.front()))
+        str.remove_prefix(1);
+    while (!str.empty() && is_ows(str.back()))
+        str.remove_suffix(1);
+    return str;
+}
+
+//! Case-insensitive comparison, for ASCII strings
+bool iequals(std::string_view lhs, std::string_view rhs) {
+    auto lower = [](char c) { return (c >= 'A' && c <= 'Z') ? char(c + 32) : c; };
+    return lhs.size() == rhs.size()
+           && std::equal(lhs.begin(), lhs.end(), rhs.begin(),
+                   [&](char a, char b) { return lower(a) == lower(b); });
+}
 } // namespace
 
-std::optional<http_request> request_parser::parse_next_packet(std::string_view data) {
+std::size_t request_parser::parse_head(std::string_view data) {
     PROFILING_SCOPE();
-    if (state_ == parse_state::done)
-        return {};
-
-    // Everything before the body, we parse line by line
-    while (state_ < parse_state::body && !data.empty()) {
-        auto eol_pos = data.find("\r\n");
-        if (eol_pos == std::string_view::npos) {
-            // Partial line
-            cur_line_.append(data);
-            return {};
-        } else {
-            // We read a complete line
-            cur_line_.append(data.substr(0, eol_pos));
-            data.remove_prefix(eol_pos + 2);
-
-            // Interpret this line
-            if (!add_current_line())
-                throw bad_request{};
-            cur_line_.clear();
-        }
+    if (head_size_ != 0)
+        return head_size_;
+
+    // Find all the line ends in the new data, in one pass; we stop at the empty line that ends the
+    // head
+    num_lines_ += scan::find_line_ends(
+            data, scan_pos_, line_ends_.data() + num_lines_, line_ends_.size() - num_lines_);
+    scan_pos_ = data.size();
+    bool complete = num_lines_ >= 2 && line_ends_[num_lines_ - 1] == line_ends_[num_lines_ - 2] + 2;
+    if (!complete) {
+        if (num_lines_ == line_ends_.size())
+            throw bad_request{}; // Too many headers
+        return 0;
     }
 
-    // Check if we have new data for the body
-    if (state_ == parse_state::body) {
-        if (body_remaining_ >= data.size()) {
-            body_.append(data);
-            body_remaining_ -= data.size();
-        } else {
-            body_.insert(body_.end(), data.begin(), data.begin() + body_remaining_);
-            body_remaining_ = 0;
-        }
+    // Parse the head line by line; each line ends in CRLF
+    std::size_t line_start = 0;
+    for (std::size_t i = 0; i + 1 < num_lines_; i++) {
+        std::size_t eol_pos = line_ends_[i];
+        if (eol_pos == line_start || data[eol_pos - 1] != '\r')
+            throw bad_request{};
+        auto line = data.substr(line_start, eol_pos - 1 - line_start);
+        if (i == 0)
+            parse_request_line(line);
+        else
+            parse_header_line(line);
+        line_start = eol_pos + 1;
+    }
+    head_size_ = line_ends_[num_lines_ - 1] + 1;
+    return head_size_;
+}
 
-        // Did we complete?
-        if (body_remaining_ == 0) {
-            state_ = parse_state::done;
-            // return the read HTTP request object
-            return {http_request{method_, std::move(uri_), std::move(headers_), std::move(body_)}};
-        }
+http_request request_parser::make_request(std::string body) const {
+    return http_request{method_, uri_, headers_, std::move(body), version_};
+}
+
+void request_parser::parse_request_line(std::string_view line) {
+    // Parse the method
+    auto pos = std::min(line.find(' '), line.size());
+    auto [method, ok] = parse_method(line.substr(0, pos));
+    if (!ok)
+        throw bad_request{};
+    method_ = method;
+
+    // Parse the URI
+    auto pos0 = std::min(pos + 1, line.size());
+    pos = std::min(line.find(" HTTP/", pos0), line.size());
+    uri_ = line.substr(pos0, pos - pos0);
+
+    // Parse the version; anything that is not HTTP/1.0 is handled as HTTP/1.1
+    if (pos < line.size() && line.substr(pos + 6) == "1.0")
+        version_ = http_version::http_1_0;
+}
+
+void request_parser::parse_header_line(std::string_view line) {
+    auto pos = scan::find_char(line, ':');
+    if (pos == 0 || pos == std::string_view::npos)
+        throw bad_request{};
+    auto name = line.substr(0, pos);
+    auto value = trim_ows(line.substr(pos + 1));
+
+    // Map well-known names to the corresponding enum values
+    header_field field = lookup_header_field(name);
+    if (field == header_field::content_length) {
+        std::size_t length{0};
+        auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), length);
+        if (ec != std::errc{} || ptr != value.data() + value.size())
+            throw bad_request{};
+        // With conflicting lengths, we and a proxy in front of us may disagree on where the body
+        // ends, and thus on where the next request starts
+        if (has_content_length_ && length != content_length_)
+            throw bad_request{};
+        content_length_ = length;
+        has_content_length_ = true;
+    } else if (field == header_field::transfer_encoding) {
+        // We don't decode chunked bodies. Ignoring the header would make us read the body as the
+        // next request (request smuggling), so we refuse these requests.
+        throw not_implemented{};
     }
-    return {};
+
+    // Add the header
+    if (!headers_.push_back(header_view{field, name, value}))
+        throw bad_request{};
 }
 
-bool request_parser::add_current_line() {
-    std::string_view line{cur_line_};
-    if (state_ == parse_state::first_line) {
-        // Parse the method
-        auto pos = std::min(line.find(' '), line.size());
-        auto [method_, ok] = parse_method(line.substr(0, pos));
-        if (!ok)
-            return false;
-
-        // Parse the URI
-        auto pos0 = pos + 1;
-        pos = std::min(line.find(" HTTP/", pos0), line.size());
-        uri_ = line.substr(pos0, pos - pos0);
-
-        // Move to the next line
-        state_ = parse_state::header_lines;
-    } else {
-        if (line.empty()) {
-            // Empty line: end of headers
-            state_ = parse_state::body;
-        } else {
-            // header name
-            auto pos = std::min(line.find(':'), line.size());
-            auto hname = line.substr(0, pos);
-            line.remove_prefix(pos + 1);
-            // skip optional whitespace
-            line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
-            // header value
-            pos = std::min(line.rfind(' '), line.size());
-            auto hval = line.substr(0, pos);
-            if (hname.empty() || hval.empty())
+bool wants_keep_alive(const http_request& req) {
+    bool keep_alive = req.version_ == http_version::http_1_1;
+    for (const auto& h : req.headers_) {
+        if (h.field_ != header_field::connection)
+            continue;
+        // The header contains a list of comma-separated tokens, case-insensitive
+        std::string_view tokens{h.value_};
+        while (!tokens.empty()) {
+            auto pos = std::min(tokens.find(','), tokens.size());
+            auto token = trim_ows(tokens.substr(0, pos));
+            tokens.remove_prefix(std::min(pos + 1, tokens.size()));
+            if (iequals(token, "close"))
                 return false;
-
-            // Transform the header name in lowercase
-            std::string name{hname};
-            std::transform(name.begin(), name.end(), name.begin(), std::tolower);
-            // Check for content-length
-            std::string val{hval};
-            if (name == "content-length") {
-                body_remaining_ = static_cast<size_t>(std::stoull(val));
-                body_.reserve(body_remaining_);
-            }
-
-            // Add the header
-            headers_.push_back(header{std::move(name), std::move(val)});
+            if (iequals(token, "keep-alive"))
+                keep_alive = true;
         }
     }
-    return true;
+    return keep_alive;
 }
 
-} // namespace http_server
\ No newline at end of file
+} // namespace http_server
@@ -2,10 +2,12 @@
 
 #include "http_request.hpp"
 
+#include <array>
+#include <cstdint>
 #include <string>
 #include <string_view>
-#include <optional>
 #include <stdexcept>
+#include <utility>
 
 namespace http_server {
 
@@ -13,25 +15,56 @@ struct bad_request : std::exception {
     const char* what() const noexcept override { return "bad HTTP request"; }
 };
 
+//! Thrown for requests that use a feature that we don't implement; currently, any
+//! `Transfer-Encoding`
+struct not_implemented : std::exception {
+    const char* what() const noexcept override { return "HTTP feature not implemented"; }
+};
+
+//! Parses the method of a request; the flag is false if the method is unknown
+std::pair<http_method, bool> parse_method(std::string_view method_str);
+
+//! Parses the head of an HTTP request (the request line and the headers), without copying it.
+//!
+//! The head needs to be in a contiguous buffer. The parsed request points into that buffer, so the
+//! buffer must be kept unchanged while the request is in use. Parsing doesn't allocate memory.
 class request_parser {
 public:
-    std::optional<http_request> parse_next_packet(std::string_view data);
+    //! Parses the request head found at the beginning of `data`.
+    //! As long as the head is incomplete, this is called again with the same data, extended with
+    //! the newly received bytes; we don't scan twice the bytes that we've already seen.
+    //! Returns the size of the head, if complete, or 0 if we need more data.
+    //! Throws `bad_request` if the head is malformed, or if the size of the body is ambiguous.
+    //! Throws `not_implemented` if the request has a `Transfer-Encoding`.
+    std::size_t parse_head(std::string_view data);
+
+    //! Check if we finished parsing the request line and the headers
+    bool headers_complete() const noexcept { return head_size_ != 0; }
+
+    //! The size of the body, as given by the `Content-Length` header
+    std::size_t content_length() const noexcept { return content_length_; }
+
+    //! Creates the request object, after the head is complete, adding the given body to it
+    http_request make_request(std::string body) const;
 
 private:
-    enum class parse_state {
-        first_line,
-        header_lines,
-        body,
-        done,
-    };
-    parse_state state_{parse_state::first_line};
-    std::string cur_line_;
+    //! The size of the head, once we found its end
+    std::size_t head_size_{0};
+    //! The position from which we continue to look for the end of the head
+    std::size_t scan_pos_{0};
+    //! The positions of the line ends ('\n') found so far; one for the request line, one for each
+    //! header, and one for the empty line at the end
+    std::array<std::uint32_t, request_headers::max_size + 2> line_ends_;
+    std::size_t num_lines_{0};
     http_method method_{http_method::get};
-    std::string uri_;
-    headers headers_;
-    size_t body_remaining_{0};
-    std::string body_;
+    std::string_view uri_;
+    http_version version_{http_version::http_1_1};
+    request_headers headers_;
+    std::size_t content_length_{0};
+    bool has_content_length_{false};
 
-    bool add_current_line();
+    void parse_request_line(std::string_view line);
+    void parse_header_line(std::string_view line);
 };
-} // namespace http_server
\ No newline at end of file
+
+} // namespace http_server
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace http_server {
+
+//! Maps request paths to route indices, with a perfect hash built at compile time.
+//!
+//! The table is built from the list of paths; the index of a route is its position in the list.
+//! Looking up a path costs one hash of the path and one string comparison, regardless of the
+//! number of routes. Paths need to match exactly. If the routes cannot be told apart by the hash,
+//! the table fails to compile.
+template <std::size_t N>
+class route_table {
+public:
+    //! The index returned for unknown paths
+    static constexpr std::size_t npos = N;
+
+    consteval explicit route_table(std::array<std::string_view, N> paths)
+        : paths_(paths) {
+        // Look for a seed that gives no collisions between the paths
+        while (!try_build()) {
+            if (++seed_ > 10000)
+                throw "cannot find a perfect hash for the routes; do they differ only in the "
+                      "characters that the hash doesn't look at?";
+        }
+    }
+
+    //! Returns the index of the route with the given path, or `npos`
+    constexpr auto find(std::string_view path) const noexcept -> std::size_t {
+        std::size_t idx = slots_[hash(path, seed_) % table_size];
+        return idx != npos && paths_[idx] == path ? idx : npos;
+    }
+
+    constexpr auto size() const noexcept -> std::size_t { return N; }
+    constexpr auto path(std::size_t idx) const noexcept -> std::string_view { return paths_[idx]; }
+
+private:
+    static constexpr std::size_t table_size = std::bit_ceil(N * 2);
+
+    std::array<std::string_view, N> paths_;
+    std::array<std::size_t, table_size> slots_{};
+    std::uint32_t seed_{0};
+
+    //! The hash of a path. To be fast regardless of the length of the paths, it only looks at the
+    //! length and at four characters; the paths of the routes typically share a prefix and differ
+    //! towards the end.
+    static constexpr auto hash(std::string_view str, std::uint32_t seed) noexcept -> std::uint32_t {
+        std::uint32_t h = static_cast<std::uint32_t>(str.size()) * 0x9e3779b9u;
+        if (!str.empty()) {
+            auto at = [&](std::size_t i) { return static_cast<unsigned char>(str[i]); };
+            std::size_t n = str.size();
+            h ^= at(n - 1) | (at(n - 1 - (n - 1) / 8) << 8) | (at(n / 2) << 16) | (at(n / 4) << 24);
+        }
+        h = (h ^ seed) * 0x85ebca6bu;
+        return h ^ (h >> 15);
+    }
+
+    constexpr auto try_build() -> bool {
+        slots_.fill(npos);
+        for (std::size_t i = 0; i < N; i++) {
+            std::size_t& slot = slots_[hash(paths_[i], seed_) % table_size];
+            if (slot != npos)
+                return false;
+            slot = i;
+        }
+        return true;
+    }
+};
+
+} // namespace http_server
@@ -35,6 +35,10 @@ std::string_view status_code_to_string(status_code sc) {
         return "HTTP/1.1 403 Forbidden\r\n"sv;
     case status_code::s_404_not_found:
         return "HTTP/1.1 404 Not Found\r\n"sv;
+    case status_code::s_412_precondition_failed:
+        return "HTTP/1.1 412 Precondition Failed\r\n"sv;
+    case status_code::s_413_payload_too_large:
+        return "HTTP/1.1 413 Payload Too Large\r\n"sv;
     case status_code::s_500_internal_server_error:
         return "HTTP/1.1 500 Internal Server Error\r\n"sv;
     case status_code::s_501_not_implemented:
@@ -48,15 +52,32 @@ std::string_view status_code_to_string(status_code sc) {
 
 } // namespace
 
+int status_code_value(status_code sc) {
+    // The status line has the form "HTTP/1.1 NNN Reason\r\n"
+    std::string_view line = status_code_to_string(sc);
+    return (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+}
+
+bool has_content_length(status_code sc) {
+    return sc != status_code::s_204_no_content && sc != status_code::s_304_not_modified;
+}
+
 void to_buffers(const http_response& resp, std::vector<std::string_view>& buffers) {
-    buffers.reserve(1 + resp.headers_.size() * 4 + 2);
+    to_buffers(resp, {}, buffers);
+}
+
+void to_buffers(const http_response& resp, const headers& extra_headers,
+        std::vector<std::string_view>& buffers) {
+    buffers.reserve(1 + (resp.headers_.size() + extra_headers.size()) * 4 + 2);
 
     buffers.push_back(status_code_to_string(resp.status_code_));
-    for (const auto& p : resp.headers_) {
-        buffers.push_back(std::string_view(p.name_));
-        buffers.push_back(header_separator);
-        buffers.push_back(std::string_view(p.value_));
-        buffers.push_back(crlf);
+    for (const auto* hs : {&resp.headers_, &extra_headers}) {
+        for (const auto& p : *hs) {
+            buffers.push_back(std::string_view(p.name_));
+            buffers.push_back(header_separator);
+            buffers.push_back(std::string_view(p.value_));
+            buffers.push_back(crlf);
+        }
     }
     buffers.push_back(crlf);
     if (!resp.body_.empty())
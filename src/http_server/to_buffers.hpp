@@ -7,7 +7,20 @@
 
 namespace http_server {
 
+//! Returns the numeric value of a status code; e.g., 404 for `s_404_not_found`
+int status_code_value(status_code sc);
+
+//! Check if the responses with the given status code carry a `Content-Length`. A 204 has no body,
+//! and a 304 stands for a response that we don't send, so the length of its empty body would be
+//! wrong.
+bool has_content_length(status_code sc);
+
 //! Converts an HTTP response object to a vector of buffers, ready to be sent over a stream
 void to_buffers(const http_response& resp, std::vector<std::string_view>& buffers);
 
+//! Same as above, but also adds `extra_headers` after the headers of the response.
+//! The extra headers must outlive the buffers.
+void to_buffers(const http_response& resp, const headers& extra_headers,
+        std::vector<std::string_view>& buffers);
+
 } // namespace http_server
\ No newline at end of file
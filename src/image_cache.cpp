@@ -0,0 +1,28 @@
+#include "image_cache.hpp"
+
+#include "hash.hpp"
+#include "profiling.hpp"
+
+auto stage_key(const image_key& source, image_stage stage,
+        std::initializer_list<int> params) noexcept -> image_key {
+    std::uint64_t h = hash_combine(source.hash_, static_cast<std::uint64_t>(stage));
+    for (int p : params)
+        h = hash_combine(h, static_cast<std::uint64_t>(p));
+    return {h, source.body_size_};
+}
+
+#if HAS_OPENCV
+
+auto image_cache::find(const image_key& key) -> cv::Mat {
+    PROFILING_SCOPE();
+    return entries_.find(key).value_or(cv::Mat{});
+}
+
+auto image_cache::insert(const image_key& key, const cv::Mat& img) -> void {
+    PROFILING_SCOPE();
+    // The pixels, plus the header of the image and our bookkeeping
+    std::size_t size = img.total() * img.elemSize() + sizeof(cv::Mat) + 128;
+    entries_.insert(key, img, size);
+}
+
+#endif
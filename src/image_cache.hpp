@@ -0,0 +1,90 @@
+#pragma once
+
+#include "sharded_lru_cache.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+#if HAS_OPENCV
+#include <opencv2/core.hpp>
+#endif
+
+//! The stages of the transforms whose results are kept in the `image_cache`
+enum class image_stage : std::uint32_t {
+    //! The image decoded from the request body
+    decoded,
+    //! The edge mask: blur, grayscale, adaptive threshold
+    edges,
+    reduced_colors,
+    oil_painting,
+};
+
+//! Identifies an intermediate image by everything that it depends on: the content of the request
+//! body, the stage that produced the image, and the parameters of the stage
+struct image_key {
+    std::uint64_t hash_{0};
+    std::uint64_t body_size_{0};
+
+    auto operator==(const image_key& other) const noexcept -> bool = default;
+};
+
+//! Returns the key of the image in a request body, given the hash and the size of the body (see
+//! `response_key`); the keys of its stages are derived from it
+inline auto source_key(std::uint64_t body_hash, std::uint64_t body_size) noexcept
+        -> image_key {
+    return {body_hash, body_size};
+}
+
+//! Returns the key of the result of `stage`, with the given parameters, applied to the source
+auto stage_key(const image_key& source, image_stage stage,
+        std::initializer_list<int> params) noexcept -> image_key;
+
+#if HAS_OPENCV
+
+//! A cache of the decoded images and of the intermediate results of the transforms, bounded by
+//! the memory of the pixels.
+//!
+//! Clients often apply several transforms to the same image; with the cache, the image is decoded
+//! once, and the stages that the transforms share (e.g., the edges of `cartoonify` and
+//! `contourpaint`) are computed once. The images are shared with the readers, as `cv::Mat` is
+//! reference-counted; they must not be modified.
+class image_cache {
+public:
+    //! Creates a cache that holds up to `capacity` bytes of images
+    explicit image_cache(std::size_t capacity)
+        : entries_(capacity, num_shards, capacity / num_shards / 4) {}
+
+    //! Looks up the image for the key; returns an empty image if it's not in the cache
+    auto find(const image_key& key) -> cv::Mat;
+
+    //! Adds the image for the key. Images larger than a quarter of a shard are not cached.
+    auto insert(const image_key& key, const cv::Mat& img) -> void;
+
+    //! Get the counters
+    auto stats() const -> cache_stats { return entries_.stats(); }
+
+private:
+    //! The images are large, and few threads run the transforms at the same time; fewer shards let
+    //! each of them hold larger images
+    static constexpr std::size_t num_shards = 4;
+
+    struct key_hash {
+        auto operator()(const image_key& key) const noexcept -> std::size_t {
+            return static_cast<std::size_t>(key.hash_);
+        }
+    };
+    sharded_lru_cache<image_key, cv::Mat, key_hash> entries_;
+};
+
+#else
+
+//! Without OpenCV there are no images to cache
+class image_cache {
+public:
+    explicit image_cache(std::size_t /*capacity*/) {}
+
+    auto stats() const -> cache_stats { return {}; }
+};
+
+#endif
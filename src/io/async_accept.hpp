@@ -1,12 +1,15 @@
 #pragma once
 
 #include "io/io_context.hpp"
+#include "io/detail/cancel_on_stop.hpp"
 #include "io/listening_socket.hpp"
 #include "io/connection.hpp"
 #include <profiling.hpp>
 
 #include <sys/socket.h>
-#include <sys/fcntl.h>
+#include <unistd.h>
+
+#include <vector>
 
 namespace io {
 
@@ -26,31 +29,55 @@ struct async_accept_sender {
         Recv recv_;
         io_context* ctx_;
         native_file_desc_t fd_;
+        cancel_on_stop<Recv> stop_cb_;
 
         auto try_run() noexcept -> bool override {
             PROFILING_SCOPE_N("async_accept::try_run");
-            sockaddr address;
-            socklen_t length = sizeof(address);
-            int rc = ::accept(fd_, &address, &length);
+            // Once cancelled, wait for the I/O loop to stop us
+            if (cancel_requested())
+                return false;
+            int rc = ::accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
             PROFILING_SET_TEXT_FMT(32, "fd=%d => %d", fd_, rc);
+            return complete(rc >= 0 ? rc : -errno);
+        }
+        auto native_desc() noexcept -> native_io_desc override {
+            return {native_io_kind::accept, nullptr, 0};
+        }
+        auto complete_native(int res) noexcept -> bool override {
+            PROFILING_SCOPE_N("async_accept::complete_native");
+            PROFILING_SET_TEXT_FMT(32, "fd=%d => %d", fd_, res);
+            return complete(res);
+        }
+        //! Complete the operation with the result of `accept()` (negative errno on failure).
+        //! Returns false if the operation needs to be retried.
+        auto complete(int res) noexcept -> bool {
             // Is the operation complete?
-            if (rc >= 0) {
+            if (res >= 0) {
                 PROFILING_SCOPE_N("async_accept::try_run -- DONE");
-                native_file_desc_t conn_fd = static_cast<native_file_desc_t>(rc);
-                fcntl(conn_fd, F_SETFL, O_NONBLOCK);
+                native_file_desc_t conn_fd = static_cast<native_file_desc_t>(res);
+                if (!claim_completion()) {
+                    // Cancelled in the meantime; nobody will take the connection
+                    ::close(conn_fd);
+                    return false;
+                }
+                stop_cb_.reset();
                 std::execution::set_value(std::move(recv_), connection{conn_fd});
                 return true;
             }
             // Is the operation still in progress?
-            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            if (res == -EAGAIN || res == -EWOULDBLOCK)
                 return false;
             // General failure
             PROFILING_SCOPE_N("async_accept::try_run -- FAILURE");
-            auto err = std::error_code(errno, std::system_category());
+            if (!claim_completion())
+                return false;
+            stop_cb_.reset();
+            auto err = std::error_code(-res, std::system_category());
             std::execution::set_error(std::move(recv_), err);
             return true;
         }
         auto set_stopped() noexcept -> void override {
+            stop_cb_.reset();
             std::execution::set_stopped(std::move(recv_));
         }
 
@@ -63,8 +90,13 @@ struct async_accept_sender {
         friend void tag_invoke(std::execution::start_t, oper& self) noexcept {
             PROFILING_SCOPE_N("async_accept::start");
             try {
+                if (!self.stop_cb_.start(self.recv_, self.ctx_, &self)) {
+                    std::execution::set_stopped(std::move(self.recv_));
+                    return;
+                }
                 self.ctx_->get_scheduler().add_io_oper(self.fd_, oper_type::read, &self);
             } catch (...) {
+                self.stop_cb_.reset();
                 auto err = std::make_error_code(std::errc::operation_not_permitted);
                 std::execution::set_error(std::move(self.recv_), err);
             }
@@ -77,6 +109,135 @@ struct async_accept_sender {
         return {std::forward<Recv>(recv), self.ctx_, self.fd_};
     }
 };
+
+struct async_accept_batch_sender {
+    io_context* ctx_;
+    native_file_desc_t fd_;
+    std::size_t max_count_;
+
+    using completion_signatures = std::execution::completion_signatures< //
+            std::execution::set_value_t(std::vector<connection>),        //
+            std::execution::set_error_t(std::system_error),              //
+            std::execution::set_stopped_t()>;
+
+    template <std::execution::receiver Recv>
+    class oper : oper_body_base {
+        Recv recv_;
+        io_context* ctx_;
+        native_file_desc_t fd_;
+        std::size_t max_count_;
+        std::vector<connection> conns_;
+        cancel_on_stop<Recv> stop_cb_;
+
+        auto try_run() noexcept -> bool override {
+            PROFILING_SCOPE_N("async_accept_batch::try_run");
+            // Once cancelled, wait for the I/O loop to stop us
+            if (cancel_requested())
+                return false;
+            return complete(drain());
+        }
+        auto native_desc() noexcept -> native_io_desc override {
+            return {native_io_kind::accept_multishot, nullptr, max_count_};
+        }
+        auto complete_native(int res) noexcept -> bool override {
+            PROFILING_SCOPE_N("async_accept_batch::complete_native");
+            if (res < 0)
+                return complete(res);
+            // We got the first connection from the ring; take the rest of the batch directly
+            add_connection(res);
+            return complete(cancel_requested() ? 0 : drain());
+        }
+        auto complete_accepted(std::span<const native_file_desc_t> conns) noexcept
+                -> bool override {
+            PROFILING_SCOPE_N("async_accept_batch::complete_accepted");
+            // The multishot request keeps accepting for us; no need to drain the socket
+            for (native_file_desc_t conn_fd : conns)
+                add_connection(conn_fd);
+            return complete(-EAGAIN);
+        }
+        //! Accept connections until there are no more pending, or we reach our budget.
+        //! Returns the last error (negative errno), or 0 if we reached the budget.
+        auto drain() noexcept -> int {
+            while (conns_.size() < max_count_) {
+                int rc = ::accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (rc >= 0)
+                    add_connection(rc);
+                // The peer gave up before we accepted the connection; try the next one
+                else if (errno != ECONNABORTED && errno != EINTR)
+                    return -errno;
+            }
+            return 0;
+        }
+        auto add_connection(int conn_fd) noexcept -> void {
+            try {
+                conns_.emplace_back(static_cast<native_file_desc_t>(conn_fd));
+            } catch (...) {
+                // Out of memory; drop the connection
+                ::close(conn_fd);
+            }
+        }
+        //! Complete the operation if we have any connections, or on a general failure.
+        //! Returns false if the operation needs to be retried.
+        auto complete(int res) noexcept -> bool {
+            PROFILING_SET_TEXT_FMT(32, "fd=%d => %d conns", fd_, int(conns_.size()));
+            // Deliver what we have; a failure will be seen again on the next accept
+            if (!conns_.empty()) {
+                if (!claim_completion()) {
+                    // Cancelled in the meantime; nobody will take the connections
+                    conns_.clear();
+                    return false;
+                }
+                stop_cb_.reset();
+                std::execution::set_value(std::move(recv_), std::move(conns_));
+                return true;
+            }
+            // Is the operation still in progress?
+            if (res == -EAGAIN || res == -EWOULDBLOCK || res == -ECONNABORTED || res == -EINTR)
+                return false;
+            // General failure
+            PROFILING_SCOPE_N("async_accept_batch::try_run -- FAILURE");
+            if (!claim_completion())
+                return false;
+            stop_cb_.reset();
+            auto err = std::error_code(-res, std::system_category());
+            std::execution::set_error(std::move(recv_), err);
+            return true;
+        }
+        auto set_stopped() noexcept -> void override {
+            stop_cb_.reset();
+            std::execution::set_stopped(std::move(recv_));
+        }
+
+    public:
+        oper(Recv&& recv, io_context* ctx, native_file_desc_t fd, std::size_t max_count)
+            : recv_(std::move(recv))
+            , ctx_(ctx)
+            , fd_(fd)
+            , max_count_(max_count) {}
+
+        friend void tag_invoke(std::execution::start_t, oper& self) noexcept {
+            PROFILING_SCOPE_N("async_accept_batch::start");
+            try {
+                if (!self.stop_cb_.start(self.recv_, self.ctx_, &self)) {
+                    std::execution::set_stopped(std::move(self.recv_));
+                    return;
+                }
+                self.conns_.reserve(self.max_count_);
+                self.ctx_->get_scheduler().add_io_oper(self.fd_, oper_type::read, &self);
+            } catch (...) {
+                self.stop_cb_.reset();
+                auto err = std::make_error_code(std::errc::operation_not_permitted);
+                std::execution::set_error(std::move(self.recv_), err);
+            }
+        }
+    };
+
+    template <std::execution::receiver Recv>
+    friend auto tag_invoke(std::execution::connect_t, async_accept_batch_sender self, Recv&& recv)
+            -> oper<std::decay_t<Recv>> {
+        return {std::forward<Recv>(recv), self.ctx_, self.fd_, self.max_count_};
+    }
+};
 } // namespace detail
 
 inline auto async_accept(io_context& ctx, const listening_socket& sock)
@@ -84,4 +245,13 @@ inline auto async_accept(io_context& ctx, const listening_socket& sock)
     return {&ctx, sock.fd()};
 }
 
+//! Accepts all the pending connections on `sock`, up to `max_count`, in one go.
+//! Completes when at least one connection is accepted.
+//! With io_uring, a multishot accept request stays armed on the socket between the batches, and
+//! a batch is made of the connections that it accepted.
+inline auto async_accept_batch(io_context& ctx, const listening_socket& sock,
+        std::size_t max_count) -> detail::async_accept_batch_sender {
+    return {&ctx, sock.fd(), max_count};
+}
+
 } // namespace io
\ No newline at end of file
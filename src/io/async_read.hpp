@@ -1,6 +1,7 @@
 #pragma once
 
 #include "io/io_context.hpp"
+#include "io/detail/cancel_on_stop.hpp"
 #include "io/connection.hpp"
 #include "io/out_buffer.hpp"
 #include <profiling.hpp>
@@ -27,26 +28,50 @@ struct async_read_sender {
         io_context* ctx_;
         native_file_desc_t fd_;
         out_buffer buf_;
+        cancel_on_stop<Recv> stop_cb_;
 
         auto try_run() noexcept -> bool override {
             PROFILING_SCOPE_N("async_read::try_run");
+            // Once cancelled, wait for the I/O loop to stop us
+            if (cancel_requested())
+                return false;
             int rc = ::recv(fd_, buf_.data(), buf_.size(), MSG_DONTWAIT);
             PROFILING_SET_TEXT_FMT(32, "fd=%d => %d", fd_, rc);
+            return complete(rc >= 0 ? rc : -errno);
+        }
+        auto native_desc() noexcept -> native_io_desc override {
+            return {native_io_kind::recv, buf_.data(), buf_.size()};
+        }
+        auto complete_native(int res) noexcept -> bool override {
+            PROFILING_SCOPE_N("async_read::complete_native");
+            PROFILING_SET_TEXT_FMT(32, "fd=%d => %d", fd_, res);
+            return complete(res);
+        }
+        //! Complete the operation with the result of `recv()` (negative errno on failure).
+        //! Returns false if the operation needs to be retried.
+        auto complete(int res) noexcept -> bool {
             // Is the operation complete?
-            if (rc >= 0) {
-                std::size_t num_received = static_cast<std::size_t>(rc);
+            if (res >= 0) {
+                if (!claim_completion())
+                    return false;
+                stop_cb_.reset();
+                std::size_t num_received = static_cast<std::size_t>(res);
                 std::execution::set_value(std::move(recv_), num_received);
                 return true;
             }
             // Is the operation still in progress?
-            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            if (res == -EAGAIN || res == -EWOULDBLOCK || res == -EINTR)
                 return false;
             // General failure
-            auto err = std::error_code(errno, std::system_category());
+            if (!claim_completion())
+                return false;
+            stop_cb_.reset();
+            auto err = std::error_code(-res, std::system_category());
             std::execution::set_error(std::move(recv_), err);
             return true;
         }
         auto set_stopped() noexcept -> void override {
+            stop_cb_.reset();
             std::execution::set_stopped(std::move(recv_));
         }
 
@@ -60,8 +85,13 @@ struct async_read_sender {
         friend void tag_invoke(std::execution::start_t, oper& self) noexcept {
             PROFILING_SCOPE_N("async_read::start");
             try {
+                if (!self.stop_cb_.start(self.recv_, self.ctx_, &self)) {
+                    std::execution::set_stopped(std::move(self.recv_));
+                    return;
+                }
                 self.ctx_->get_scheduler().add_io_oper(self.fd_, oper_type::read, &self);
             } catch (...) {
+                self.stop_cb_.reset();
                 auto err = std::make_error_code(std::errc::operation_not_permitted);
                 std::execution::set_error(std::move(self.recv_), err);
             }
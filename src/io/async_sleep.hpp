@@ -0,0 +1,113 @@
+#pragma once
+
+#include "io/io_context.hpp"
+#include "io/detail/cancel_on_stop.hpp"
+#include <profiling.hpp>
+
+namespace io {
+
+namespace detail {
+
+struct async_sleep_sender {
+    io_context* ctx_;
+    //! The time point at which we complete; for relative sleeps, the origin is the start time
+    io_context::scheduler::time_point deadline_;
+    //! For relative sleeps, the amount of time to wait, measured from the start of the operation
+    io_context::scheduler::duration delay_;
+    bool relative_;
+
+    using completion_signatures = std::execution::completion_signatures< //
+            std::execution::set_value_t(),                               //
+            std::execution::set_error_t(std::system_error),              //
+            std::execution::set_stopped_t()>;
+
+    template <std::execution::receiver Recv>
+    class oper : timer_oper_base {
+        Recv recv_;
+        io_context* ctx_;
+        io_context::scheduler::duration delay_;
+        bool relative_;
+        cancel_on_stop<Recv> stop_cb_;
+
+        auto try_run() noexcept -> bool override {
+            PROFILING_SCOPE_N("async_sleep::try_run");
+            // If we are being cancelled, the I/O loop will stop us
+            if (!claim_completion())
+                return true;
+            stop_cb_.reset();
+            std::execution::set_value(std::move(recv_));
+            return true;
+        }
+        auto set_stopped() noexcept -> void override {
+            stop_cb_.reset();
+            std::execution::set_stopped(std::move(recv_));
+        }
+
+    public:
+        oper(Recv&& recv, io_context* ctx, io_context::scheduler::time_point deadline,
+                io_context::scheduler::duration delay, bool relative)
+            : recv_(std::move(recv))
+            , ctx_(ctx)
+            , delay_(delay)
+            , relative_(relative) {
+            deadline_ = deadline;
+        }
+
+        friend void tag_invoke(std::execution::start_t, oper& self) noexcept {
+            PROFILING_SCOPE_N("async_sleep::start");
+            try {
+                if (!self.stop_cb_.start(self.recv_, self.ctx_, &self)) {
+                    std::execution::set_stopped(std::move(self.recv_));
+                    return;
+                }
+                auto sched = self.ctx_->get_scheduler();
+                if (self.relative_)
+                    self.deadline_ = sched.now() + self.delay_;
+                sched.add_timer_oper(&self);
+            } catch (...) {
+                self.stop_cb_.reset();
+                auto err = std::make_error_code(std::errc::operation_not_permitted);
+                std::execution::set_error(std::move(self.recv_), err);
+            }
+        }
+    };
+
+    template <std::execution::receiver Recv>
+    friend auto tag_invoke(std::execution::connect_t, async_sleep_sender&& self, Recv&& recv)
+            -> oper<std::decay_t<Recv>> {
+        return {std::forward<Recv>(recv), self.ctx_, self.deadline_, self.delay_, self.relative_};
+    }
+    friend auto tag_invoke(std::execution::get_completion_scheduler_t<std::execution::set_value_t>,
+            const async_sleep_sender& self) noexcept -> io_context::scheduler {
+        return self.ctx_->get_scheduler();
+    }
+};
+} // namespace detail
+
+//! Returns a sender that completes on the I/O thread of `ctx` when `deadline` is reached.
+inline auto async_sleep_until(io_context& ctx, io_context::scheduler::time_point deadline)
+        -> detail::async_sleep_sender {
+    return {&ctx, deadline, {}, false};
+}
+
+//! Returns a sender that completes on the I/O thread of `ctx` after `dur` has elapsed, measured
+//! from the moment the operation is started.
+inline auto async_sleep_for(io_context& ctx, io_context::scheduler::duration dur)
+        -> detail::async_sleep_sender {
+    return {&ctx, {}, dur, true};
+}
+
+//! Like `schedule()`, but completes on the scheduler when the time point `deadline` is reached.
+inline auto schedule_at(io_context::scheduler sched, io_context::scheduler::time_point deadline)
+        -> detail::async_sleep_sender {
+    return {sched.context(), deadline, {}, false};
+}
+
+//! Like `schedule()`, but completes on the scheduler after `dur` has elapsed.
+//! The duration is measured from the moment the operation is started.
+inline auto schedule_after(io_context::scheduler sched, io_context::scheduler::duration dur)
+        -> detail::async_sleep_sender {
+    return {sched.context(), {}, dur, true};
+}
+
+} // namespace io
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "io/io_context.hpp"
+#include "io/detail/cancel_on_stop.hpp"
+#include "io/signal_set.hpp"
+#include <profiling.hpp>
+
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+namespace io {
+
+namespace detail {
+
+struct async_wait_signal_sender {
+    io_context* ctx_;
+    native_file_desc_t fd_;
+
+    using completion_signatures = std::execution::completion_signatures< //
+            std::execution::set_value_t(int),                            //
+            std::execution::set_error_t(std::system_error),              //
+            std::execution::set_stopped_t()>;
+
+    template <std::execution::receiver Recv>
+    class oper : oper_body_base {
+        Recv recv_;
+        io_context* ctx_;
+        native_file_desc_t fd_;
+        cancel_on_stop<Recv> stop_cb_;
+
+        auto try_run() noexcept -> bool override {
+            PROFILING_SCOPE_N("async_wait_signal::try_run");
+            // Once cancelled, wait for the I/O loop to stop us
+            if (cancel_requested())
+                return false;
+            signalfd_siginfo info;
+            auto rc = ::read(fd_, &info, sizeof(info));
+            // Is the signal still to come?
+            if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                return false;
+            if (!claim_completion())
+                return false;
+            stop_cb_.reset();
+            if (rc < 0) {
+                auto err = std::error_code(errno, std::system_category());
+                std::execution::set_error(std::move(recv_), err);
+            } else {
+                std::execution::set_value(std::move(recv_), static_cast<int>(info.ssi_signo));
+            }
+            return true;
+        }
+        auto set_stopped() noexcept -> void override {
+            stop_cb_.reset();
+            std::execution::set_stopped(std::move(recv_));
+        }
+
+    public:
+        oper(Recv&& recv, io_context* ctx, native_file_desc_t fd)
+            : recv_(std::move(recv))
+            , ctx_(ctx)
+            , fd_(fd) {}
+
+        friend void tag_invoke(std::execution::start_t, oper& self) noexcept {
+            PROFILING_SCOPE_N("async_wait_signal::start");
+            try {
+                if (!self.stop_cb_.start(self.recv_, self.ctx_, &self)) {
+                    std::execution::set_stopped(std::move(self.recv_));
+                    return;
+                }
+                self.ctx_->get_scheduler().add_io_oper(self.fd_, oper_type::read, &self);
+            } catch (...) {
+                self.stop_cb_.reset();
+                auto err = std::make_error_code(std::errc::operation_not_permitted);
+                std::execution::set_error(std::move(self.recv_), err);
+            }
+        }
+    };
+
+    template <std::execution::receiver Recv>
+    friend auto tag_invoke(std::execution::connect_t, async_wait_signal_sender&& self, Recv&& recv)
+            -> oper<std::decay_t<Recv>> {
+        return {std::forward<Recv>(recv), self.ctx_, self.fd_};
+    }
+};
+} // namespace detail
+
+//! Returns a sender that completes on the I/O thread of `ctx` with the number of the next signal
+//! from `signals` that the process receives.
+inline auto async_wait_signal(io_context& ctx, const signal_set& signals)
+        -> detail::async_wait_signal_sender {
+    return {&ctx, signals.fd()};
+}
+
+} // namespace io
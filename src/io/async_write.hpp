@@ -1,6 +1,7 @@
 #pragma once
 
 #include "io/io_context.hpp"
+#include "io/detail/cancel_on_stop.hpp"
 #include "io/connection.hpp"
 #include <profiling.hpp>
 
@@ -27,28 +28,52 @@ struct async_write_sender {
         io_context* ctx_;
         native_file_desc_t fd_;
         std::string_view data_;
+        cancel_on_stop<Recv> stop_cb_;
 
         auto try_run() noexcept -> bool override {
             PROFILING_SCOPE_N("async_write::try_run");
+            // Once cancelled, wait for the I/O loop to stop us
+            if (cancel_requested())
+                return false;
             int rc = ::send(fd_, data_.data(), data_.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
             PROFILING_SET_TEXT_FMT(32, "fd=%d => %d", fd_, rc);
+            return complete(rc >= 0 ? rc : -errno);
+        }
+        auto native_desc() noexcept -> native_io_desc override {
+            return {native_io_kind::send, const_cast<char*>(data_.data()), data_.size()};
+        }
+        auto complete_native(int res) noexcept -> bool override {
+            PROFILING_SCOPE_N("async_write::complete_native");
+            PROFILING_SET_TEXT_FMT(32, "fd=%d => %d", fd_, res);
+            return complete(res);
+        }
+        //! Complete the operation with the result of `send()` (negative errno on failure).
+        //! Returns false if the operation needs to be retried.
+        auto complete(int res) noexcept -> bool {
             // Is the operation complete?
-            if (rc >= 0) {
+            if (res >= 0) {
+                if (!claim_completion())
+                    return false;
+                stop_cb_.reset();
                 PROFILING_SCOPE_N("async_write::try_run -- DONE");
-                std::size_t num_sent = static_cast<std::size_t>(rc);
+                std::size_t num_sent = static_cast<std::size_t>(res);
                 std::execution::set_value(std::move(recv_), num_sent);
                 return true;
             }
             // Is the operation still in progress?
-            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == EALREADY)
+            if (res == -EAGAIN || res == -EWOULDBLOCK || res == -EINTR || res == -EALREADY)
                 return false;
             // General failure
             PROFILING_SCOPE_N("async_write::try_run -- FAIL");
-            auto err = std::error_code(errno, std::system_category());
+            if (!claim_completion())
+                return false;
+            stop_cb_.reset();
+            auto err = std::error_code(-res, std::system_category());
             std::execution::set_error(std::move(recv_), err);
             return true;
         }
         auto set_stopped() noexcept -> void override {
+            stop_cb_.reset();
             std::execution::set_stopped(std::move(recv_));
         }
 
@@ -62,8 +87,13 @@ struct async_write_sender {
         friend void tag_invoke(std::execution::start_t, oper& self) noexcept {
             PROFILING_SCOPE_N("async_write::start");
             try {
+                if (!self.stop_cb_.start(self.recv_, self.ctx_, &self)) {
+                    std::execution::set_stopped(std::move(self.recv_));
+                    return;
+                }
                 self.ctx_->get_scheduler().add_io_oper(self.fd_, oper_type::write, &self);
             } catch (...) {
+                self.stop_cb_.reset();
                 auto err = std::make_error_code(std::errc::operation_not_permitted);
                 std::execution::set_error(std::move(self.recv_), err);
             }
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "io/io_context.hpp"
+#include "io/detail/cancel_on_stop.hpp"
+#include "io/connection.hpp"
+#include "io/zerocopy.hpp"
+#include <profiling.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace io {
+
+namespace detail {
+
+struct async_writev_sender {
+    io_context* ctx_;
+    native_file_desc_t fd_;
+    std::span<const std::string_view> buffers_;
+    zerocopy_tracker* zc_;
+
+    using completion_signatures = std::execution::completion_signatures< //
+            std::execution::set_value_t(std::size_t),                    //
+            std::execution::set_error_t(std::system_error),              //
+            std::execution::set_stopped_t()>;
+
+    template <std::execution::receiver Recv>
+    class oper : oper_body_base {
+        Recv recv_;
+        io_context* ctx_;
+        native_file_desc_t fd_;
+        //! The buffers to be written; the ones before `first_` were completely written
+        std::vector<iovec> iov_;
+        std::size_t first_{0};
+        //! The message passed to `sendmsg()`, pointing to the remaining buffers
+        msghdr msg_{};
+        std::size_t total_sent_{0};
+        //! If set, we send with `MSG_ZEROCOPY`, and count the sends here
+        zerocopy_tracker* zc_;
+        cancel_on_stop<Recv> stop_cb_;
+
+        auto try_run() noexcept -> bool override {
+            PROFILING_SCOPE_N("async_writev::try_run");
+            // Once cancelled, wait for the I/O loop to stop us
+            if (cancel_requested())
+                return false;
+            update_msg();
+            int flags = MSG_DONTWAIT | MSG_NOSIGNAL | (zc_ ? MSG_ZEROCOPY : 0);
+            auto rc = ::sendmsg(fd_, &msg_, flags);
+            if (rc < 0 && errno == ENOBUFS && zc_) {
+                // Not enough memory to pin the pages; send this part the regular way
+                rc = ::sendmsg(fd_, &msg_, MSG_DONTWAIT | MSG_NOSIGNAL);
+            } else if (rc >= 0 && zc_) {
+                zc_->sent_++;
+            }
+            PROFILING_SET_TEXT_FMT(32, "fd=%d => %d", fd_, int(rc));
+            return complete(rc >= 0 ? static_cast<int>(rc) : -errno);
+        }
+        auto native_desc() noexcept -> native_io_desc override {
+            // Zero-copy sends go through `try_run()`, so that we can count them
+            if (zc_)
+                return {};
+            update_msg();
+            return {native_io_kind::sendmsg, &msg_, 0};
+        }
+        auto complete_native(int res) noexcept -> bool override {
+            PROFILING_SCOPE_N("async_writev::complete_native");
+            PROFILING_SET_TEXT_FMT(32, "fd=%d => %d", fd_, res);
+            return complete(res);
+        }
+        //! Make `msg_` point to the buffers that still need to be written
+        auto update_msg() noexcept -> void {
+            msg_.msg_iov = iov_.data() + first_;
+            msg_.msg_iovlen = std::min<std::size_t>(iov_.size() - first_, IOV_MAX);
+        }
+        //! Skip over the `n` bytes that were written
+        auto advance(std::size_t n) noexcept -> void {
+            total_sent_ += n;
+            while (first_ < iov_.size() && n >= iov_[first_].iov_len) {
+                n -= iov_[first_].iov_len;
+                first_++;
+            }
+            if (n > 0) {
+                iov_[first_].iov_base = static_cast<char*>(iov_[first_].iov_base) + n;
+                iov_[first_].iov_len -= n;
+            }
+        }
+        //! Complete the operation with the result of `sendmsg()` (negative errno on failure).
+        //! Returns false if the operation needs to be retried; that includes partial writes.
+        auto complete(int res) noexcept -> bool {
+            if (res >= 0) {
+                advance(static_cast<std::size_t>(res));
+                // After a partial write, wait until we can write again, and continue from there
+                if (first_ < iov_.size())
+                    return false;
+                if (!claim_completion())
+                    return false;
+                stop_cb_.reset();
+                PROFILING_SCOPE_N("async_writev::try_run -- DONE");
+                std::execution::set_value(std::move(recv_), total_sent_);
+                return true;
+            }
+            // Is the operation still in progress?
+            if (res == -EAGAIN || res == -EWOULDBLOCK || res == -EINTR || res == -EALREADY)
+                return false;
+            // General failure
+            PROFILING_SCOPE_N("async_writev::try_run -- FAIL");
+            if (!claim_completion())
+                return false;
+            stop_cb_.reset();
+            auto err = std::error_code(-res, std::system_category());
+            std::execution::set_error(std::move(recv_), err);
+            return true;
+        }
+        auto set_stopped() noexcept -> void override {
+            stop_cb_.reset();
+            std::execution::set_stopped(std::move(recv_));
+        }
+
+    public:
+        oper(Recv&& recv, io_context* ctx, native_file_desc_t fd,
+                std::span<const std::string_view> buffers, zerocopy_tracker* zc)
+            : recv_(std::move(recv))
+            , ctx_(ctx)
+            , fd_(fd)
+            , zc_(zc) {
+            iov_.reserve(buffers.size());
+            for (auto buf : buffers)
+                if (!buf.empty())
+                    iov_.push_back(iovec{const_cast<char*>(buf.data()), buf.size()});
+        }
+
+        friend void tag_invoke(std::execution::start_t, oper& self) noexcept {
+            PROFILING_SCOPE_N("async_writev::start");
+            try {
+                if (!self.stop_cb_.start(self.recv_, self.ctx_, &self)) {
+                    std::execution::set_stopped(std::move(self.recv_));
+                    return;
+                }
+                if (self.iov_.empty()) {
+                    // Nothing to write
+                    self.stop_cb_.reset();
+                    std::execution::set_value(std::move(self.recv_), std::size_t{0});
+                    return;
+                }
+                self.ctx_->get_scheduler().add_io_oper(self.fd_, oper_type::write, &self);
+            } catch (...) {
+                self.stop_cb_.reset();
+                auto err = std::make_error_code(std::errc::operation_not_permitted);
+                std::execution::set_error(std::move(self.recv_), err);
+            }
+        }
+    };
+
+    template <std::execution::receiver Recv>
+    friend auto tag_invoke(std::execution::connect_t, async_writev_sender&& self, Recv&& recv)
+            -> oper<std::decay_t<Recv>> {
+        return {std::forward<Recv>(recv), self.ctx_, self.fd_, self.buffers_, self.zc_};
+    }
+};
+} // namespace detail
+
+//! Writes all the given buffers to the connection, with as few `sendmsg()` calls as possible.
+//! Partial writes are continued when the connection becomes writable again; completes with the
+//! total number of bytes written. The buffers need to stay alive until the operation completes.
+inline auto async_writev(io_context& ctx, const connection& c,
+        std::span<const std::string_view> buffers) -> detail::async_writev_sender {
+    return {&ctx, c.fd(), buffers, nullptr};
+}
+
+//! Same as above, but sends with `MSG_ZEROCOPY`; the kernel doesn't copy the data, but uses the
+//! buffers until the peer acknowledges it. The sends are counted in `zc`; after this completes,
+//! `async_zerocopy_release()` needs to complete before the buffers can be freed.
+//! Zero-copy needs to be enabled on the connection, with `enable_zerocopy()`.
+inline auto async_writev(io_context& ctx, const connection& c,
+        std::span<const std::string_view> buffers, zerocopy_tracker& zc)
+        -> detail::async_writev_sender {
+    return {&ctx, c.fd(), buffers, &zc};
+}
+
+} // namespace io
@@ -0,0 +1,76 @@
+#include "buffer_pool.hpp"
+#include "profiling.hpp"
+
+#include <cassert>
+#include <utility>
+
+namespace io {
+
+pooled_buffer::pooled_buffer(pooled_buffer&& other) noexcept
+    : pool_(std::exchange(other.pool_, nullptr))
+    , data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0)) {}
+
+auto pooled_buffer::operator=(pooled_buffer&& other) noexcept -> pooled_buffer& {
+    if (this != &other) {
+        reset();
+        pool_ = std::exchange(other.pool_, nullptr);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+auto pooled_buffer::reset() noexcept -> void {
+    if (data_)
+        pool_->release(data_, size_);
+    pool_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+buffer_pool::buffer_pool(std::size_t max_free)
+    : max_free_(max_free) {
+    // Releasing buffers never allocates
+    for (auto& list : free_)
+        list.reserve(max_free_);
+}
+
+buffer_pool::~buffer_pool() {
+    for (auto& list : free_)
+        for (char* p : list)
+            delete[] p;
+}
+
+auto buffer_pool::acquire(std::size_t size) -> pooled_buffer {
+    assert(size <= large_size);
+    bool large = size > small_size;
+    std::size_t class_size = large ? large_size : small_size;
+    auto& list = free_[large ? 1 : 0];
+
+    char* data = nullptr;
+    if (!list.empty()) {
+        data = list.back();
+        list.pop_back();
+        stats_.hits_++;
+    } else {
+        PROFILING_SCOPE_N("buffer_pool -- allocate");
+        data = new char[class_size];
+        stats_.misses_++;
+    }
+    stats_.in_use_bytes_ += class_size;
+    if (stats_.in_use_bytes_ > stats_.high_water_bytes_)
+        stats_.high_water_bytes_ = stats_.in_use_bytes_;
+    return {this, data, class_size};
+}
+
+auto buffer_pool::release(char* data, std::size_t size) noexcept -> void {
+    stats_.in_use_bytes_ -= size;
+    auto& list = free_[size > small_size ? 1 : 0];
+    if (list.size() < max_free_)
+        list.push_back(data);
+    else
+        delete[] data;
+}
+
+} // namespace io
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace io {
+
+class buffer_pool;
+
+//! A buffer taken from a `buffer_pool`; gives the memory back to the pool when destroyed.
+//! Must be destroyed on the thread that owns the pool.
+class pooled_buffer {
+public:
+    pooled_buffer() = default;
+    ~pooled_buffer() { reset(); }
+    pooled_buffer(pooled_buffer&& other) noexcept;
+    auto operator=(pooled_buffer&& other) noexcept -> pooled_buffer&;
+
+    pooled_buffer(const pooled_buffer& other) = delete;
+    auto operator=(const pooled_buffer& other) -> pooled_buffer& = delete;
+
+    auto data() const noexcept -> char* { return data_; }
+    auto size() const noexcept -> std::size_t { return size_; }
+    explicit operator bool() const noexcept { return data_ != nullptr; }
+
+    //! Give the memory back to the pool
+    auto reset() noexcept -> void;
+
+private:
+    friend class buffer_pool;
+    pooled_buffer(buffer_pool* pool, char* data, std::size_t size)
+        : pool_(pool)
+        , data_(data)
+        , size_(size) {}
+
+    buffer_pool* pool_{nullptr};
+    char* data_{nullptr};
+    std::size_t size_{0};
+};
+
+//! Statistics of a `buffer_pool`
+struct buffer_pool_stats {
+    //! Number of buffers served from the free lists
+    std::uint64_t hits_{0};
+    //! Number of buffers that had to be allocated
+    std::uint64_t misses_{0};
+    //! Number of bytes currently held by the users of the pool
+    std::size_t in_use_bytes_{0};
+    //! The maximum value reached by `in_use_bytes_`
+    std::size_t high_water_bytes_{0};
+};
+
+//! A pool of fixed-size buffers, used for reading from the connections.
+//!
+//! There are two size classes: small slabs, enough for typical request heads, and large chunks,
+//! used for large heads and for the request bodies. Released buffers are kept in per-class free
+//! lists, up to a limit, so that connections can reuse them without going to the allocator.
+//!
+//! Not thread-safe; there is one pool per I/O thread, used only by that thread.
+class buffer_pool {
+public:
+    static constexpr std::size_t small_size = 16 * 1024;
+    static constexpr std::size_t large_size = 64 * 1024;
+
+    //! Creates a pool that keeps at most `max_free` unused buffers of each size class
+    explicit buffer_pool(std::size_t max_free = 256);
+    ~buffer_pool();
+
+    buffer_pool(const buffer_pool& other) = delete;
+    auto operator=(const buffer_pool& other) -> buffer_pool& = delete;
+
+    //! Get a buffer of at least `size` bytes; `size` cannot be larger than `large_size`
+    auto acquire(std::size_t size) -> pooled_buffer;
+
+    auto stats() const noexcept -> const buffer_pool_stats& { return stats_; }
+
+private:
+    friend class pooled_buffer;
+    auto release(char* data, std::size_t size) noexcept -> void;
+
+    std::size_t max_free_;
+    //! The free lists, for the small and for the large buffers
+    std::vector<char*> free_[2];
+    buffer_pool_stats stats_;
+};
+
+} // namespace io
@@ -1,6 +1,7 @@
 #include "connection.hpp"
 #include "profiling.hpp"
 
+#include <sys/socket.h>
 #include <unistd.h>
 
 namespace io {
@@ -25,4 +26,15 @@ auto connection::close() -> void {
     fd_ = 0;
 }
 
+auto connection::abort() const noexcept -> void {
+    PROFILING_SCOPE();
+    // Closing the socket would reset the connection with a zero linger time, but others may still
+    // use the file descriptor; disconnecting it does the same, and keeps it open
+    linger no_linger{1, 0};
+    ::setsockopt(fd_, SOL_SOCKET, SO_LINGER, &no_linger, sizeof(no_linger));
+    sockaddr unspec{};
+    unspec.sa_family = AF_UNSPEC;
+    ::connect(fd_, &unspec, sizeof(unspec));
+}
+
 } // namespace io
\ No newline at end of file
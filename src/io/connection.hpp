@@ -20,6 +20,9 @@ public:
     auto operator=(const connection& other) -> connection& = delete;
 
     auto close() -> void;
+    //! Resets the connection: the data not yet sent or acknowledged is dropped, and the peer gets a
+    //! RST. The file descriptor stays open until `close()`; further operations on it fail.
+    auto abort() const noexcept -> void;
 
     auto fd() const noexcept -> detail::native_file_desc_t { return fd_; }
 };
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "io/io_context.hpp"
+#include "io/connection.hpp"
+#include <profiling.hpp>
+
+#include <sys/socket.h>
+
+namespace io {
+
+//! A deadline for the operations performed on a connection.
+//!
+//! If the deadline expires while armed, the connection is shut down. Any pending operation on the
+//! connection completes (reads see the end of the stream, writes fail), and the owner of the
+//! connection closes it. Arming and disarming are O(1), and expiry costs nothing for the
+//! connections that are not reaped.
+//!
+//! The deadline must be armed, disarmed and destroyed on the thread running the I/O context.
+class connection_deadline : detail::timer_oper_base {
+public:
+    connection_deadline(io_context& ctx, const connection& conn)
+        : ctx_(ctx)
+        , fd_(conn.fd()) {}
+    ~connection_deadline() { disarm(); }
+
+    connection_deadline(const connection_deadline&) = delete;
+    auto operator=(const connection_deadline&) -> connection_deadline& = delete;
+
+    //! Arm the deadline to expire after `timeout`, replacing any previous deadline.
+    //! A zero timeout leaves the deadline disarmed.
+    auto arm(std::chrono::milliseconds timeout) noexcept -> void {
+        disarm();
+        if (timeout <= std::chrono::milliseconds::zero())
+            return;
+        auto sched = ctx_.get_scheduler();
+        deadline_ = sched.now() + timeout;
+        sched.add_local_timer(this);
+    }
+    //! Disarm the deadline, if it didn't expire yet
+    auto disarm() noexcept -> void { ctx_.get_scheduler().remove_local_timer(this); }
+
+    //! Check whether the deadline expired, and the connection was shut down
+    auto expired() const noexcept -> bool { return expired_; }
+
+private:
+    io_context& ctx_;
+    detail::native_file_desc_t fd_;
+    bool expired_{false};
+
+    auto try_run() noexcept -> bool override {
+        PROFILING_SCOPE_N("connection_deadline -- expired");
+        PROFILING_SET_TEXT_FMT(32, "fd=%d", fd_);
+        expired_ = true;
+        ::shutdown(fd_, SHUT_RDWR);
+        return true;
+    }
+    auto set_stopped() noexcept -> void override {}
+};
+
+} // namespace io
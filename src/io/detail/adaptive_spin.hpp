@@ -0,0 +1,68 @@
+#pragma once
+
+#include "io/io_loop_stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace io::detail {
+
+//! Decides how long an I/O loop spins, looking for work, before it blocks in the kernel.
+//!
+//! The spin budget adapts to the gaps between the bursts of work. If the loop had to block, but
+//! work arrived shortly after (within the maximum spin time), the budget grows to cover that gap.
+//! If the loop stayed blocked for longer than the maximum spin time, the budget is halved, so an
+//! idle loop quickly stops burning CPU.
+class adaptive_spin {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit adaptive_spin(std::chrono::microseconds max_spin)
+        : max_spin_(max_spin)
+        , min_spin_(std::max(max_spin / 64, std::chrono::microseconds{1}))
+        , budget_(max_spin) {}
+
+    //! Check if busy-polling is enabled
+    auto enabled() const noexcept -> bool { return max_spin_.count() > 0; }
+
+    //! Calls `check()` repeatedly, until it returns true or the spin budget runs out.
+    //! Returns true if work was found (counted as a spin hit); false if the loop needs to block.
+    template <typename F>
+    auto spin(F&& check, io_loop_stats& stats) -> bool {
+        if (!enabled())
+            return false;
+        auto start = clock::now();
+        auto deadline = start + budget_;
+        auto now = start;
+        do {
+            if (check()) {
+                stats.spin_hits_++;
+                budget_ = std::min(max_spin_, std::max(budget_, (now - start) * 2));
+                return true;
+            }
+            now = clock::now();
+        } while (now < deadline);
+        parked_at_ = now;
+        return false;
+    }
+
+    //! Called after the loop blocked, once `spin()` returned false. Adjusts the spin budget based
+    //! on how long we had to wait for work.
+    auto woke_up() noexcept -> void {
+        if (!enabled())
+            return;
+        auto gap = clock::now() - parked_at_;
+        if (gap <= max_spin_)
+            budget_ = std::clamp(gap * 2, min_spin_, max_spin_);
+        else
+            budget_ = std::max(min_spin_, budget_ / 2);
+    }
+
+private:
+    clock::duration max_spin_;
+    clock::duration min_spin_;
+    clock::duration budget_;
+    clock::time_point parked_at_;
+};
+
+} // namespace io::detail
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "io/io_context.hpp"
+
+#include <execution.hpp>
+#include <optional>
+
+namespace io::detail {
+
+//! Connects the stop token of a receiver with the cancellation of an operation from an I/O context.
+//!
+//! When stop is requested, a cancellation request is submitted to the I/O loop, which removes the
+//! operation from its pending set and completes it with `set_stopped()`. From that moment, the
+//! operation must not complete on its own; see `oper_body_base::claim_completion()`. Stop can be
+//! requested from any thread.
+template <typename Recv>
+class cancel_on_stop {
+    struct on_stop_requested {
+        cancel_on_stop* self_;
+        auto operator()() noexcept -> void {
+            if (self_->req_.target_->request_cancel())
+                self_->ctx_->get_scheduler().cancel_oper(&self_->req_);
+        }
+    };
+    using stop_token_t = std::stop_token_of_t<Recv&>;
+    using callback_t = typename stop_token_t::template callback_type<on_stop_requested>;
+
+    io_context* ctx_{nullptr};
+    cancel_request req_;
+    std::optional<callback_t> callback_;
+
+public:
+    cancel_on_stop() = default;
+    cancel_on_stop(const cancel_on_stop&) = delete;
+    auto operator=(const cancel_on_stop&) -> cancel_on_stop& = delete;
+
+    //! Start listening for stop requests for operation `op`, to be executed on `ctx`.
+    //! Returns false if stop was already requested; the operation should not be started then.
+    auto start(Recv& recv, io_context* ctx, oper_body_base* op) -> bool {
+        auto token = std::get_stop_token(recv);
+        if (token.stop_requested())
+            return false;
+        if (token.stop_possible()) {
+            ctx_ = ctx;
+            req_.target_ = op;
+            callback_.emplace(token, on_stop_requested{this});
+        }
+        return true;
+    }
+
+    //! Stop listening for stop requests; must be called before completing the operation
+    auto reset() noexcept -> void { callback_.reset(); }
+};
+
+} // namespace io::detail
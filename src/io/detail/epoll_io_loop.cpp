@@ -0,0 +1,345 @@
+#include "epoll_io_loop.hpp"
+#include <profiling.hpp>
+
+#include <algorithm>
+#include <system_error>
+#include <unistd.h>
+
+namespace io::detail {
+
+namespace {
+//! Try to complete the first operation from the given list.
+//! Returns true if the operation completed (and it was removed from the list).
+auto try_complete_front(std::vector<oper_body_base*>& opers) -> bool {
+    if (!opers.empty() && opers.front()->try_run()) {
+        opers.erase(opers.begin());
+        return true;
+    }
+    return false;
+}
+} // namespace
+
+epoll_io_loop::epoll_io_loop(const io_options& opts)
+    : edge_triggered_(opts.edge_triggered_)
+    , spin_(opts.max_spin_) {
+    PROFILING_SCOPE();
+
+    static constexpr std::size_t expected_max_fds = 1024;
+    fd_entries_.reserve(expected_max_fds);
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0)
+        throw std::system_error(std::error_code(errno, std::system_category()));
+
+    // The wake fd is always level-triggered; we consume the signal when it's reported
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = in_queue_.wake_fd();
+    int rc = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, in_queue_.wake_fd(), &ev);
+    if (rc != 0)
+        throw std::system_error(std::error_code(errno, std::system_category()));
+}
+
+epoll_io_loop::~epoll_io_loop() { close(epoll_fd_); }
+
+auto epoll_io_loop::run_one() -> bool {
+    PROFILING_SCOPE();
+
+    // Now try to execute some outstanding ops
+    while (true) {
+        // If there are owned input ops, handle them before checking for new ops
+        if (handle_one_owned_in_op())
+            return true;
+
+        // Check if we have new ops, to move them on the processing for this thread
+        check_in_ops();
+        PROFILING_PLOT_INT("I/O ops", int(num_pending_));
+
+        // Check for newly added owned input ops
+        if (handle_one_owned_in_op())
+            return true;
+
+        // Check if we have any completions from the last wait
+        if (check_for_one_io_completion())
+            return true;
+        // Check for expired timers
+        if (timers_.expire(timer_wheel::clock::now()) > 0)
+            return true;
+        // Nothing else to do; wait for the kernel to report new events
+        if (!do_poll())
+            return false;
+    }
+}
+
+auto epoll_io_loop::run() -> std::size_t {
+    PROFILING_SCOPE();
+    std::size_t num_completed{0};
+    // Run as many operations as possible, until the stop signal occurs
+    while (!should_stop_.load(std::memory_order_acquire)) {
+        if (run_one())
+            num_completed++;
+    }
+
+    PROFILING_SCOPE_N("exiting I/O loop");
+    // If we have a stop signal, and still have outstanding operations, cancel them
+    num_completed += timers_.cancel_all();
+    for (fd_entry& entry : fd_entries_) {
+        for (oper_body_base* op_body : entry.readers_) {
+            op_body->set_stopped();
+            num_completed++;
+        }
+        for (oper_body_base* op_body : entry.writers_) {
+            op_body->set_stopped();
+            num_completed++;
+        }
+        entry.readers_.clear();
+        entry.writers_.clear();
+    }
+    num_pending_ = 0;
+
+    return num_completed;
+}
+
+auto epoll_io_loop::stop() noexcept -> void {
+    PROFILING_SCOPE();
+    should_stop_.store(true, std::memory_order_release);
+}
+
+auto epoll_io_loop::add_io_oper(native_file_desc_t fd, oper_type t, oper_body_base* body) -> void {
+    PROFILING_SCOPE();
+    body->submit_fd_ = fd;
+    body->submit_type_ = t;
+    in_queue_.push(body);
+    PROFILING_SET_TEXT_FMT(32, "fd=%d", fd);
+}
+
+auto epoll_io_loop::add_non_io_oper(oper_body_base* body) -> void {
+    PROFILING_SCOPE();
+    body->submit_fd_ = -1;
+    body->submit_type_ = oper_type::read;
+    in_queue_.push(body);
+}
+
+auto epoll_io_loop::add_timer_oper(timer_oper_base* body) -> void {
+    PROFILING_SCOPE();
+    body->submit_fd_ = -1;
+    body->submit_type_ = oper_type::timer;
+    in_queue_.push(body);
+}
+
+auto epoll_io_loop::cancel_oper(cancel_request* req) -> void {
+    PROFILING_SCOPE();
+    req->submit_fd_ = -1;
+    req->submit_type_ = oper_type::cancel;
+    in_queue_.push(req);
+}
+
+auto epoll_io_loop::add_local_timer(timer_oper_base* oper) noexcept -> void {
+    timers_.add(oper);
+}
+
+auto epoll_io_loop::remove_local_timer(timer_oper_base* oper) noexcept -> void {
+    // Timers that have expired or were cancelled are no longer linked into the wheel
+    if (oper->timer_pprev_)
+        timers_.remove(oper);
+}
+
+auto epoll_io_loop::check_in_ops() -> void {
+    PROFILING_SCOPE();
+    // Take all the submitted items at once
+    owned_in_opers_ = in_queue_.pop_all();
+}
+
+auto epoll_io_loop::handle_one_owned_in_op() -> bool {
+    PROFILING_SCOPE();
+    if (owned_in_opers_) {
+        oper_body_base* op = owned_in_opers_;
+        owned_in_opers_ = op->submit_next_;
+        if (op->submit_type_ == oper_type::cancel) {
+            process_cancel(static_cast<cancel_request*>(op)->target_);
+            return true;
+        }
+        op->seen_by_loop_ = true;
+        if (op->cancel_processed_) {
+            // The operation was cancelled before we got to it
+            op->set_stopped();
+        } else if (op->submit_type_ == oper_type::timer) {
+            // Wait for the deadline of the timer
+            timers_.add(static_cast<timer_oper_base*>(op));
+        } else if (op->submit_fd_ < 0) {
+            // Simply run the non-IO operations; don't care about the result
+            op->try_run();
+        } else {
+            // If the I/O operation did not complete instantly, wait for the fd to be ready
+            native_file_desc_t fd = op->submit_fd_;
+            oper_type t = op->submit_type_;
+            if (!op->try_run())
+                park_io_oper(fd, t, op);
+        }
+        return true;
+    }
+    return false;
+}
+
+auto epoll_io_loop::check_for_one_io_completion() -> bool {
+    PROFILING_SCOPE();
+
+    while (next_ready_ < num_ready_) {
+        const epoll_event& ev = ready_events_[next_ready_];
+        native_file_desc_t fd = ev.data.fd;
+
+        if (fd == in_queue_.wake_fd()) {
+            in_queue_.consume_wake_signal();
+            next_ready_++;
+            continue;
+        }
+
+        // We stay on the same event until no more operations can complete for it
+        if (static_cast<std::size_t>(fd) < fd_entries_.size()) {
+            fd_entry& entry = fd_entries_[fd];
+            bool can_read = (ev.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+            bool can_write = (ev.events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0;
+            if ((can_read && try_complete_front(entry.readers_)) ||
+                    (can_write && try_complete_front(entry.writers_))) {
+                num_pending_--;
+                update_registration(fd, entry);
+                return true;
+            }
+        }
+        next_ready_++;
+    }
+    return false;
+}
+
+auto epoll_io_loop::do_poll() -> bool {
+    PROFILING_SCOPE();
+
+    next_ready_ = 0;
+    num_ready_ = 0;
+    // In busy-polling mode, look for work without blocking for a while, before parking
+    int rc = 0;
+    bool found = spin_.spin(
+            [this, &rc] {
+                if (!in_queue_.empty() || timers_.next_timeout_ms(timer_wheel::clock::now()) == 0)
+                    return true;
+                rc = epoll_wait(epoll_fd_, ready_events_.data(), max_events, 0);
+                return rc != 0;
+            },
+            stats_);
+
+    if (!found) {
+        // Wait until the next timer expires; don't block if new operations were submitted
+        int timeout = 0;
+        if (in_queue_.prepare_to_sleep()) {
+            timeout = timers_.next_timeout_ms(timer_wheel::clock::now());
+            if (timeout != 0)
+                stats_.parks_++;
+        }
+        rc = epoll_wait(epoll_fd_, ready_events_.data(), max_events, timeout);
+        in_queue_.done_sleeping();
+        spin_.woke_up();
+    }
+    PROFILING_SET_TEXT_FMT(32, "pending=%d => %d", int(num_pending_), rc);
+    if (rc < 0)
+        return false;
+    num_ready_ = rc;
+    return true;
+}
+
+auto epoll_io_loop::process_cancel(oper_body_base* op) noexcept -> void {
+    PROFILING_SCOPE();
+    // If the operation is still in our queue, cancel it when we get to it
+    if (!op->seen_by_loop_) {
+        op->cancel_processed_ = true;
+        return;
+    }
+    // An operation with a pending cancellation never completes on its own, so it must be either
+    // in the timer wheel (or expired from it), or parked on its file descriptor
+    if (op->submit_type_ == oper_type::timer) {
+        remove_local_timer(static_cast<timer_oper_base*>(op));
+    } else if (static_cast<std::size_t>(op->submit_fd_) < fd_entries_.size()) {
+        // There are very few operations parked on a file descriptor; usually just one
+        native_file_desc_t fd = op->submit_fd_;
+        fd_entry& entry = fd_entries_[fd];
+        auto& opers = op->submit_type_ == oper_type::write ? entry.writers_ : entry.readers_;
+        auto it = std::find(opers.begin(), opers.end(), op);
+        if (it != opers.end()) {
+            opers.erase(it);
+            num_pending_--;
+            update_registration(fd, entry);
+        }
+    }
+    op->set_stopped();
+}
+
+auto epoll_io_loop::park_io_oper(native_file_desc_t fd, oper_type t, oper_body_base* body)
+        -> void {
+    if (static_cast<std::size_t>(fd) >= fd_entries_.size())
+        fd_entries_.resize(fd + 1);
+    fd_entry& entry = fd_entries_[fd];
+    auto& opers = t == oper_type::write ? entry.writers_ : entry.readers_;
+    opers.push_back(body);
+    num_pending_++;
+
+    if (!update_registration(fd, entry)) {
+        // We cannot wait on this file descriptor; cancel the operation, unless a cancellation
+        // request is already on its way
+        opers.pop_back();
+        num_pending_--;
+        update_registration(fd, entry);
+        if (body->claim_completion())
+            body->set_stopped();
+    }
+}
+
+auto epoll_io_loop::update_registration(native_file_desc_t fd, fd_entry& entry) -> bool {
+    std::uint32_t wanted = 0;
+    if (!entry.readers_.empty())
+        wanted |= EPOLLIN | EPOLLRDHUP;
+    if (!entry.writers_.empty())
+        wanted |= EPOLLOUT;
+
+    if (edge_triggered_) {
+        // We never remove the fd from epoll; the kernel does that when the fd is closed. As the
+        // fd number can be reused, we always re-add the fd when it gets its first pending
+        // operation; EEXIST tells us that it's still registered from a previous operation.
+        if (wanted == 0) {
+            entry.registered_events_ = 0;
+            return true;
+        }
+        if (entry.registered_events_ != 0)
+            return true;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = fd;
+        int rc = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+        if (rc != 0 && errno != EEXIST)
+            return false;
+        entry.registered_events_ = ev.events;
+        return true;
+    }
+
+    // Level-triggered: register exactly the events for the pending operations
+    if (wanted == entry.registered_events_)
+        return true;
+    if (wanted == 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        entry.registered_events_ = 0;
+        return true;
+    }
+    epoll_event ev{};
+    ev.events = wanted;
+    ev.data.fd = fd;
+    int op = entry.registered_events_ == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    int rc = epoll_ctl(epoll_fd_, op, fd, &ev);
+    if (rc != 0 && op == EPOLL_CTL_ADD && errno == EEXIST)
+        rc = epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+    else if (rc != 0 && op == EPOLL_CTL_MOD && errno == ENOENT)
+        rc = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+    if (rc != 0)
+        return false;
+    entry.registered_events_ = wanted;
+    return true;
+}
+
+} // namespace io::detail
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "native_file_desc_t.hpp"
+#include "oper_type.hpp"
+#include "oper_body_base.hpp"
+#include "submission_queue.hpp"
+#include "timer_wheel.hpp"
+#include "adaptive_spin.hpp"
+#include "io/io_options.hpp"
+
+#include <vector>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include <sys/epoll.h>
+
+namespace io::detail {
+
+//! Class that implements an I/O loop, using `epoll()` for I/O.
+//!
+//! Same contract as `poll_io_loop`, but the cost of waiting for I/O doesn't depend on the number
+//! of pending operations: file descriptors are registered once with the kernel, and each wakeup
+//! reports only the descriptors that are ready.
+//!
+//! Can work in level-triggered mode (default) or edge-triggered mode (see `io_options`).
+class epoll_io_loop {
+public:
+    explicit epoll_io_loop(const io_options& opts = {});
+    ~epoll_io_loop();
+
+    epoll_io_loop(const epoll_io_loop&) = delete;
+    auto operator=(const epoll_io_loop&) -> epoll_io_loop& = delete;
+
+    //! Run the loop once to execute maximum one operation.
+    //! If there are no operations to execute (or, no I/O completed) this will return false.
+    auto run_one() -> bool;
+
+    //! Run the loop to process operations
+    //! Stops after `stop()` is called, and all operations in our queues are drained.
+    auto run() -> std::size_t;
+
+    //! Stops processing any more operations
+    auto stop() noexcept -> void;
+
+    //! Check if we were told to stop
+    auto is_stopped() const noexcept -> bool {
+        return should_stop_.load(std::memory_order_acquire);
+    }
+
+    //! Add an I/O operation to be executed into our loop
+    //! The body will be called multiple times, until the operation succeeds (body function returns
+    //! true)
+    auto add_io_oper(native_file_desc_t fd, oper_type t, oper_body_base* oper) -> void;
+
+    //! Add a non-I/O operation in our loop
+    //! The body will only be executed once.
+    auto add_non_io_oper(oper_body_base* oper) -> void;
+
+    //! Add an operation to be executed once its deadline is reached
+    auto add_timer_oper(timer_oper_base* oper) -> void;
+
+    //! Statistics about how the loop waits for work
+    auto stats() const noexcept -> const io_loop_stats& { return stats_; }
+
+    //! Submit a request to cancel an operation previously added to our loop.
+    //! Can be called from any thread; the operation completes with `set_stopped()`.
+    auto cancel_oper(cancel_request* req) -> void;
+
+    //! Add a timer directly to our timer wheel, bypassing the submission queue.
+    //! Must be called from the thread running the loop.
+    auto add_local_timer(timer_oper_base* oper) noexcept -> void;
+    //! Remove a timer added with `add_local_timer()`, if it didn't expire yet.
+    //! Must be called from the thread running the loop.
+    auto remove_local_timer(timer_oper_base* oper) noexcept -> void;
+
+private:
+    //! The pending operations for a file descriptor, and what we registered in epoll for it
+    struct fd_entry {
+        std::vector<oper_body_base*> readers_;
+        std::vector<oper_body_base*> writers_;
+        //! The events registered with epoll for this file descriptor; 0 if not registered
+        std::uint32_t registered_events_{0};
+    };
+
+    //! Maximum number of events we get from one call to `epoll_wait()`
+    static constexpr int max_events = 128;
+
+    const bool edge_triggered_;
+    std::atomic<bool> should_stop_{false};
+
+    // IO and non-IO operations created by various threads, not yet consumed by our loop
+    submission_queue in_queue_;
+
+    // input operations for which we have ownership
+    oper_body_base* owned_in_opers_{nullptr};
+
+    // The timers waiting for their deadline
+    timer_wheel timers_;
+
+    // Decides how long we spin before blocking, in busy-polling mode
+    adaptive_spin spin_;
+    io_loop_stats stats_;
+
+    native_file_desc_t epoll_fd_{-1};
+
+    // The pending operations, indexed by file descriptor
+    std::vector<fd_entry> fd_entries_;
+    std::size_t num_pending_{0};
+
+    // The events returned by the last `epoll_wait()` call, and how far we got in processing them
+    std::array<epoll_event, max_events> ready_events_;
+    int num_ready_{0};
+    int next_ready_{0};
+
+    auto check_in_ops() -> void;
+    auto handle_one_owned_in_op() -> bool;
+    auto check_for_one_io_completion() -> bool;
+    auto do_poll() -> bool;
+    auto process_cancel(oper_body_base* op) noexcept -> void;
+
+    auto park_io_oper(native_file_desc_t fd, oper_type t, oper_body_base* body) -> void;
+    auto update_registration(native_file_desc_t fd, fd_entry& entry) -> bool;
+};
+} // namespace io::detail
@@ -0,0 +1,22 @@
+#pragma once
+
+#if IO_BACKEND_EPOLL
+#include "epoll_io_loop.hpp"
+#elif IO_BACKEND_URING
+#include "uring_io_loop.hpp"
+#else
+#include "poll_io_loop.hpp"
+#endif
+
+namespace io::detail {
+
+//! The I/O loop implementation used by `io_context`; selected at compile time.
+#if IO_BACKEND_EPOLL
+using io_loop = epoll_io_loop;
+#elif IO_BACKEND_URING
+using io_loop = uring_io_loop;
+#else
+using io_loop = poll_io_loop;
+#endif
+
+} // namespace io::detail
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+namespace io::detail {
+
+//! The kind of I/O operations that completion-based loops can submit directly to the kernel
+enum class native_io_kind {
+    none,
+    recv,
+    send,
+    //! `buf_` points to a `msghdr`; `len_` is unused
+    sendmsg,
+    accept,
+    //! Accepts a batch of connections, at most `len_`. Loops may keep a multishot accept request
+    //! armed on the listening socket between the operations, and hand the connections over with
+    //! `oper_body_base::complete_accepted()`; the others treat it as `accept`.
+    accept_multishot,
+};
+
+//! Description of an I/O operation, for loops that submit the operations to the kernel instead of
+//! waiting for readiness.
+struct native_io_desc {
+    native_io_kind kind_{native_io_kind::none};
+    void* buf_{nullptr};
+    std::size_t len_{0};
+};
+
+} // namespace io::detail
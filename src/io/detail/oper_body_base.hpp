@@ -1,5 +1,13 @@
 #pragma once
 
+#include "native_file_desc_t.hpp"
+#include "native_io_desc.hpp"
+#include "oper_type.hpp"
+#include "slot_handle.hpp"
+
+#include <atomic>
+#include <span>
+
 namespace io::detail {
 
 //! Base class to represent the actions of an operation to be passed to an I/O loop
@@ -10,6 +18,68 @@ struct oper_body_base {
     virtual auto try_run() noexcept -> bool = 0;
     //! Called to announce that the operation was cancelled.
     virtual auto set_stopped() noexcept -> void = 0;
+
+    //! Describes the I/O done by this operation, so that completion-based loops can submit it
+    //! directly to the kernel. Operations that return `native_io_kind::none` are only run through
+    //! `try_run()`.
+    virtual auto native_desc() noexcept -> native_io_desc { return {}; }
+    //! Called by completion-based loops with the result of the native operation (negative errno on
+    //! failure). Returns false if the operation needs to be retried.
+    virtual auto complete_native(int /*res*/) noexcept -> bool { return false; }
+    //! Called by completion-based loops for `native_io_kind::accept_multishot` operations, with the
+    //! connections accepted by the multishot request armed on the listening socket; the operation
+    //! takes ownership of them. Errors are reported with `complete_native()`.
+    //! Returns false if the operation needs to be retried.
+    virtual auto complete_accepted(std::span<const native_file_desc_t> /*conns*/) noexcept -> bool {
+        return false;
+    }
+
+    //! Request the cancellation of the operation; can be called from any thread.
+    //! Returns false if the operation already started to complete.
+    auto request_cancel() noexcept -> bool {
+        cancel_state expected = cancel_state::none;
+        return cancel_state_.compare_exchange_strong(expected, cancel_state::requested);
+    }
+    //! Check if the cancellation of the operation was requested
+    auto cancel_requested() const noexcept -> bool {
+        return cancel_state_.load(std::memory_order_acquire) == cancel_state::requested;
+    }
+    //! Called by the operation before it completes. Returns false if the cancellation was requested
+    //! in the meantime; the operation must then not complete, and must not perform more I/O. The
+    //! I/O loop will call `set_stopped()` when it processes the cancellation.
+    auto claim_completion() noexcept -> bool {
+        cancel_state expected = cancel_state::none;
+        return cancel_state_.compare_exchange_strong(expected, cancel_state::completing);
+    }
+
+    //! Link used to queue the operation when submitting it to an I/O loop, without allocating
+    oper_body_base* submit_next_{nullptr};
+    //! The file descriptor of the submitted I/O operation; -1 for non-I/O operations
+    native_file_desc_t submit_fd_{-1};
+    //! The type of the submitted I/O operation
+    oper_type submit_type_{oper_type::read};
+
+    // Used by the I/O loop, on its own thread, to find the operation when cancelling it
+
+    //! Set when the I/O loop takes the operation out of the submission queue
+    bool seen_by_loop_{false};
+    //! Set if the I/O loop processed a cancellation before taking the operation out of the queue
+    bool cancel_processed_{false};
+    //! Where the I/O loop keeps the operation while it's pending
+    slot_handle loop_slot_;
+
+private:
+    enum class cancel_state { none, requested, completing };
+    std::atomic<cancel_state> cancel_state_{cancel_state::none};
+};
+
+//! A request to cancel an operation, submitted to the I/O loop that owns the operation.
+//! The loop completes the target operation with `set_stopped()`.
+struct cancel_request : oper_body_base {
+    oper_body_base* target_{nullptr};
+
+    auto try_run() noexcept -> bool override { return true; }
+    auto set_stopped() noexcept -> void override {}
 };
 
-} // namespace io::detail
\ No newline at end of file
+} // namespace io::detail
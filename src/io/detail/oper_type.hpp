@@ -5,5 +5,9 @@ namespace io::detail {
 enum class oper_type {
     read,
     write,
+    //! Not an I/O operation; the operation completes at a given time point
+    timer,
+    //! Not an I/O operation; a request to cancel another operation
+    cancel,
 };
-} // namespace io::detail
\ No newline at end of file
+} // namespace io::detail
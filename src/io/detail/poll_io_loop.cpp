@@ -12,27 +12,20 @@ using namespace std::chrono_literals;
 
 namespace io::detail {
 
-poll_io_loop::poll_io_loop() {
+poll_io_loop::poll_io_loop(const io_options& opts)
+    : spin_(opts.max_spin_) {
     PROFILING_SCOPE();
 
-    static constexpr std::size_t expected_max_in_ops = 128;
     static constexpr std::size_t expected_max_pending_ops = 512;
-    in_opers_.reserve(expected_max_in_ops);
-    owned_in_opers_.reserve(expected_max_in_ops);
     poll_data_.reserve(expected_max_pending_ops);
-    poll_opers_.reserve(expected_max_pending_ops);
+    poll_slots_.reserve(expected_max_pending_ops);
+    slots_.reserve(expected_max_pending_ops);
+    free_slots_.reserve(expected_max_pending_ops);
+    ready_.reserve(expected_max_pending_ops);
 
-    next_op_to_process_ = owned_in_opers_.begin();
-
-    int rc = pipe(poll_wake_fd_);
-    if (rc != 0)
-        throw std::system_error(std::error_code(errno, std::system_category()));
-    fcntl(poll_wake_fd_[0], F_SETFL, O_NONBLOCK);
-    fcntl(poll_wake_fd_[1], F_SETFL, O_NONBLOCK);
-    PROFILING_SET_TEXT_FMT(32, "pipe created: %d <-> %d", poll_wake_fd_[0], poll_wake_fd_[1]);
-
-    poll_data_.push_back(pollfd{poll_wake_fd_[0], POLLIN, 0});
-    poll_opers_.push_back(nullptr);
+    // The first entry is used to wake up the loop when new operations are submitted
+    poll_data_.push_back(pollfd{in_queue_.wake_fd(), POLLIN, 0});
+    poll_slots_.push_back(slot_handle::invalid_index);
 }
 
 auto poll_io_loop::run_one() -> bool {
@@ -56,6 +49,9 @@ auto poll_io_loop::run_one() -> bool {
         // Check if we have any completions
         if (check_for_one_io_completion())
             return true;
+        // Check for expired timers
+        if (timers_.expire(timer_wheel::clock::now()) > 0)
+            return true;
         // when calling do_poll, all events in poll_data_ are checked
         if (!do_poll())
             return false;
@@ -67,15 +63,30 @@ auto poll_io_loop::run() -> std::size_t {
     std::size_t num_completed{0};
     // Run as many operations as possible, until the stop signal occurs
     while (!should_stop_.load(std::memory_order_acquire)) {
-        if (run_one())
-            num_completed++;
+        // Handle all the submitted operations, then all the completions from the last poll
+        std::size_t n{0};
+        while (handle_one_owned_in_op())
+            n++;
+        check_in_ops();
+        while (handle_one_owned_in_op())
+            n++;
+        PROFILING_PLOT_INT("I/O ops", int(poll_data_.size()) - 1);
+        while (check_for_one_io_completion())
+            n++;
+        n += timers_.expire(timer_wheel::clock::now());
+        num_completed += n;
+        // Wait for more work only if we didn't do anything in this iteration
+        if (n == 0)
+            do_poll();
     }
 
     PROFILING_SCOPE_N("exiting I/O loop");
     // If we have a stop signal, and still have outstanding operations, cancel them
-    for (oper_body_base* op_body : poll_opers_) {
-        if (op_body) {
-            op_body->set_stopped();
+    num_completed += timers_.cancel_all();
+    for (pending_slot& slot : slots_) {
+        if (slot.body_) {
+            slot.body_->set_stopped();
+            slot.body_ = nullptr;
             num_completed++;
         }
     }
@@ -90,48 +101,75 @@ auto poll_io_loop::stop() noexcept -> void {
 
 auto poll_io_loop::add_io_oper(native_file_desc_t fd, oper_type t, oper_body_base* body) -> void {
     PROFILING_SCOPE();
-    std::scoped_lock lock{in_bottleneck_};
-    short event = t == oper_type::write ? POLLOUT : POLLIN;
-    in_opers_.emplace_back(fd, event, body);
-    const char msg = 1;
-    write(poll_wake_fd_[1], &msg, 1);
+    body->submit_fd_ = fd;
+    body->submit_type_ = t;
+    in_queue_.push(body);
     PROFILING_SET_TEXT_FMT(32, "fd=%d", fd);
 }
 
 auto poll_io_loop::add_non_io_oper(oper_body_base* body) -> void {
     PROFILING_SCOPE();
-    std::scoped_lock lock{in_bottleneck_};
-    in_opers_.emplace_back(-1, 0, body);
-    const char msg = 1;
-    write(poll_wake_fd_[1], &msg, 1);
+    body->submit_fd_ = -1;
+    body->submit_type_ = oper_type::read;
+    in_queue_.push(body);
+}
+
+auto poll_io_loop::add_timer_oper(timer_oper_base* body) -> void {
+    PROFILING_SCOPE();
+    body->submit_fd_ = -1;
+    body->submit_type_ = oper_type::timer;
+    in_queue_.push(body);
+}
+
+auto poll_io_loop::cancel_oper(cancel_request* req) -> void {
+    PROFILING_SCOPE();
+    req->submit_fd_ = -1;
+    req->submit_type_ = oper_type::cancel;
+    in_queue_.push(req);
+}
+
+auto poll_io_loop::add_local_timer(timer_oper_base* oper) noexcept -> void {
+    timers_.add(oper);
+}
+
+auto poll_io_loop::remove_local_timer(timer_oper_base* oper) noexcept -> void {
+    // Timers that have expired or were cancelled are no longer linked into the wheel
+    if (oper->timer_pprev_)
+        timers_.remove(oper);
 }
 
 auto poll_io_loop::check_in_ops() -> void {
     PROFILING_SCOPE();
-    owned_in_opers_.clear();
-    {
-        // Quickly steal the items from the input vector, while under the lock
-        std::scoped_lock lock{in_bottleneck_};
-        owned_in_opers_.swap(in_opers_);
-    }
-    next_op_to_process_ = owned_in_opers_.begin();
+    // Take all the submitted items at once
+    owned_in_opers_ = in_queue_.pop_all();
 }
 
 auto poll_io_loop::handle_one_owned_in_op() -> bool {
     PROFILING_SCOPE();
-    if (next_op_to_process_ != owned_in_opers_.end()) {
-        const io_oper& op = *next_op_to_process_;
-        next_op_to_process_++;
-        if (op.fd_ < 0) {
+    if (owned_in_opers_) {
+        oper_body_base* op = owned_in_opers_;
+        owned_in_opers_ = op->submit_next_;
+        if (op->submit_type_ == oper_type::cancel) {
+            process_cancel(static_cast<cancel_request*>(op)->target_);
+            return true;
+        }
+        op->seen_by_loop_ = true;
+        if (op->cancel_processed_) {
+            // The operation was cancelled before we got to it
+            op->set_stopped();
+        } else if (op->submit_type_ == oper_type::timer) {
+            // Wait for the deadline of the timer
+            timers_.add(static_cast<timer_oper_base*>(op));
+        } else if (op->submit_fd_ < 0) {
             // Simply run the non-IO operations; don't care about the result
-            op.body_->try_run();
+            op->try_run();
         } else {
             // If the I/O operation did not complete instantly, add it to our lists used
             // when polling
-            if (!op.body_->try_run()) {
-                poll_data_.push_back(pollfd{op.fd_, op.events_, 0});
-                poll_opers_.push_back(op.body_);
-            }
+            native_file_desc_t fd = op->submit_fd_;
+            short events = op->submit_type_ == oper_type::write ? POLLOUT : POLLIN;
+            if (!op->try_run())
+                op->loop_slot_ = add_pending(fd, events, op);
         }
         return true;
     }
@@ -141,26 +179,21 @@ auto poll_io_loop::handle_one_owned_in_op() -> bool {
 auto poll_io_loop::check_for_one_io_completion() -> bool {
     PROFILING_SCOPE();
 
-    char msg{0};
-    while (read(poll_wake_fd_[0], &msg, 1) > 0)
-        ;
-
-    for (std::size_t i = check_completions_start_idx_; i < poll_data_.size(); i++) {
-        pollfd& p = poll_data_[i];
-        if ((p.events & p.revents) != 0) {
-            oper_body_base* body = poll_opers_[i];
-            if (body && body->try_run()) {
-                // If the operation is finally complete, remove it from the list
-                poll_data_.erase(poll_data_.begin() + i);
-                poll_opers_.erase(poll_opers_.begin() + i);
-                check_completions_start_idx_ = i;
-                return true;
-            }
+    while (next_ready_ < ready_.size()) {
+        slot_handle h = ready_[next_ready_++];
+        pending_slot& slot = slots_[h.index_];
+        // Skip operations that were removed since the poll
+        if (slot.generation_ != h.generation_ || !slot.body_)
+            continue;
+        if (slot.body_->try_run()) {
+            // If the operation is finally complete, remove it from our table
+            remove_pending(h.index_);
+            return true;
         }
     }
-    check_completions_start_idx_ = poll_data_.size();
     return false;
 }
+
 auto poll_io_loop::do_poll() -> bool {
     PROFILING_SCOPE();
 
@@ -168,10 +201,29 @@ auto poll_io_loop::do_poll() -> bool {
     for (pollfd& p : poll_data_)
         p.revents = 0;
 
+    // In busy-polling mode, look for work without blocking for a while, before parking
+    int rc = 0;
+    bool found = spin_.spin(
+            [this, &rc] {
+                if (!in_queue_.empty() || timers_.next_timeout_ms(timer_wheel::clock::now()) == 0)
+                    return true;
+                rc = poll(poll_data_.data(), poll_data_.size(), 0);
+                return rc != 0;
+            },
+            stats_);
+
+    // Wait until the next timer expires; don't block if new operations were submitted
+    int timeout = 0;
+    if (!found && in_queue_.prepare_to_sleep()) {
+        timeout = timers_.next_timeout_ms(timer_wheel::clock::now());
+        if (timeout != 0)
+            stats_.parks_++;
+    }
+
     while (true) {
-        // Perform the poll on all the poll data that we have
-        int rc = poll(poll_data_.data(), poll_data_.size(), -1);
-        // int rc = poll(poll_data_.data(), poll_data_.size(), 10);
+        // Perform the poll on all the poll data that we have, unless spinning already did it
+        if (!found || rc <= 0)
+            rc = poll(poll_data_.data(), poll_data_.size(), timeout);
 
 #if PROFILING_ENABLED
         char buf[256];
@@ -195,13 +247,85 @@ auto poll_io_loop::do_poll() -> bool {
 
         if (rc >= 0) {
             // Call to `poll()` succeeded
-            check_completions_start_idx_ = 0; // skip notification file
+            in_queue_.done_sleeping();
+            if (!found)
+                spin_.woke_up();
+            // Were we woken up because of new submitted operations?
+            if ((poll_data_[0].revents & POLLIN) != 0)
+                in_queue_.consume_wake_signal();
+            // Collect all the ready operations in one pass
+            ready_.clear();
+            next_ready_ = 0;
+            for (std::size_t i = 1; i < poll_data_.size() && ready_.size() < std::size_t(rc); i++) {
+                if (poll_data_[i].revents != 0) {
+                    std::uint32_t slot = poll_slots_[i];
+                    ready_.push_back(slot_handle{slot, slots_[slot].generation_});
+                }
+            }
             return true;
         }
         // Failure?
-        if (errno != EINVAL)
+        if (errno != EINVAL) {
+            in_queue_.done_sleeping();
             return false;
+        }
+    }
+}
+
+auto poll_io_loop::process_cancel(oper_body_base* op) noexcept -> void {
+    PROFILING_SCOPE();
+    // If the operation is still in our queue, cancel it when we get to it
+    if (!op->seen_by_loop_) {
+        op->cancel_processed_ = true;
+        return;
+    }
+    // An operation with a pending cancellation never completes on its own, so it must be either
+    // in the timer wheel (or expired from it), or in our table of pending operations
+    if (op->submit_type_ == oper_type::timer) {
+        remove_local_timer(static_cast<timer_oper_base*>(op));
+    } else {
+        slot_handle h = op->loop_slot_;
+        if (h.index_ < slots_.size() && slots_[h.index_].generation_ == h.generation_ &&
+                slots_[h.index_].body_ == op)
+            remove_pending(h.index_);
+    }
+    op->set_stopped();
+}
+
+auto poll_io_loop::add_pending(native_file_desc_t fd, short events, oper_body_base* body)
+        -> slot_handle {
+    std::uint32_t slot;
+    if (free_slots_.empty()) {
+        slot = static_cast<std::uint32_t>(slots_.size());
+        slots_.emplace_back();
+    } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
     }
+    pending_slot& s = slots_[slot];
+    s.body_ = body;
+    s.poll_idx_ = static_cast<std::uint32_t>(poll_data_.size());
+    poll_data_.push_back(pollfd{fd, events, 0});
+    poll_slots_.push_back(slot);
+    return slot_handle{slot, s.generation_};
+}
+
+auto poll_io_loop::remove_pending(std::uint32_t slot) -> void {
+    pending_slot& s = slots_[slot];
+    // Move the last poll entry in the place of the removed one
+    std::uint32_t idx = s.poll_idx_;
+    std::uint32_t last_idx = static_cast<std::uint32_t>(poll_data_.size() - 1);
+    if (idx != last_idx) {
+        poll_data_[idx] = poll_data_[last_idx];
+        poll_slots_[idx] = poll_slots_[last_idx];
+        slots_[poll_slots_[idx]].poll_idx_ = idx;
+    }
+    poll_data_.pop_back();
+    poll_slots_.pop_back();
+
+    s.body_ = nullptr;
+    s.generation_++;
+    free_slots_.push_back(slot);
 }
 
-} // namespace io::detail
\ No newline at end of file
+} // namespace io::detail
@@ -3,10 +3,13 @@
 #include "native_file_desc_t.hpp"
 #include "oper_type.hpp"
 #include "oper_body_base.hpp"
+#include "submission_queue.hpp"
+#include "timer_wheel.hpp"
+#include "adaptive_spin.hpp"
+#include "slot_handle.hpp"
+#include "io/io_options.hpp"
 
 #include <vector>
-#include <mutex>
-#include <condition_variable>
 #include <atomic>
 
 #include <sys/socket.h>
@@ -20,9 +23,13 @@ namespace io::detail {
 //! One can add I/O and non-I/O events into the loop, and let the loop execute them.
 //! For the I/O operations, the given actions are executed multiple times until the operation
 //! completes with success.
+//!
+//! Pending I/O operations are kept in a slot table, so that registering and removing an operation
+//! is O(1). After each `poll()` call, the ready operations are collected in a single pass, and are
+//! dispatched without scanning the pending operations again.
 class poll_io_loop {
 public:
-    poll_io_loop();
+    explicit poll_io_loop(const io_options& opts = {});
 
     //! Run the loop once to execute maximum one operation.
     //! If there are no operations to execute (or, no I/O completed) this will return false.
@@ -30,6 +37,7 @@ public:
 
     //! Run the loop to process operations
     //! Stops after `stop()` is called, and all operations in our queues are drained.
+    //! Dispatches all the ready completions in one pass.
     auto run() -> std::size_t;
 
     //! Stops processing any more operations
@@ -49,38 +57,68 @@ public:
     //! The body will only be executed once.
     auto add_non_io_oper(oper_body_base* oper) -> void;
 
-private:
-    //! An operation that can be executed though this loop
-    struct io_oper {
-        native_file_desc_t fd_;
-        short events_;
-        oper_body_base* body_;
-
-        io_oper(native_file_desc_t fd, short events, oper_body_base* body)
-            : fd_(fd)
-            , events_(events)
-            , body_(body) {}
-    };
+    //! Add an operation to be executed once its deadline is reached
+    auto add_timer_oper(timer_oper_base* oper) -> void;
+
+    //! Statistics about how the loop waits for work
+    auto stats() const noexcept -> const io_loop_stats& { return stats_; }
 
+    //! Submit a request to cancel an operation previously added to our loop.
+    //! Can be called from any thread; the operation completes with `set_stopped()`.
+    auto cancel_oper(cancel_request* req) -> void;
+
+    //! Add a timer directly to our timer wheel, bypassing the submission queue.
+    //! Must be called from the thread running the loop.
+    auto add_local_timer(timer_oper_base* oper) noexcept -> void;
+    //! Remove a timer added with `add_local_timer()`, if it didn't expire yet.
+    //! Must be called from the thread running the loop.
+    auto remove_local_timer(timer_oper_base* oper) noexcept -> void;
+
+private:
     std::atomic<bool> should_stop_{false};
 
     // IO and non-IO operations created by various threads, not yet consumed by our loop
-    std::vector<io_oper> in_opers_;
-    std::mutex in_bottleneck_;
+    submission_queue in_queue_;
 
     // input operations for which we have ownership
-    std::vector<io_oper> owned_in_opers_;
-    std::vector<io_oper>::const_iterator next_op_to_process_;
+    oper_body_base* owned_in_opers_{nullptr};
 
-    // data for which we call poll; the two vectors are kept in sync
+    // The timers waiting for their deadline
+    timer_wheel timers_;
+
+    // Decides how long we spin before blocking, in busy-polling mode
+    adaptive_spin spin_;
+    io_loop_stats stats_;
+
+    //! A slot in the table of pending I/O operations
+    struct pending_slot {
+        oper_body_base* body_{nullptr};
+        //! The index of the operation in `poll_data_`
+        std::uint32_t poll_idx_{0};
+        std::uint32_t generation_{0};
+    };
+
+    // data for which we call poll; `poll_slots_` contains the slot index for each element in
+    // `poll_data_`. The first element is used for waking up the loop, and doesn't have a slot.
     std::vector<pollfd> poll_data_;
-    std::vector<oper_body_base*> poll_opers_;
-    native_file_desc_t poll_wake_fd_[2];
-    std::size_t check_completions_start_idx_{0};
+    std::vector<std::uint32_t> poll_slots_;
+
+    // The table of pending I/O operations
+    std::vector<pending_slot> slots_;
+    std::vector<std::uint32_t> free_slots_;
+
+    // The operations reported ready by the last `poll()` call, and how far we got in processing
+    // them; stale handles are skipped.
+    std::vector<slot_handle> ready_;
+    std::size_t next_ready_{0};
 
     auto check_in_ops() -> void;
     auto handle_one_owned_in_op() -> bool;
     auto check_for_one_io_completion() -> bool;
     auto do_poll() -> bool;
+    auto process_cancel(oper_body_base* op) noexcept -> void;
+
+    auto add_pending(native_file_desc_t fd, short events, oper_body_base* body) -> slot_handle;
+    auto remove_pending(std::uint32_t slot) -> void;
 };
 } // namespace io::detail
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+namespace io::detail {
+
+//! Handle to an entry in a slot table of an I/O loop.
+//! Each slot has a generation, incremented when the entry is removed; this makes old handles
+//! stale, even if the slot gets reused by another entry.
+struct slot_handle {
+    static constexpr std::uint32_t invalid_index = ~std::uint32_t(0);
+
+    std::uint32_t index_{invalid_index};
+    std::uint32_t generation_{0};
+};
+
+} // namespace io::detail
@@ -0,0 +1,61 @@
+#include "submission_queue.hpp"
+#include <profiling.hpp>
+
+#include <system_error>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace io::detail {
+
+submission_queue::submission_queue()
+    : wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (wake_fd_ < 0)
+        throw std::system_error(std::error_code(errno, std::system_category()));
+}
+
+submission_queue::~submission_queue() { close(wake_fd_); }
+
+auto submission_queue::push(oper_body_base* op) noexcept -> void {
+    PROFILING_SCOPE();
+    oper_body_base* old_head = head_.load(std::memory_order_relaxed);
+    do {
+        op->submit_next_ = old_head;
+    } while (!head_.compare_exchange_weak(old_head, op, std::memory_order_seq_cst));
+
+    // Only signal the loop if it's blocked; the first producer to see it sleeping does the signal
+    if (sleeping_.load(std::memory_order_seq_cst) &&
+            sleeping_.exchange(false, std::memory_order_seq_cst)) {
+        PROFILING_SCOPE_N("wake I/O loop");
+        eventfd_write(wake_fd_, 1);
+    }
+}
+
+auto submission_queue::pop_all() noexcept -> oper_body_base* {
+    oper_body_base* op = head_.exchange(nullptr, std::memory_order_acquire);
+    // Reverse the list, so that operations are handled in the order they were submitted
+    oper_body_base* res = nullptr;
+    while (op) {
+        oper_body_base* next = op->submit_next_;
+        op->submit_next_ = res;
+        res = op;
+        op = next;
+    }
+    return res;
+}
+
+auto submission_queue::prepare_to_sleep() noexcept -> bool {
+    sleeping_.store(true, std::memory_order_seq_cst);
+    // A producer that pushed before we set the flag may not have seen it; check the queue again
+    if (head_.load(std::memory_order_seq_cst) != nullptr) {
+        sleeping_.store(false, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+auto submission_queue::consume_wake_signal() noexcept -> void {
+    eventfd_t val;
+    eventfd_read(wake_fd_, &val);
+}
+
+} // namespace io::detail
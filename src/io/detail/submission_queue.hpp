@@ -0,0 +1,53 @@
+#pragma once
+
+#include "native_file_desc_t.hpp"
+#include "oper_body_base.hpp"
+
+#include <atomic>
+
+namespace io::detail {
+
+//! Queue of operations submitted to an I/O loop from arbitrary threads.
+//!
+//! Producers push operations into an intrusive lock-free list; the loop thread takes all of them
+//! at once. The loop announces when it's about to block waiting for I/O, and only then producers
+//! signal the eventfd that the loop watches. A burst of submissions costs at most one wakeup,
+//! and no syscall at all if the loop is busy.
+class submission_queue {
+public:
+    submission_queue();
+    ~submission_queue();
+
+    submission_queue(const submission_queue&) = delete;
+    auto operator=(const submission_queue&) -> submission_queue& = delete;
+
+    //! Push an operation into the queue, waking up the loop if it's blocked.
+    //! Can be called from any thread.
+    auto push(oper_body_base* op) noexcept -> void;
+
+    //! Take all the operations from the queue. Returns a list linked by `submit_next_`, in the
+    //! order in which the operations were pushed.
+    auto pop_all() noexcept -> oper_body_base*;
+    //! Check if there are operations in the queue; meant for polling, without blocking
+    auto empty() const noexcept -> bool { return head_.load(std::memory_order_acquire) == nullptr; }
+
+    //! Called by the loop before blocking. Returns false if there are operations in the queue,
+    //! in which case the loop must not block.
+    auto prepare_to_sleep() noexcept -> bool;
+    //! Called by the loop after it finished blocking.
+    auto done_sleeping() noexcept -> void { sleeping_.store(false, std::memory_order_relaxed); }
+
+    //! The file descriptor that becomes readable when the loop needs to wake up
+    auto wake_fd() const noexcept -> native_file_desc_t { return wake_fd_; }
+    //! Consume the wake signal, after the wake fd was reported readable.
+    auto consume_wake_signal() noexcept -> void;
+
+private:
+    //! The last pushed operation; the list goes from the newest to the oldest operation
+    std::atomic<oper_body_base*> head_{nullptr};
+    //! Set while the loop is blocked (or about to block) waiting for I/O
+    std::atomic<bool> sleeping_{false};
+    native_file_desc_t wake_fd_{-1};
+};
+
+} // namespace io::detail
@@ -0,0 +1,158 @@
+#include "timer_wheel.hpp"
+#include <profiling.hpp>
+
+#include <algorithm>
+#include <limits>
+
+using namespace std::chrono_literals;
+
+namespace io::detail {
+
+timer_wheel::timer_wheel()
+    : origin_(clock::now()) {}
+
+auto timer_wheel::add(timer_oper_base* t) noexcept -> void {
+    // If the wheel was empty for a while, skip the ticks in which nothing happened
+    if (count_ == 0)
+        current_tick_ = std::max(current_tick_, to_tick(clock::now()));
+
+    // Round up the deadline, so that we never execute a timer too early
+    auto since_origin = t->deadline_ - origin_;
+    if (since_origin <= clock::duration::zero())
+        t->timer_tick_ = 0;
+    else
+        t->timer_tick_ = static_cast<std::uint64_t>((since_origin + 1ms - 1ns) / 1ms);
+    insert(t);
+    count_++;
+}
+
+auto timer_wheel::remove(timer_oper_base* t) noexcept -> void {
+    if (t->timer_next_)
+        t->timer_next_->timer_pprev_ = t->timer_pprev_;
+    *t->timer_pprev_ = t->timer_next_;
+    t->timer_next_ = nullptr;
+    t->timer_pprev_ = nullptr;
+    count_--;
+}
+
+auto timer_wheel::next_timeout_ms(clock::time_point now) const noexcept -> int {
+    if (count_ == 0)
+        return -1;
+
+    // We need to wake up at the next level boundary, to move timers to the lower levels
+    std::uint64_t next_tick = (current_tick_ + slot_mask) & ~slot_mask;
+    // Check if we have something in the first level, before the boundary
+    for (std::uint64_t tick = current_tick_; tick < next_tick; tick++) {
+        if (slots_[0][tick & slot_mask]) {
+            next_tick = tick;
+            break;
+        }
+    }
+
+    auto wait = origin_ + next_tick * 1ms - now;
+    if (wait <= clock::duration::zero())
+        return 0;
+    auto wait_ms = (wait + 1ms - 1ns) / 1ms;
+    return static_cast<int>(std::min<decltype(wait_ms)>(wait_ms, std::numeric_limits<int>::max()));
+}
+
+auto timer_wheel::expire(clock::time_point now) noexcept -> std::size_t {
+    std::uint64_t target_tick = to_tick(now);
+    if (count_ == 0) {
+        current_tick_ = std::max(current_tick_, target_tick + 1);
+        return 0;
+    }
+    if (current_tick_ > target_tick)
+        return 0;
+
+    PROFILING_SCOPE();
+    // Collect all the expired timers first; executing them may add new timers
+    timer_oper_base* expired = nullptr;
+    while (current_tick_ <= target_tick && count_ > 0) {
+        // When reaching the start of a slot of a higher level, move its timers to lower levels;
+        // start with the highest level, so that timers can go down multiple levels
+        for (int level = num_levels - 1; level > 0; level--) {
+            std::uint64_t level_mask = (std::uint64_t(1) << (bits_per_level * level)) - 1;
+            if ((current_tick_ & level_mask) == 0)
+                cascade(level);
+        }
+
+        slot_list& slot = slots_[0][current_tick_ & slot_mask];
+        while (slot) {
+            timer_oper_base* t = slot;
+            remove(t);
+            t->timer_next_ = expired;
+            expired = t;
+        }
+        current_tick_++;
+    }
+    if (count_ == 0)
+        current_tick_ = std::max(current_tick_, target_tick + 1);
+
+    std::size_t num_expired{0};
+    while (expired) {
+        timer_oper_base* t = expired;
+        expired = t->timer_next_;
+        t->timer_next_ = nullptr;
+        t->try_run();
+        num_expired++;
+    }
+    PROFILING_SET_TEXT_FMT(32, "expired=%d", int(num_expired));
+    return num_expired;
+}
+
+auto timer_wheel::cancel_all() noexcept -> std::size_t {
+    std::size_t num_cancelled{0};
+    for (auto& level : slots_) {
+        for (slot_list& slot : level) {
+            while (slot) {
+                timer_oper_base* t = slot;
+                remove(t);
+                t->set_stopped();
+                num_cancelled++;
+            }
+        }
+    }
+    return num_cancelled;
+}
+
+auto timer_wheel::to_tick(clock::time_point tp) const noexcept -> std::uint64_t {
+    auto since_origin = tp - origin_;
+    if (since_origin <= clock::duration::zero())
+        return 0;
+    return static_cast<std::uint64_t>(since_origin / 1ms);
+}
+
+auto timer_wheel::insert(timer_oper_base* t) noexcept -> void {
+    std::uint64_t tick = std::max(t->timer_tick_, current_tick_);
+    std::uint64_t delta = tick - current_tick_;
+
+    // Find the level that covers the timer's distance from now
+    int level = 0;
+    while (level < num_levels - 1 && delta >= (std::uint64_t(1) << (bits_per_level * (level + 1))))
+        level++;
+    // Timers too far away go on the last slots of the top level; they will be re-inserted
+    std::uint64_t max_delta = (std::uint64_t(1) << (bits_per_level * num_levels)) - 1;
+    if (delta > max_delta)
+        tick = current_tick_ + max_delta;
+
+    slot_list& slot = slots_[level][(tick >> (bits_per_level * level)) & slot_mask];
+    t->timer_next_ = slot;
+    t->timer_pprev_ = &slot;
+    if (slot)
+        slot->timer_pprev_ = &t->timer_next_;
+    slot = t;
+}
+
+auto timer_wheel::cascade(int level) noexcept -> void {
+    slot_list& slot = slots_[level][(current_tick_ >> (bits_per_level * level)) & slot_mask];
+    timer_oper_base* t = slot;
+    slot = nullptr;
+    while (t) {
+        timer_oper_base* next = t->timer_next_;
+        insert(t);
+        t = next;
+    }
+}
+
+} // namespace io::detail
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "oper_body_base.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace io::detail {
+
+//! Base class for operations that need to be executed at a given time point
+struct timer_oper_base : oper_body_base {
+    using clock = std::chrono::steady_clock;
+
+    //! The time point at which the operation needs to be executed
+    clock::time_point deadline_;
+
+    // Intrusive links used by the timer wheel
+    timer_oper_base* timer_next_{nullptr};
+    timer_oper_base** timer_pprev_{nullptr};
+    std::uint64_t timer_tick_{0};
+};
+
+//! A hierarchical timing wheel, with a resolution of one millisecond.
+//!
+//! Adding and removing timers is O(1). Each level has 64 slots, and each slot of a level covers
+//! the entire span of the previous level; timers from a slot are moved to the lower levels when
+//! time reaches them. Timers that are too far in the future are kept in the last slots of the
+//! top level, and are re-inserted when their slot is reached.
+//!
+//! Not thread-safe; this is used by the I/O loops, on their own thread.
+class timer_wheel {
+public:
+    using clock = timer_oper_base::clock;
+
+    timer_wheel();
+
+    timer_wheel(const timer_wheel&) = delete;
+    auto operator=(const timer_wheel&) -> timer_wheel& = delete;
+
+    //! Add a timer into the wheel
+    auto add(timer_oper_base* t) noexcept -> void;
+    //! Remove a timer from the wheel; the timer must be in the wheel
+    auto remove(timer_oper_base* t) noexcept -> void;
+
+    //! Check if there are no timers in the wheel
+    auto empty() const noexcept -> bool { return count_ == 0; }
+    //! The number of timers in the wheel
+    auto size() const noexcept -> std::size_t { return count_; }
+
+    //! Returns the number of milliseconds that we can wait until we need to call `expire()`.
+    //! Returns -1 if there are no timers.
+    auto next_timeout_ms(clock::time_point now) const noexcept -> int;
+
+    //! Execute all the timers with the deadline before `now`.
+    //! Returns the number of executed timers.
+    auto expire(clock::time_point now) noexcept -> std::size_t;
+
+    //! Announces the cancellation of all the timers, and removes them from the wheel.
+    //! Returns the number of cancelled timers.
+    auto cancel_all() noexcept -> std::size_t;
+
+private:
+    static constexpr int bits_per_level = 6;
+    static constexpr int num_levels = 4;
+    static constexpr std::uint64_t slots_per_level = 1 << bits_per_level;
+    static constexpr std::uint64_t slot_mask = slots_per_level - 1;
+
+    using slot_list = timer_oper_base*;
+
+    //! The time corresponding to tick 0
+    clock::time_point origin_;
+    //! The next tick to be processed; all timers before this tick were executed
+    std::uint64_t current_tick_{0};
+    //! The number of timers in the wheel
+    std::size_t count_{0};
+
+    std::array<std::array<slot_list, slots_per_level>, num_levels> slots_{};
+
+    auto to_tick(clock::time_point tp) const noexcept -> std::uint64_t;
+    auto insert(timer_oper_base* t) noexcept -> void;
+    auto cascade(int level) noexcept -> void;
+};
+
+} // namespace io::detail
@@ -0,0 +1,807 @@
+#include "uring_io_loop.hpp"
+#include <profiling.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <system_error>
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace io::detail {
+
+namespace {
+//! The number of entries in the submission queue
+constexpr unsigned ring_entries = 256;
+
+//! What a completion refers to; stored in the lower bits of the user data of the requests
+enum user_data_tag : std::uint64_t {
+    tag_native = 0,
+    tag_poll = 1,
+    tag_wake = 2,
+    tag_cancel = 3,
+    //! A multishot accept request; the slot is the index in `listener_accepts_`
+    tag_accept = 4,
+};
+constexpr std::uint64_t tag_bits = 3;
+constexpr std::uint64_t tag_mask = (1 << tag_bits) - 1;
+
+auto make_user_data(std::uint32_t slot, user_data_tag tag) -> std::uint64_t {
+    return (std::uint64_t(slot) << tag_bits) | tag;
+}
+
+auto sys_io_uring_setup(unsigned entries, io_uring_params* params) -> int {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+auto sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+        const io_uring_getevents_arg* arg) -> int {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+            flags | IORING_ENTER_EXT_ARG, arg, sizeof(io_uring_getevents_arg)));
+}
+
+auto map_ring(int fd, std::size_t size, off_t offset) -> void* {
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+template <typename T>
+auto ring_ptr(void* base, std::uint32_t offset) -> T* {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+} // namespace
+
+uring_io_loop::uring_io_loop(const io_options& opts)
+    : spin_(opts.max_spin_) {
+    PROFILING_SCOPE();
+
+    if (!setup_ring()) {
+        teardown_ring();
+        PROFILING_SET_TEXT("io_uring not available; using poll()");
+        fallback_ = std::make_unique<poll_io_loop>(opts);
+        return;
+    }
+
+    static constexpr std::size_t expected_max_pending_ops = 512;
+    in_flight_.reserve(expected_max_pending_ops);
+    free_slots_.reserve(expected_max_pending_ops);
+
+    // Slot 0 is reserved for the wake request
+    in_flight_.emplace_back();
+    submit_wake_poll();
+}
+
+uring_io_loop::~uring_io_loop() { teardown_ring(); }
+
+auto uring_io_loop::setup_ring() -> bool {
+    io_uring_params params{};
+    int fd = sys_io_uring_setup(ring_entries, &params);
+    if (fd < 0)
+        return false;
+    ring_fd_ = fd;
+    // We rely on the kernel arming internal polls for sockets, on not dropping completions, and on
+    // being able to wait for completions with a timeout
+    constexpr std::uint32_t required_features =
+            IORING_FEAT_FAST_POLL | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required_features) != required_features)
+        return false;
+
+    sq_ring_.size_ = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+    cq_ring_.size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+        sq_ring_.size_ = std::max(sq_ring_.size_, cq_ring_.size_);
+
+    sq_ring_.ptr_ = map_ring(fd, sq_ring_.size_, IORING_OFF_SQ_RING);
+    if (!sq_ring_.ptr_)
+        return false;
+    if (single_mmap) {
+        // Same memory for both rings; make sure we don't unmap it twice
+        cq_ring_.ptr_ = sq_ring_.ptr_;
+        cq_ring_.size_ = 0;
+    } else {
+        cq_ring_.ptr_ = map_ring(fd, cq_ring_.size_, IORING_OFF_CQ_RING);
+        if (!cq_ring_.ptr_)
+            return false;
+    }
+    sqes_mem_.size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_mem_.ptr_ = map_ring(fd, sqes_mem_.size_, IORING_OFF_SQES);
+    if (!sqes_mem_.ptr_)
+        return false;
+
+    sq_head_ = ring_ptr<std::uint32_t>(sq_ring_.ptr_, params.sq_off.head);
+    sq_tail_ = ring_ptr<std::uint32_t>(sq_ring_.ptr_, params.sq_off.tail);
+    sq_mask_ = *ring_ptr<std::uint32_t>(sq_ring_.ptr_, params.sq_off.ring_mask);
+    sq_entries_ = *ring_ptr<std::uint32_t>(sq_ring_.ptr_, params.sq_off.ring_entries);
+    sq_array_ = ring_ptr<std::uint32_t>(sq_ring_.ptr_, params.sq_off.array);
+    sqes_ = static_cast<io_uring_sqe*>(sqes_mem_.ptr_);
+
+    cq_head_ = ring_ptr<std::uint32_t>(cq_ring_.ptr_, params.cq_off.head);
+    cq_tail_ = ring_ptr<std::uint32_t>(cq_ring_.ptr_, params.cq_off.tail);
+    cq_mask_ = *ring_ptr<std::uint32_t>(cq_ring_.ptr_, params.cq_off.ring_mask);
+    cqes_ = ring_ptr<io_uring_cqe>(cq_ring_.ptr_, params.cq_off.cqes);
+
+    PROFILING_SET_TEXT_FMT(64, "ring=%d, sq=%u, cq=%u", fd, params.sq_entries, params.cq_entries);
+    return true;
+}
+
+auto uring_io_loop::teardown_ring() noexcept -> void {
+    if (sqes_mem_.ptr_)
+        munmap(sqes_mem_.ptr_, sqes_mem_.size_);
+    if (cq_ring_.ptr_ && cq_ring_.size_ > 0)
+        munmap(cq_ring_.ptr_, cq_ring_.size_);
+    if (sq_ring_.ptr_)
+        munmap(sq_ring_.ptr_, sq_ring_.size_);
+    sqes_mem_ = {};
+    cq_ring_ = {};
+    sq_ring_ = {};
+    if (ring_fd_ >= 0)
+        close(ring_fd_);
+    ring_fd_ = -1;
+}
+
+auto uring_io_loop::run_one() -> bool {
+    PROFILING_SCOPE();
+    if (fallback_)
+        return fallback_->run_one();
+
+    // Now try to execute some outstanding ops
+    while (true) {
+        // If there are owned input ops, handle them before checking for new ops
+        if (handle_one_owned_in_op())
+            return true;
+
+        // Check if we have new ops, to move them on the processing for this thread
+        check_in_ops();
+        PROFILING_PLOT_INT("I/O ops", int(num_in_flight_));
+
+        // Check for newly added owned input ops
+        if (handle_one_owned_in_op())
+            return true;
+
+        // Check if we have any completions
+        if (check_for_one_io_completion())
+            return true;
+        // Check for expired timers
+        if (timers_.expire(timer_wheel::clock::now()) > 0)
+            return true;
+        // Submit everything we've prepared, and wait for completions
+        if (!do_poll())
+            return false;
+    }
+}
+
+auto uring_io_loop::run() -> std::size_t {
+    PROFILING_SCOPE();
+    if (fallback_)
+        return fallback_->run();
+
+    std::size_t num_completed{0};
+    // Run as many operations as possible, until the stop signal occurs
+    while (!should_stop_.load(std::memory_order_acquire)) {
+        if (run_one())
+            num_completed++;
+    }
+
+    PROFILING_SCOPE_N("exiting I/O loop");
+    // If we have a stop signal, and still have outstanding operations, cancel them
+    num_completed += timers_.cancel_all();
+    num_completed += cancel_all_in_flight();
+    return num_completed;
+}
+
+auto uring_io_loop::stop() noexcept -> void {
+    PROFILING_SCOPE();
+    if (fallback_)
+        return fallback_->stop();
+    should_stop_.store(true, std::memory_order_release);
+}
+
+auto uring_io_loop::add_io_oper(native_file_desc_t fd, oper_type t, oper_body_base* body) -> void {
+    PROFILING_SCOPE();
+    if (fallback_)
+        return fallback_->add_io_oper(fd, t, body);
+    body->submit_fd_ = fd;
+    body->submit_type_ = t;
+    in_queue_.push(body);
+    PROFILING_SET_TEXT_FMT(32, "fd=%d", fd);
+}
+
+auto uring_io_loop::add_non_io_oper(oper_body_base* body) -> void {
+    PROFILING_SCOPE();
+    if (fallback_)
+        return fallback_->add_non_io_oper(body);
+    body->submit_fd_ = -1;
+    body->submit_type_ = oper_type::read;
+    in_queue_.push(body);
+}
+
+auto uring_io_loop::add_timer_oper(timer_oper_base* body) -> void {
+    PROFILING_SCOPE();
+    if (fallback_)
+        return fallback_->add_timer_oper(body);
+    body->submit_fd_ = -1;
+    body->submit_type_ = oper_type::timer;
+    in_queue_.push(body);
+}
+
+auto uring_io_loop::cancel_oper(cancel_request* req) -> void {
+    PROFILING_SCOPE();
+    if (fallback_)
+        return fallback_->cancel_oper(req);
+    req->submit_fd_ = -1;
+    req->submit_type_ = oper_type::cancel;
+    in_queue_.push(req);
+}
+
+auto uring_io_loop::add_local_timer(timer_oper_base* oper) noexcept -> void {
+    if (fallback_)
+        return fallback_->add_local_timer(oper);
+    timers_.add(oper);
+}
+
+auto uring_io_loop::remove_local_timer(timer_oper_base* oper) noexcept -> void {
+    if (fallback_)
+        return fallback_->remove_local_timer(oper);
+    // Timers that have expired or were cancelled are no longer linked into the wheel
+    if (oper->timer_pprev_)
+        timers_.remove(oper);
+}
+
+auto uring_io_loop::check_in_ops() -> void {
+    PROFILING_SCOPE();
+    // Take all the submitted items at once
+    owned_in_opers_ = in_queue_.pop_all();
+}
+
+auto uring_io_loop::handle_one_owned_in_op() -> bool {
+    PROFILING_SCOPE();
+    if (owned_in_opers_) {
+        oper_body_base* op = owned_in_opers_;
+        owned_in_opers_ = op->submit_next_;
+        if (op->submit_type_ == oper_type::cancel) {
+            process_cancel(static_cast<cancel_request*>(op)->target_);
+            return true;
+        }
+        op->seen_by_loop_ = true;
+        if (op->cancel_processed_) {
+            // The operation was cancelled before we got to it
+            op->set_stopped();
+            return true;
+        }
+        if (op->submit_type_ == oper_type::timer) {
+            // Wait for the deadline of the timer
+            timers_.add(static_cast<timer_oper_base*>(op));
+            return true;
+        }
+        if (op->submit_fd_ < 0) {
+            // Simply run the non-IO operations; don't care about the result
+            op->try_run();
+            return true;
+        }
+        native_file_desc_t fd = op->submit_fd_;
+        oper_type t = op->submit_type_;
+        native_io_desc desc = op->native_desc();
+        if (desc.kind_ == native_io_kind::accept_multishot) {
+            if (!no_multishot_accept_) {
+                // Take the connections from the multishot request armed on the socket
+                wait_for_accept(alloc_slot(op, fd, t), desc.len_);
+                return true;
+            }
+            desc.kind_ = native_io_kind::accept;
+        }
+        if (desc.kind_ != native_io_kind::none) {
+            // Let the kernel perform the operation; we get the result as a completion
+            submit_native(alloc_slot(op, fd, t), desc);
+        } else if (!op->try_run()) {
+            // The operation didn't complete instantly; wait for the fd to be ready
+            retry_or_park(alloc_slot(op, fd, t));
+        }
+        return true;
+    }
+    return false;
+}
+
+auto uring_io_loop::check_for_one_io_completion() -> bool {
+    PROFILING_SCOPE();
+    while (true) {
+        std::uint32_t head = *cq_head_;
+        std::uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        if (head == tail)
+            return false;
+        io_uring_cqe cqe = cqes_[head & cq_mask_];
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+
+        auto tag = static_cast<user_data_tag>(cqe.user_data & tag_mask);
+        auto slot = static_cast<std::uint32_t>(cqe.user_data >> tag_bits);
+        switch (tag) {
+        case tag_wake:
+            in_queue_.consume_wake_signal();
+            submit_wake_poll();
+            break;
+        case tag_cancel:
+            break;
+        case tag_accept:
+            if (on_accept_completion(slot, cqe.res, cqe.flags))
+                return true;
+            break;
+        case tag_poll:
+        case tag_native: {
+            in_flight& f = in_flight_[slot];
+            oper_body_base* body = f.body_;
+            if (f.cancelling_) {
+                // The request was cancelled (or completed just before); drop its result.
+                // Don't leak connections that were accepted in the meantime.
+                if (tag == tag_native && f.kind_ == native_io_kind::accept && cqe.res >= 0)
+                    close(cqe.res);
+                free_slot(slot);
+                body->set_stopped();
+                return true;
+            }
+            // For polls, the fd is ready (or the poll failed); let the operation find out
+            bool done = tag == tag_poll ? body->try_run() : body->complete_native(cqe.res);
+            if (done) {
+                free_slot(slot);
+                return true;
+            }
+            // The operation would block; wait for readiness, and continue with `try_run()`
+            retry_or_park(slot);
+            break;
+        }
+        }
+    }
+}
+
+auto uring_io_loop::do_poll() -> bool {
+    PROFILING_SCOPE();
+    // In busy-polling mode, look for work without blocking for a while, before parking. The
+    // completions are in shared memory, so we don't need syscalls for checking them.
+    if (spin_.enabled() && num_to_submit_ > 0)
+        submit_and_wait(0);
+    bool found = spin_.spin(
+            [this] {
+                return !in_queue_.empty() ||
+                       *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) ||
+                       timers_.next_timeout_ms(timer_wheel::clock::now()) == 0;
+            },
+            stats_);
+    if (found)
+        return true;
+
+    // Cancellations that didn't fit in the submission queue go in once the kernel took the
+    // previous requests
+    if (!pending_cancels_.empty()) {
+        submit_and_wait(0);
+        submit_pending_cancels();
+    }
+
+    // Wait until the next timer expires; don't block if new operations were submitted
+    std::uint32_t min_complete = 0;
+    int timeout_ms = -1;
+    if (in_queue_.prepare_to_sleep()) {
+        timeout_ms = timers_.next_timeout_ms(timer_wheel::clock::now());
+        // The operations with pending cancellations may never complete on their own; come back
+        // soon to retry them
+        if (!pending_cancels_.empty() && (timeout_ms < 0 || timeout_ms > 1))
+            timeout_ms = 1;
+        min_complete = timeout_ms == 0 ? 0 : 1;
+        if (min_complete > 0)
+            stats_.parks_++;
+    }
+    int rc = submit_and_wait(min_complete, timeout_ms);
+    in_queue_.done_sleeping();
+    spin_.woke_up();
+    PROFILING_SET_TEXT_FMT(32, "in_flight=%d => %d", int(num_in_flight_), rc);
+    return rc >= 0 || rc == -EBUSY || rc == -ETIME;
+}
+
+auto uring_io_loop::get_sqe() -> io_uring_sqe* {
+    std::uint32_t tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+        // The submission queue is full; hand the requests to the kernel to make room
+        submit_and_wait(0);
+        if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+            throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+    }
+    std::uint32_t idx = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    sq_array_[idx] = idx;
+    // The kernel only looks at the new entries when we call `io_uring_enter()`
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    num_to_submit_++;
+    return sqe;
+}
+
+auto uring_io_loop::submit_and_wait(std::uint32_t min_complete, int timeout_ms) -> int {
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    __kernel_timespec ts{timeout_ms / 1000, (timeout_ms % 1000) * 1000000ll};
+    io_uring_getevents_arg arg{};
+    if (min_complete > 0 && timeout_ms >= 0)
+        arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+    int rc = sys_io_uring_enter(ring_fd_, num_to_submit_, min_complete, flags, &arg);
+    if (rc < 0)
+        return -errno;
+    num_to_submit_ -= std::min(num_to_submit_, static_cast<std::uint32_t>(rc));
+    return rc;
+}
+
+auto uring_io_loop::alloc_slot(oper_body_base* body, native_file_desc_t fd, oper_type t)
+        -> std::uint32_t {
+    std::uint32_t slot;
+    if (free_slots_.empty()) {
+        slot = static_cast<std::uint32_t>(in_flight_.size());
+        in_flight_.emplace_back();
+    } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    }
+    in_flight_[slot] = in_flight{body, fd, t, native_io_kind::none};
+    num_in_flight_++;
+    body->loop_slot_ = slot_handle{slot, 0};
+    return slot;
+}
+
+auto uring_io_loop::free_slot(std::uint32_t slot) -> void {
+    in_flight_[slot] = {};
+    free_slots_.push_back(slot);
+    num_in_flight_--;
+}
+
+auto uring_io_loop::retry_or_park(std::uint32_t slot) -> void {
+    // An operation being cancelled waits for its cancellation request, without doing any more I/O
+    in_flight& f = in_flight_[slot];
+    if (f.body_->cancel_requested())
+        f.parked_ = true;
+    else
+        submit_poll(slot);
+}
+
+auto uring_io_loop::process_cancel(oper_body_base* op) noexcept -> void {
+    PROFILING_SCOPE();
+    // If the operation is still in our queue, cancel it when we get to it
+    if (!op->seen_by_loop_) {
+        op->cancel_processed_ = true;
+        return;
+    }
+    if (op->submit_type_ == oper_type::timer) {
+        remove_local_timer(static_cast<timer_oper_base*>(op));
+        op->set_stopped();
+        return;
+    }
+    // An operation with a pending cancellation never completes on its own, so it must still
+    // have its slot
+    std::uint32_t slot = op->loop_slot_.index_;
+    in_flight& f = in_flight_[slot];
+    if (f.parked_ || f.kind_ == native_io_kind::accept_multishot) {
+        // Nothing is in the kernel for the operation itself
+        if (f.kind_ == native_io_kind::accept_multishot)
+            cancel_accept_waiter(slot);
+        free_slot(slot);
+        op->set_stopped();
+        return;
+    }
+    // The kernel may still use the buffers of the operation; stop it when its request completes
+    f.cancelling_ = true;
+    try {
+        submit_cancel(slot);
+    } catch (...) {
+        // The ring is full. A poll on an idle socket never completes by itself, so the
+        // cancellation can't be dropped; submit it once the ring has room.
+        pending_cancels_.push_back({slot, op});
+    }
+}
+
+auto uring_io_loop::submit_cancel(std::uint32_t slot) -> void {
+    const in_flight& f = in_flight_[slot];
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = make_user_data(slot, f.kind_ == native_io_kind::none ? tag_poll : tag_native);
+    sqe->user_data = make_user_data(0, tag_cancel);
+}
+
+auto uring_io_loop::submit_pending_cancels() noexcept -> void {
+    while (!pending_cancels_.empty()) {
+        pending_cancel c = pending_cancels_.back();
+        // Skip the requests that completed in the meantime
+        bool needed = false;
+        if (c.body_)
+            needed = in_flight_[c.slot_].body_ == c.body_ && in_flight_[c.slot_].cancelling_;
+        else
+            needed = listener_accepts_[c.slot_].armed_ && listener_accepts_[c.slot_].cancelling_;
+        if (needed) {
+            try {
+                if (c.body_)
+                    submit_cancel(c.slot_);
+                else
+                    submit_accept_cancel(c.slot_);
+            } catch (...) {
+                return; // Still no room
+            }
+        }
+        pending_cancels_.pop_back();
+    }
+}
+
+auto uring_io_loop::wait_for_accept(std::uint32_t slot, std::size_t batch_size) -> void {
+    in_flight& f = in_flight_[slot];
+    // Find the entry of the listening socket, or a free one
+    auto num_entries = static_cast<std::uint32_t>(listener_accepts_.size());
+    std::uint32_t idx = 0;
+    while (idx < num_entries && listener_accepts_[idx].fd_ != f.fd_)
+        idx++;
+    if (idx == num_entries) {
+        idx = 0;
+        while (idx < num_entries && listener_accepts_[idx].fd_ >= 0)
+            idx++;
+        if (idx == num_entries)
+            listener_accepts_.emplace_back();
+    }
+    listener_accept& l = listener_accepts_[idx];
+    if (l.waiter_) {
+        // Another operation already waits on the socket; this one gets a request of its own
+        submit_native(slot, {native_io_kind::accept, nullptr, 0});
+        return;
+    }
+    f.kind_ = native_io_kind::accept_multishot;
+    l.fd_ = f.fd_;
+    l.waiter_ = f.body_;
+    l.waiter_slot_ = slot;
+    l.batch_size_ = std::max<std::size_t>(batch_size, 1);
+    update_accept(idx);
+}
+
+auto uring_io_loop::on_accept_completion(std::uint32_t idx, int res, std::uint32_t flags) -> bool {
+    listener_accept& l = listener_accepts_[idx];
+    if ((flags & IORING_CQE_F_MORE) == 0) {
+        // The request ended; it's armed again if an operation still waits
+        l.armed_ = false;
+        l.cancelling_ = false;
+        num_armed_accepts_--;
+    }
+    bool completed = false;
+    if (res >= 0) {
+        try {
+            l.ready_.push_back(static_cast<native_file_desc_t>(res));
+        } catch (...) {
+            // Out of memory; drop the connection
+            close(res);
+        }
+    } else if (res == -EINVAL) {
+        // The kernel doesn't support multishot accept
+        no_multishot_accept_ = true;
+    } else if (res != -ECANCELED && l.waiter_ && l.ready_.empty()
+               && !l.waiter_->cancel_requested()) {
+        // Let the operation decide whether the error ends it; the connections go first, and the
+        // error comes again on the next request
+        if (l.waiter_->complete_native(res)) {
+            free_slot(l.waiter_slot_);
+            l.waiter_ = nullptr;
+            completed = true;
+        }
+    }
+    completed = update_accept(idx) || completed;
+    if (no_multishot_accept_ && l.waiter_ && !l.armed_) {
+        // Continue with a single accept request, like the operations that come after
+        std::uint32_t slot = l.waiter_slot_;
+        l.waiter_ = nullptr;
+        submit_native(slot, {native_io_kind::accept, nullptr, 0});
+    }
+    if (!l.armed_ && !l.waiter_ && l.ready_.empty())
+        l.fd_ = -1;
+    return completed;
+}
+
+auto uring_io_loop::update_accept(std::uint32_t idx) -> bool {
+    listener_accept& l = listener_accepts_[idx];
+    bool completed = false;
+    // Hand the connections to the waiting operation; if it's being cancelled, it won't take them
+    if (l.waiter_ && !l.ready_.empty() && !l.waiter_->cancel_requested()) {
+        std::size_t n = std::min(l.ready_.size(), l.batch_size_);
+        bool done = l.waiter_->complete_accepted({l.ready_.data(), n});
+        // The operation owns the connections now, even if it didn't complete
+        l.ready_.erase(l.ready_.begin(), l.ready_.begin() + static_cast<std::ptrdiff_t>(n));
+        if (done) {
+            free_slot(l.waiter_slot_);
+            l.waiter_ = nullptr;
+            completed = true;
+        }
+    }
+    bool waiting = l.waiter_ && !l.waiter_->cancel_requested();
+    if (waiting && !l.armed_ && !no_multishot_accept_)
+        submit_accept(idx);
+    else if (!waiting && l.armed_ && l.ready_.size() >= l.batch_size_)
+        // Nobody takes the connections for now; leave the next ones in the accept queue
+        cancel_accept(idx);
+    return completed;
+}
+
+auto uring_io_loop::submit_accept(std::uint32_t idx) -> void {
+    listener_accept& l = listener_accepts_[idx];
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = l.fd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = make_user_data(idx, tag_accept);
+    l.armed_ = true;
+    num_armed_accepts_++;
+}
+
+auto uring_io_loop::submit_accept_cancel(std::uint32_t idx) -> void {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = make_user_data(idx, tag_accept);
+    sqe->user_data = make_user_data(0, tag_cancel);
+}
+
+auto uring_io_loop::cancel_accept(std::uint32_t idx) noexcept -> void {
+    listener_accept& l = listener_accepts_[idx];
+    if (l.cancelling_)
+        return;
+    l.cancelling_ = true;
+    try {
+        submit_accept_cancel(idx);
+    } catch (...) {
+        // The ring is full; submit it once the ring has room
+        pending_cancels_.push_back({idx, nullptr});
+    }
+}
+
+auto uring_io_loop::cancel_accept_waiter(std::uint32_t slot) noexcept -> void {
+    for (std::uint32_t idx = 0; idx < listener_accepts_.size(); idx++) {
+        listener_accept& l = listener_accepts_[idx];
+        if (!l.waiter_ || l.waiter_slot_ != slot)
+            continue;
+        // The listener is probably going away; stop accepting connections for it
+        l.waiter_ = nullptr;
+        for (native_file_desc_t conn_fd : l.ready_)
+            close(conn_fd);
+        l.ready_.clear();
+        if (l.armed_)
+            cancel_accept(idx);
+        else
+            l.fd_ = -1;
+        return;
+    }
+}
+
+auto uring_io_loop::submit_native(std::uint32_t slot, const native_io_desc& desc) -> void {
+    in_flight& f = in_flight_[slot];
+    f.kind_ = desc.kind_;
+    io_uring_sqe* sqe = get_sqe();
+    sqe->fd = f.fd_;
+    sqe->user_data = make_user_data(slot, tag_native);
+    auto len = static_cast<std::uint32_t>(
+            std::min<std::size_t>(desc.len_, std::numeric_limits<std::uint32_t>::max()));
+    switch (desc.kind_) {
+    case native_io_kind::recv:
+        sqe->opcode = IORING_OP_RECV;
+        sqe->addr = reinterpret_cast<std::uint64_t>(desc.buf_);
+        sqe->len = len;
+        break;
+    case native_io_kind::send:
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr = reinterpret_cast<std::uint64_t>(desc.buf_);
+        sqe->len = len;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        break;
+    case native_io_kind::sendmsg:
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = reinterpret_cast<std::uint64_t>(desc.buf_);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        break;
+    case native_io_kind::accept:
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        break;
+    case native_io_kind::none:
+    case native_io_kind::accept_multishot: // Handled by `wait_for_accept()`
+        break;
+    }
+}
+
+auto uring_io_loop::submit_poll(std::uint32_t slot) -> void {
+    in_flight& f = in_flight_[slot];
+    f.kind_ = native_io_kind::none;
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = f.fd_;
+    sqe->poll32_events = f.type_ == oper_type::write ? POLLOUT : POLLIN;
+    sqe->user_data = make_user_data(slot, tag_poll);
+}
+
+auto uring_io_loop::submit_wake_poll() -> void {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = in_queue_.wake_fd();
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = make_user_data(0, tag_wake);
+}
+
+auto uring_io_loop::cancel_all_in_flight() -> std::size_t {
+    std::size_t num_cancelled{0};
+    // Operations waiting for their cancellation requests, or for the connections of a multishot
+    // accept, have nothing in the kernel
+    for (std::uint32_t slot = 1; slot < in_flight_.size(); slot++) {
+        const in_flight& f = in_flight_[slot];
+        if (f.body_ && (f.parked_ || f.kind_ == native_io_kind::accept_multishot)) {
+            oper_body_base* body = f.body_;
+            free_slot(slot);
+            body->set_stopped();
+            num_cancelled++;
+        }
+    }
+
+    // Ask the kernel to cancel all the requests; we need to wait for their completions before
+    // announcing the cancellation, as the kernel may still use the buffers of the operations.
+    // There may be more requests than room in the submission queue; the cancellations go in as
+    // the kernel takes them.
+    pending_cancels_.clear();
+    for (std::uint32_t slot = 1; slot < in_flight_.size(); slot++) {
+        in_flight& f = in_flight_[slot];
+        if (f.body_) {
+            f.cancelling_ = true;
+            pending_cancels_.push_back({slot, f.body_});
+        }
+    }
+    for (std::uint32_t idx = 0; idx < listener_accepts_.size(); idx++) {
+        listener_accept& l = listener_accepts_[idx];
+        l.waiter_ = nullptr;
+        if (l.armed_) {
+            l.cancelling_ = true;
+            pending_cancels_.push_back({idx, nullptr});
+        }
+    }
+
+    while (num_in_flight_ > 0 || num_armed_accepts_ > 0) {
+        submit_pending_cancels();
+        // Come back soon if some cancellations are still waiting for room
+        int rc = submit_and_wait(1, pending_cancels_.empty() ? -1 : 1);
+        if (rc < 0 && rc != -EINTR && rc != -EBUSY && rc != -ETIME)
+            break;
+        std::uint32_t head = *cq_head_;
+        std::uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            auto tag = static_cast<user_data_tag>(cqe.user_data & tag_mask);
+            auto slot = static_cast<std::uint32_t>(cqe.user_data >> tag_bits);
+            if (tag == tag_accept) {
+                // Nobody takes the connections accepted in the meantime
+                if (cqe.res >= 0)
+                    close(cqe.res);
+                if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+                    listener_accepts_[slot].armed_ = false;
+                    num_armed_accepts_--;
+                }
+                continue;
+            }
+            if (tag != tag_native && tag != tag_poll)
+                continue;
+            in_flight& f = in_flight_[slot];
+            // Don't leak connections that were accepted while we were cancelling
+            if (tag == tag_native && f.kind_ == native_io_kind::accept && cqe.res >= 0)
+                close(cqe.res);
+            f.body_->set_stopped();
+            f = {};
+            free_slots_.push_back(slot);
+            num_in_flight_--;
+            num_cancelled++;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    for (listener_accept& l : listener_accepts_)
+        for (native_file_desc_t conn_fd : l.ready_)
+            close(conn_fd);
+    listener_accepts_.clear();
+    return num_cancelled;
+}
+
+} // namespace io::detail
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "native_file_desc_t.hpp"
+#include "oper_type.hpp"
+#include "oper_body_base.hpp"
+#include "submission_queue.hpp"
+#include "timer_wheel.hpp"
+#include "adaptive_spin.hpp"
+#include "poll_io_loop.hpp"
+#include "io/io_options.hpp"
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace io::detail {
+
+//! Class that implements an I/O loop on top of Linux's io_uring.
+//!
+//! Same contract as `poll_io_loop`, but operations that can describe themselves (see
+//! `oper_body_base::native_desc()`) are submitted directly to the kernel as recv/send/accept
+//! requests, and are completed from the completion queue, without a separate readiness check.
+//! All the requests prepared during one loop iteration are submitted with a single syscall,
+//! together with waiting for completions.
+//!
+//! Operations without a native description, and native operations that would block, are handled
+//! by submitting a poll request and calling `try_run()` when the file descriptor is ready.
+//!
+//! The batch accepts (`native_io_kind::accept_multishot`) share a multishot accept request per
+//! listening socket. It stays armed between the operations, so a busy listener doesn't submit a new
+//! request for each batch. The connections accepted while no operation waits are kept for the next
+//! one; if there are enough of them for a whole batch, the request is cancelled, and the rest stay
+//! in the accept queue of the socket. Cancelling the operation waiting on a socket also cancels its
+//! request, and closes the connections kept for it.
+//!
+//! If the kernel doesn't support io_uring (or doesn't have the features we need), this forwards
+//! everything to a `poll_io_loop`.
+class uring_io_loop {
+public:
+    explicit uring_io_loop(const io_options& opts = {});
+    ~uring_io_loop();
+
+    uring_io_loop(const uring_io_loop&) = delete;
+    auto operator=(const uring_io_loop&) -> uring_io_loop& = delete;
+
+    //! Run the loop once to execute maximum one operation.
+    //! If there are no operations to execute (or, no I/O completed) this will return false.
+    auto run_one() -> bool;
+
+    //! Run the loop to process operations
+    //! Stops after `stop()` is called, and all operations in our queues are drained.
+    auto run() -> std::size_t;
+
+    //! Stops processing any more operations
+    auto stop() noexcept -> void;
+
+    //! Check if we were told to stop
+    auto is_stopped() const noexcept -> bool {
+        if (fallback_)
+            return fallback_->is_stopped();
+        return should_stop_.load(std::memory_order_acquire);
+    }
+
+    //! Add an I/O operation to be executed into our loop
+    //! The body will be called multiple times, until the operation succeeds (body function returns
+    //! true)
+    auto add_io_oper(native_file_desc_t fd, oper_type t, oper_body_base* oper) -> void;
+
+    //! Add a non-I/O operation in our loop
+    //! The body will only be executed once.
+    auto add_non_io_oper(oper_body_base* oper) -> void;
+
+    //! Add an operation to be executed once its deadline is reached
+    auto add_timer_oper(timer_oper_base* oper) -> void;
+
+    //! Statistics about how the loop waits for work
+    auto stats() const noexcept -> const io_loop_stats& {
+        return fallback_ ? fallback_->stats() : stats_;
+    }
+
+    //! Submit a request to cancel an operation previously added to our loop.
+    //! Can be called from any thread; the operation completes with `set_stopped()`.
+    auto cancel_oper(cancel_request* req) -> void;
+
+    //! Add a timer directly to our timer wheel, bypassing the submission queue.
+    //! Must be called from the thread running the loop.
+    auto add_local_timer(timer_oper_base* oper) noexcept -> void;
+    //! Remove a timer added with `add_local_timer()`, if it didn't expire yet.
+    //! Must be called from the thread running the loop.
+    auto remove_local_timer(timer_oper_base* oper) noexcept -> void;
+
+    //! Check if we are actually using io_uring, or we fell back to `poll()`
+    auto uses_io_uring() const noexcept -> bool { return !fallback_; }
+
+private:
+    //! The mapped memory of the submission and completion rings
+    struct ring_memory {
+        void* ptr_{nullptr};
+        std::size_t size_{0};
+    };
+
+    //! The loop we forward to, if io_uring is not available
+    std::unique_ptr<poll_io_loop> fallback_;
+
+    std::atomic<bool> should_stop_{false};
+
+    // IO and non-IO operations created by various threads, not yet consumed by our loop
+    submission_queue in_queue_;
+
+    // input operations for which we have ownership
+    oper_body_base* owned_in_opers_{nullptr};
+
+    // The timers waiting for their deadline
+    timer_wheel timers_;
+
+    // Decides how long we spin before blocking, in busy-polling mode
+    adaptive_spin spin_;
+    io_loop_stats stats_;
+
+    // The ring and its mapped memory
+    native_file_desc_t ring_fd_{-1};
+    ring_memory sq_ring_;
+    ring_memory cq_ring_;
+    ring_memory sqes_mem_;
+
+    // Pointers inside the submission ring
+    std::uint32_t* sq_head_{nullptr};
+    std::uint32_t* sq_tail_{nullptr};
+    std::uint32_t sq_mask_{0};
+    std::uint32_t sq_entries_{0};
+    std::uint32_t* sq_array_{nullptr};
+    io_uring_sqe* sqes_{nullptr};
+    //! Number of SQEs that we prepared, but not yet submitted to the kernel
+    std::uint32_t num_to_submit_{0};
+
+    // Pointers inside the completion ring
+    std::uint32_t* cq_head_{nullptr};
+    std::uint32_t* cq_tail_{nullptr};
+    std::uint32_t cq_mask_{0};
+    io_uring_cqe* cqes_{nullptr};
+
+    //! A request in flight in the kernel
+    struct in_flight {
+        oper_body_base* body_{nullptr};
+        native_file_desc_t fd_{-1};
+        oper_type type_{oper_type::read};
+        native_io_kind kind_{native_io_kind::none};
+        //! The operation refused to complete, as it's being cancelled; nothing is in the kernel
+        bool parked_{false};
+        //! We asked the kernel to cancel the request; the operation is stopped on its completion
+        bool cancelling_{false};
+    };
+    // The requests in flight; the index in this vector is stored in the user data of the requests
+    std::vector<in_flight> in_flight_;
+    std::vector<std::uint32_t> free_slots_;
+    std::size_t num_in_flight_{0};
+
+    //! A multishot accept request on a listening socket, and the operation waiting for its
+    //! connections. The index in `listener_accepts_` is stored in the user data of the request.
+    struct listener_accept {
+        //! The listening socket; -1 if the entry is free
+        native_file_desc_t fd_{-1};
+        //! The operation waiting for connections, and its slot in `in_flight_`
+        oper_body_base* waiter_{nullptr};
+        std::uint32_t waiter_slot_{0};
+        //! The size of the batches taken by the operations
+        std::size_t batch_size_{1};
+        //! Set while the request is in the kernel
+        bool armed_{false};
+        //! We asked the kernel to cancel the request
+        bool cancelling_{false};
+        //! The connections accepted while no operation was waiting
+        std::vector<native_file_desc_t> ready_;
+    };
+    std::vector<listener_accept> listener_accepts_;
+    //! The number of multishot accept requests in the kernel
+    std::size_t num_armed_accepts_{0};
+    //! Set if the kernel doesn't support multishot accept; we then accept with single requests
+    bool no_multishot_accept_{false};
+
+    //! A cancellation that didn't fit in the submission queue
+    struct pending_cancel {
+        std::uint32_t slot_;
+        //! The operation in the slot; null for the request of `listener_accepts_[slot_]`
+        oper_body_base* body_;
+    };
+    //! The cancellations to submit as soon as the submission queue has room
+    std::vector<pending_cancel> pending_cancels_;
+
+    auto setup_ring() -> bool;
+    auto teardown_ring() noexcept -> void;
+
+    auto check_in_ops() -> void;
+    auto handle_one_owned_in_op() -> bool;
+    auto check_for_one_io_completion() -> bool;
+    auto do_poll() -> bool;
+    auto process_cancel(oper_body_base* op) noexcept -> void;
+
+    auto get_sqe() -> io_uring_sqe*;
+    auto submit_and_wait(std::uint32_t min_complete, int timeout_ms = -1) -> int;
+    auto alloc_slot(oper_body_base* body, native_file_desc_t fd, oper_type t) -> std::uint32_t;
+    auto submit_native(std::uint32_t slot, const native_io_desc& desc) -> void;
+    auto submit_poll(std::uint32_t slot) -> void;
+    auto retry_or_park(std::uint32_t slot) -> void;
+    auto free_slot(std::uint32_t slot) -> void;
+    auto submit_wake_poll() -> void;
+    auto submit_cancel(std::uint32_t slot) -> void;
+    auto submit_pending_cancels() noexcept -> void;
+    auto wait_for_accept(std::uint32_t slot, std::size_t batch_size) -> void;
+    auto on_accept_completion(std::uint32_t idx, int res, std::uint32_t flags) -> bool;
+    auto update_accept(std::uint32_t idx) -> bool;
+    auto submit_accept(std::uint32_t idx) -> void;
+    auto submit_accept_cancel(std::uint32_t idx) -> void;
+    auto cancel_accept(std::uint32_t idx) noexcept -> void;
+    auto cancel_accept_waiter(std::uint32_t slot) noexcept -> void;
+    auto cancel_all_in_flight() -> std::size_t;
+};
+} // namespace io::detail
@@ -1,6 +1,8 @@
 #pragma once
 
-#include "detail/poll_io_loop.hpp"
+#include "detail/io_loop.hpp"
+#include "io_options.hpp"
+#include "io_loop_stats.hpp"
 #include <senders/sender_from_ftor.hpp>
 
 #include <execution.hpp>
@@ -13,7 +15,8 @@ namespace io {
 //! on it. It also allows adding I/O operations to be executed in this context.
 class io_context {
 public:
-    io_context() = default;
+    explicit io_context(const io_options& opts = {})
+        : io_loop_(opts) {}
     io_context(io_context const&) = delete;
     auto operator=(io_context const&) -> io_context& = delete;
 
@@ -29,6 +32,9 @@ public:
     //! Check if we were told to stop
     auto is_stopped() const noexcept -> bool { return io_loop_.is_stopped(); }
 
+    //! Statistics about how the I/O loop waits for work; read them after the loop stops
+    auto stats() const noexcept -> const io_loop_stats& { return io_loop_.stats(); }
+
     class scheduler;
 
     //! Get a scheduler object associated with this I/O context
@@ -36,7 +42,7 @@ public:
 
 private:
     //! The I/O loop used as the underlying implementation of this I/O context.
-    detail::poll_io_loop io_loop_;
+    detail::io_loop io_loop_;
 };
 
 class io_context::scheduler {
@@ -51,7 +57,7 @@ public:
 
         template <class Receiver>
         class operation : detail::oper_body_base {
-            detail::poll_io_loop* io_loop_;
+            detail::io_loop* io_loop_;
             Receiver recv_;
 
             auto try_run() noexcept -> bool override {
@@ -63,7 +69,7 @@ public:
             }
 
         public:
-            operation(detail::poll_io_loop* io_loop, Receiver&& recv)
+            operation(detail::io_loop* io_loop, Receiver&& recv)
                 : io_loop_(io_loop)
                 , recv_(std::move(recv)) {}
 
@@ -111,6 +117,34 @@ public:
         context_->io_loop_.add_io_oper(fd, t, oper);
     }
 
+    //! The clock used for timed operations in our context
+    using clock = detail::timer_oper_base::clock;
+    using time_point = clock::time_point;
+    using duration = clock::duration;
+
+    //! Returns the current time, as seen by the timed operations in our context
+    auto now() const noexcept -> time_point { return clock::now(); }
+
+    //! Request the cancellation of an operation added to our context; can be called from any
+    //! thread. The operation will be completed with `set_stopped()`.
+    auto cancel_oper(detail::cancel_request* req) -> void { context_->io_loop_.cancel_oper(req); }
+
+    //! Add an operation to be executed into our context when its deadline is reached
+    auto add_timer_oper(detail::timer_oper_base* oper) -> void {
+        context_->io_loop_.add_timer_oper(oper);
+    }
+
+    //! Add a timer directly to the timer wheel of our context; cheaper than `add_timer_oper()`.
+    //! Must be called from the thread running the context.
+    auto add_local_timer(detail::timer_oper_base* oper) noexcept -> void {
+        context_->io_loop_.add_local_timer(oper);
+    }
+    //! Remove a timer added with `add_local_timer()`, if it is still pending.
+    //! Must be called from the thread running the context.
+    auto remove_local_timer(detail::timer_oper_base* oper) noexcept -> void {
+        context_->io_loop_.remove_local_timer(oper);
+    }
+
 private:
     io_context* context_;
 };
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+namespace io {
+
+//! Statistics collected by the I/O loop behind an `io_context`.
+//! Updated only by the thread running the loop; read them after the loop stops.
+struct io_loop_stats {
+    //! Number of times the busy-polling spin found work before its budget ran out
+    std::uint64_t spin_hits_{0};
+    //! Number of times the loop blocked in the kernel, waiting for work
+    std::uint64_t parks_{0};
+};
+
+} // namespace io
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+
+namespace io {
+
+//! Options used to configure the I/O loop behind an `io_context`.
+//! Options that don't apply to the selected backend are ignored.
+struct io_options {
+    //! For the epoll backend: use edge-triggered notifications instead of level-triggered ones.
+    //! Edge-triggered mode keeps file descriptors registered between operations, saving one
+    //! `epoll_ctl()` call per completed operation.
+    bool edge_triggered_{false};
+    //! Busy-polling mode: the maximum time the loop spins, looking for work without blocking,
+    //! before it parks in the kernel. The actual spin time adapts to the traffic, within this
+    //! limit. Trades CPU time for latency; zero (the default) disables busy-polling.
+    std::chrono::microseconds max_spin_{0};
+};
+
+} // namespace io
@@ -1,6 +1,7 @@
 #include "listening_socket.hpp"
 
 #include <system_error>
+#include <cstring>
 
 #include <sys/socket.h>
 #include <unistd.h>
@@ -9,13 +10,18 @@
 
 namespace io {
 
-listening_socket::listening_socket()
+listening_socket::listening_socket(bool reuse_port)
     : fd_(socket(AF_INET, SOCK_STREAM, 0)) {
     fcntl(fd_, F_SETFL, O_NONBLOCK);
     int on = 1;
     int rc = setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, (char*)&on, sizeof(on));
     if (rc != 0)
         throw std::system_error(std::error_code(errno, std::system_category()));
+    if (reuse_port) {
+        rc = setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, (char*)&on, sizeof(on));
+        if (rc != 0)
+            throw std::system_error(std::error_code(errno, std::system_category()));
+    }
 }
 
 listening_socket::~listening_socket() {
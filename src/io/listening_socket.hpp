@@ -6,7 +6,9 @@ namespace io {
 
 class listening_socket {
 public:
-    listening_socket();
+    //! Creates a listening socket. If `reuse_port` is set, multiple sockets can be bound to the same
+    //! port, and the kernel distributes the incoming connections between them.
+    explicit listening_socket(bool reuse_port = false);
     ~listening_socket();
     listening_socket(listening_socket&& other);
     auto operator=(listening_socket&& other) -> listening_socket&;
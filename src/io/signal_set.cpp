@@ -0,0 +1,27 @@
+#include "signal_set.hpp"
+
+#include <system_error>
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+namespace io {
+
+signal_set::signal_set(std::initializer_list<int> signals) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int signo : signals)
+        sigaddset(&mask, signo);
+    int rc = pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    if (rc != 0)
+        throw std::system_error(std::error_code(rc, std::system_category()));
+    fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd_ < 0)
+        throw std::system_error(std::error_code(errno, std::system_category()));
+}
+
+signal_set::~signal_set() { close(fd_); }
+
+} // namespace io
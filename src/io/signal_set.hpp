@@ -0,0 +1,28 @@
+#pragma once
+
+#include "detail/native_file_desc_t.hpp"
+
+#include <initializer_list>
+
+namespace io {
+
+//! A set of signals that are received through a file descriptor, instead of a signal handler, so
+//! that an I/O context can wait for them (see `async_wait_signal()`).
+//!
+//! The signals are blocked in the calling thread, and in all the threads it creates afterwards;
+//! create the set before starting any other thread, so that no thread can receive them directly.
+class signal_set {
+public:
+    explicit signal_set(std::initializer_list<int> signals);
+    ~signal_set();
+
+    signal_set(const signal_set& other) = delete;
+    auto operator=(const signal_set& other) -> signal_set& = delete;
+
+    auto fd() const -> detail::native_file_desc_t { return fd_; }
+
+private:
+    detail::native_file_desc_t fd_;
+};
+
+} // namespace io
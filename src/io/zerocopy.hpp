@@ -0,0 +1,175 @@
+#pragma once
+
+#include "io/io_context.hpp"
+#include "io/connection.hpp"
+#include <profiling.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+namespace io {
+
+//! Keeps track of the `MSG_ZEROCOPY` sends made on a connection.
+//!
+//! With zero-copy sends, the kernel uses the memory of our buffers until the data is acknowledged
+//! by the peer; it tells us that it no longer needs them through notifications on the error queue
+//! of the socket. The buffers must stay alive until all the sends are released.
+struct zerocopy_tracker {
+    //! The number of zero-copy sends made
+    std::uint32_t sent_{0};
+    //! The number of sends for which the kernel released the buffers
+    std::uint32_t released_{0};
+    //! The number of released sends for which the kernel copied the data anyway (e.g., loopback)
+    std::uint32_t copied_{0};
+
+    //! Check if the kernel still uses some of our buffers
+    auto pending() const noexcept -> bool { return released_ != sent_; }
+};
+
+//! Enables zero-copy sends on the connection. Returns false if they are not supported.
+inline auto enable_zerocopy(const connection& c) noexcept -> bool {
+    int one = 1;
+    return ::setsockopt(c.fd(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+}
+
+namespace detail {
+
+//! Reads all the zero-copy notifications available on the error queue of `fd`, without blocking
+inline auto read_zerocopy_notifications(native_file_desc_t fd, zerocopy_tracker& zc) noexcept
+        -> void {
+    while (zc.pending()) {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            return;
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            bool is_err = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                          (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!is_err)
+                continue;
+            const auto* err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            // The notification covers a range of sends
+            std::uint32_t n = err->ee_data - err->ee_info + 1;
+            zc.released_ += n;
+            if ((err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0)
+                zc.copied_ += n;
+        }
+    }
+}
+
+struct async_zerocopy_release_sender {
+    io_context* ctx_;
+    native_file_desc_t fd_;
+    zerocopy_tracker* zc_;
+    //! After this time, we stop waiting, even if some buffers are still in use; zero means no limit
+    std::chrono::milliseconds max_wait_;
+
+    using completion_signatures = std::execution::completion_signatures< //
+            std::execution::set_value_t(),                               //
+            std::execution::set_stopped_t()>;
+
+    //! The loops don't watch the error queues, so we check it periodically; the notifications
+    //! come when the peer acknowledges the data, so we start with short intervals
+    static constexpr std::chrono::milliseconds min_interval{1};
+    static constexpr std::chrono::milliseconds max_interval{32};
+
+    template <std::execution::receiver Recv>
+    class oper : timer_oper_base {
+        Recv recv_;
+        io_context* ctx_;
+        native_file_desc_t fd_;
+        zerocopy_tracker* zc_;
+        std::chrono::milliseconds max_wait_;
+        std::chrono::milliseconds interval_{min_interval};
+        io_context::scheduler::time_point give_up_at_{io_context::scheduler::time_point::max()};
+
+        //! Check for notifications; returns true if all the buffers were released, or if we waited
+        //! long enough
+        auto check() noexcept -> bool {
+            read_zerocopy_notifications(fd_, *zc_);
+            if (!zc_->pending())
+                return true;
+            auto sched = ctx_->get_scheduler();
+            auto now = sched.now();
+            if (now >= give_up_at_)
+                return true;
+            deadline_ = std::min(now + interval_, give_up_at_);
+            interval_ = std::min(interval_ * 2, max_interval);
+            sched.add_local_timer(this);
+            return false;
+        }
+
+        auto try_run() noexcept -> bool override {
+            PROFILING_SCOPE_N("async_zerocopy_release::try_run");
+            if (check())
+                std::execution::set_value(std::move(recv_));
+            return true;
+        }
+        auto set_stopped() noexcept -> void override {
+            std::execution::set_stopped(std::move(recv_));
+        }
+
+    public:
+        oper(Recv&& recv, io_context* ctx, native_file_desc_t fd, zerocopy_tracker* zc,
+                std::chrono::milliseconds max_wait)
+            : recv_(std::move(recv))
+            , ctx_(ctx)
+            , fd_(fd)
+            , zc_(zc)
+            , max_wait_(max_wait) {}
+
+        friend void tag_invoke(std::execution::start_t, oper& self) noexcept {
+            PROFILING_SCOPE_N("async_zerocopy_release::start");
+            if (self.max_wait_ > std::chrono::milliseconds::zero())
+                self.give_up_at_ = self.ctx_->get_scheduler().now() + self.max_wait_;
+            if (self.check())
+                std::execution::set_value(std::move(self.recv_));
+        }
+    };
+
+    template <std::execution::receiver Recv>
+    friend auto tag_invoke(
+            std::execution::connect_t, async_zerocopy_release_sender&& self, Recv&& recv)
+            -> oper<std::decay_t<Recv>> {
+        return {std::forward<Recv>(recv), self.ctx_, self.fd_, self.zc_, self.max_wait_};
+    }
+};
+
+} // namespace detail
+
+//! Returns a sender that completes when the kernel has released all the buffers of the zero-copy
+//! sends tracked by `zc`; only then the buffers can be freed.
+//!
+//! This cannot be cancelled, as freeing the buffers early would expose unrelated memory to the
+//! peer. The buffers are released once the peer acknowledges the data, which may never happen; so
+//! the wait is bounded by `max_wait` (zero means no limit), and `zc.pending()` tells whether it
+//! completed because of the bound. Resetting the connection with `connection::abort()` makes the
+//! kernel drop the data, and release the buffers right away.
+//! Must be started on the I/O thread of `ctx`.
+inline auto async_zerocopy_release(io_context& ctx, const connection& c, zerocopy_tracker& zc,
+        std::chrono::milliseconds max_wait = {}) -> detail::async_zerocopy_release_sender {
+    return {&ctx, c.fd(), &zc, max_wait};
+}
+
+} // namespace io
@@ -1,16 +1,37 @@
 
+#include "access_log.hpp"
 #include "conn_data.hpp"
 #include "read_http_request.hpp"
 #include "write_http_response.hpp"
 #include "handle_request.hpp"
+#include "image_cache.hpp"
 #include "profiling.hpp"
+#include "server_config.hpp"
 #include "io/async_accept.hpp"
+#include "http_server/to_buffers.hpp"
+#include "io/async_sleep.hpp"
+#include "io/async_wait_signal.hpp"
+#include "io/signal_set.hpp"
+#include "senders/async_scope.hpp"
 
 #include <execution.hpp>
 #include <task.hpp>
 #include <schedulers/static_thread_pool.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <cstdio>
 #include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 namespace ex = std::execution;
 using example::static_thread_pool;
@@ -21,94 +42,650 @@ auto just_500_response() {
     return ex::just(std::move(resp));
 }
 
-//! Handles one connection from the client
-auto handle_connection(const conn_data& cdata) {
-    // First read the HTTP request from the connection
-    return read_http_request(cdata.io_ctx_, cdata.conn_)
+//! Returns the response for the requests that we reject because we are overloaded
+auto overloaded_response() -> http_server::http_response {
+    return http_server::create_response(http_server::status_code::s_503_service_unavailable,
+            http_server::headers{{"Retry-After", "1"}});
+}
+
+//! The ID of the next connection, for the access log
+static std::atomic<std::uint64_t> g_next_conn_id{1};
+
+//! Converts a duration to microseconds, for the access log
+auto to_us(std::chrono::steady_clock::duration d) -> std::uint32_t {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    return static_cast<std::uint32_t>(std::clamp<decltype(us)>(us, 0, UINT32_MAX));
+}
+
+//! Adds the record of a request to the access log of the connection, if the log is enabled
+auto log_access(const conn_data& cdata, access_record& rec) -> void {
+    if (!cdata.shard_.access_log_)
+        return;
+    rec.conn_id_ = cdata.id_;
+    rec.timestamp_us_ = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+                                .count();
+    cdata.shard_.access_log_->push(rec);
+}
+
+//! Processes one request on the worker pool, and completes on the I/O thread with the response.
+//! The `admission` ticket tracks the time the request waits for a worker.
+auto process_request(const conn_data& cdata, http_server::http_request req, route_params params,
+        response_key key, admission_controller::ticket& admission) {
+    admission.enqueue();
+    return ex::just(std::move(req), std::move(params))
            // Move to the worker pool
-           | ex::transfer(cdata.pool_.get_scheduler())
+           | ex::transfer(cdata.shard_.pool_.get_scheduler())
            // Handle the request
-           | ex::let_value([&cdata](http_server::http_request req) {
-                 return handle_request(cdata, std::move(req));
-             })
+           | ex::let_value(
+                   [&cdata, &admission, key](http_server::http_request req, route_params params) {
+                       admission.start();
+                       return handle_request(cdata, std::move(req), std::move(params), key);
+                   })
            // If we have any errors, convert them to 500 error responses
            | ex::let_error([](std::exception_ptr) { return just_500_response(); })
            // If we are somehow cancelled, issue a 500 error response
            | ex::let_stopped([]() { return just_500_response(); })
-           // Write the response back to the client
-           | ex::let_value([&cdata](http_server::http_response resp) {
-                 return write_http_response(cdata.io_ctx_, cdata.conn_, std::move(resp));
-             });
+           // Move back to the I/O thread, where the connection deadlines are managed
+           | ex::transfer(cdata.shard_.io_ctx_.get_scheduler());
+}
+
+//! Reads the body of the request, chunk by chunk, as the client uploads it
+auto read_request_body(const conn_data& cdata, request_reader& reader) -> task<std::string> {
+    std::string body;
+    body.reserve(reader.body_size_);
+    while (true) {
+        std::string_view chunk = co_await read_body_chunk(cdata, reader);
+        if (chunk.empty())
+            break;
+        body.append(chunk);
+    }
+    co_return body;
+}
+
+//! A request on an HTTP/2 connection that we accepted, while its body is received
+struct h2_stream {
+    route_params params_;
+    admission_controller::ticket admission_;
+    access_record rec_;
+};
+
+//! The state of an HTTP/2 connection, shared by the tasks serving it on the I/O thread
+struct h2_connection {
+    const conn_data& cdata_;
+    http_server::h2::session session_;
+    //! The requests accepted, until they are complete
+    std::unordered_map<std::uint32_t, h2_stream> streams_;
+    //! The number of requests started on the connection
+    std::size_t num_requests_{0};
+    //! The tasks processing the requests, and the one writing the output
+    senders::async_scope tasks_;
+    //! Set while a task writes the output of the session
+    bool flushing_{false};
+    //! Set once a write fails; the connection is gone
+    bool write_failed_{false};
+};
+
+//! Writes the output of the session, until there is nothing left to write.
+//! If the write fails, shuts down the connection; the reading side sees the end of it.
+auto flush_h2_output(h2_connection& h2) -> task<bool> {
+    const conn_data& cdata = h2.cdata_;
+    io::connection_deadline deadline{cdata.shard_.io_ctx_, cdata.conn_};
+    std::vector<std::string_view> buffers;
+    try {
+        while (h2.session_.want_write()) {
+            buffers.clear();
+            h2.session_.collect_output(buffers);
+            deadline.arm(cdata.shard_.timeouts_.write_);
+            co_await io::async_writev(cdata.shard_.io_ctx_, cdata.conn_, buffers);
+            h2.session_.output_written();
+        }
+    } catch (...) {
+        if (deadline.expired())
+            cdata.shard_.reaped_.write_++;
+        h2.write_failed_ = true;
+    }
+    h2.flushing_ = false;
+    // Once the session is done, or broken, the reading side can stop
+    if (h2.write_failed_ || h2.session_.closed())
+        ::shutdown(cdata.conn_.fd(), SHUT_RDWR);
+    co_return true;
 }
 
-auto listener(int port, io::io_context& ctx, static_thread_pool& pool) -> task<bool> {
+//! Starts writing the output of the session, unless that's already in progress
+auto schedule_h2_flush(h2_connection& h2) -> void {
+    if (h2.flushing_ || h2.write_failed_ || !h2.session_.want_write())
+        return;
+    h2.flushing_ = true;
+    h2.tasks_.spawn(flush_h2_output(h2));
+}
+
+//! Processes a request on an HTTP/2 connection, once it is complete, and submits the response
+auto handle_h2_stream(h2_connection& h2, std::uint32_t stream_id, h2_stream st) -> task<bool> {
+    using clock = std::chrono::steady_clock;
+    http_server::http_request& req = h2.session_.request(stream_id);
+    st.rec_.request_body_size_ = static_cast<std::uint32_t>(req.body_.size());
+    // Repeated requests are answered right here, without the worker pool
+    auto key = response_key_of(req, st.params_);
+    auto direct = answer_without_processing(h2.cdata_, req, st.params_, key);
+    if (direct)
+        st.admission_ = {};
+    auto resp = direct ? std::move(*direct)
+                       : co_await process_request(h2.cdata_, std::move(req),
+                               std::move(st.params_), key, st.admission_);
+    if (st.admission_.started_at() != clock::time_point{}) {
+        st.rec_.queue_us_ = to_us(st.admission_.started_at() - st.admission_.enqueued_at());
+        st.rec_.handle_us_ = to_us(clock::now() - st.admission_.started_at());
+    }
+    st.rec_.status_ = http_server::status_code_value(resp.status_code_);
+    st.rec_.response_body_size_ = static_cast<std::uint32_t>(resp.body_.size());
+    log_access(h2.cdata_, st.rec_);
+    h2.session_.submit_response(stream_id, std::move(resp));
+    schedule_h2_flush(h2);
+    co_return true;
+}
+
+//! Checks the head of a request on an HTTP/2 connection, like we do for HTTP/1.x, and answers
+//! right away if we don't take the request. The accepted requests wait for their body.
+auto on_h2_request_head(h2_connection& h2, std::uint32_t stream_id) -> void {
+    const conn_data& cdata = h2.cdata_;
+    const http_server::http_request& req = h2.session_.request(stream_id);
+    h2_stream st;
+    std::size_t body_size = h2.session_.declared_body_size(stream_id);
+    st.rec_.request_body_size_ = static_cast<std::uint32_t>(body_size);
+    auto rejection = check_request_head(cdata, req, body_size, st.params_);
+    if (!rejection) {
+        st.rec_.route_ = routes.path(st.params_.index());
+        // Don't take more work than we can handle in a reasonable time
+        st.admission_ = cdata.shard_.admission_.try_admit();
+        if (!st.admission_)
+            rejection = overloaded_response();
+    }
+    // Like with HTTP/1.x, the client gets a new connection after a number of requests
+    h2.num_requests_++;
+    const conn_limits& limits = cdata.shard_.limits_;
+    if (limits.max_requests_ > 0 && h2.num_requests_ >= limits.max_requests_)
+        h2.session_.shutdown();
+
+    if (rejection) {
+        st.rec_.status_ = http_server::status_code_value(rejection->status_code_);
+        st.rec_.response_body_size_ = static_cast<std::uint32_t>(rejection->body_.size());
+        log_access(cdata, st.rec_);
+        h2.session_.submit_response(stream_id, std::move(*rejection));
+        return;
+    }
+    h2.streams_.emplace(stream_id, std::move(st));
+}
+
+//! Handles an HTTP/2 connection, after the client sent the preface.
+//! The protocol is handled by the session; here, we move the data between the session and the
+//! connection, and the requests between the session and the worker pool. The requests are
+//! processed concurrently, and the responses are sent as soon as they are ready, in any order.
+//! All of this happens on the I/O thread, except for the processing of the requests.
+auto handle_h2_connection(const conn_data& cdata, request_reader& reader) -> task<bool> {
+    h2_connection h2{cdata, http_server::h2::session{*cdata.shard_.h2_options_}};
+    // Start with the data read while looking for the preface
+    h2.session_.receive({reader.buf_.data() + reader.begin_, reader.end_ - reader.begin_});
+    reader.buf_.reset();
+    auto buf = cdata.shard_.buffers_.acquire(io::buffer_pool::large_size);
+
+    // While there are no requests, the connection may stay idle for a limited time
+    io::connection_deadline idle_deadline{cdata.shard_.io_ctx_, cdata.conn_};
+    while (true) {
+        while (auto ev = h2.session_.next_event()) {
+            std::uint32_t id = ev->stream_id_;
+            switch (ev->kind_) {
+            case http_server::h2::event_kind::request_head:
+                on_h2_request_head(h2, id);
+                break;
+            case http_server::h2::event_kind::request_complete: {
+                auto it = h2.streams_.find(id);
+                if (it == h2.streams_.end())
+                    break;
+                h2.tasks_.spawn(handle_h2_stream(h2, id, std::move(it->second)));
+                h2.streams_.erase(it);
+                break;
+            }
+            case http_server::h2::event_kind::stream_reset:
+                h2.streams_.erase(id);
+                break;
+            }
+        }
+        if (cdata.shard_.draining_.load(std::memory_order_relaxed))
+            h2.session_.shutdown();
+        schedule_h2_flush(h2);
+        if (h2.session_.closed() || h2.write_failed_)
+            break;
+
+        if (h2.session_.num_streams() == 0)
+            idle_deadline.arm(cdata.shard_.timeouts_.idle_);
+        else
+            idle_deadline.disarm();
+        io::out_buffer out_buf{buf.data(), buf.size()};
+        // If we are cancelled, stop reading, but still wait for the requests in progress
+        std::size_t n = co_await (io::async_read(cdata.shard_.io_ctx_, cdata.conn_, out_buf)
+                                  | ex::let_stopped([] { return ex::just(std::size_t{0}); }));
+        if (n == 0) {
+            if (idle_deadline.expired())
+                cdata.shard_.reaped_.idle_++;
+            break;
+        }
+        PROFILING_SCOPE_N("handle_h2_connection -- received data");
+        h2.session_.receive({buf.data(), n});
+    }
+
+    // The tasks reference the session, which lives in this frame; wait for them even if we are
+    // cancelled (the wait can't be cancelled). They don't take long: the requests are processed,
+    // and the writes have deadlines. The tasks complete on this I/O thread, and so does the wait.
+    co_await h2.tasks_.on_empty();
+    co_return true;
+}
+
+//! Handles one connection from the client.
+//! Serves the requests coming on the connection, one after the other, until the client asks to
+//! close the connection, it stays idle for too long, or it reaches the maximum number of requests.
+//! Pipelined requests are served in order, so the responses are written in the request order.
+//! Requests are checked as soon as their head arrives; the rejected ones are answered without
+//! waiting for their body. This includes the requests that we can't take because we are
+//! overloaded; they get 503 responses directly from the I/O thread.
+//! Each request that gets a response is recorded in the access log.
+//! If we close the connection without reading the whole request, we wait for the client to read
+//! the response before closing it (see `linger_close()`).
+//! If HTTP/2 is enabled, and the client starts with the HTTP/2 preface, the connection is served
+//! by `handle_h2_connection()` instead.
+auto handle_connection(const conn_data& cdata) -> task<bool> {
+    using clock = std::chrono::steady_clock;
+    request_reader reader{cdata};
+    // A single header deadline covers the detection of the HTTP/2 preface and the head of the first
+    // request
+    reader.head_deadline_.arm(cdata.shard_.timeouts_.header_read_);
+    // Clients that know that we speak HTTP/2 start with its preface; the others get HTTP/1.x
+    try {
+        if (cdata.shard_.h2_options_ && co_await detect_h2_preface(cdata, reader))
+            co_return co_await handle_h2_connection(cdata, reader);
+    } catch (...) {
+        co_return true; // The connection is gone
+    }
+    bool keep_alive = true;
+    // Set if we close the connection while the client may still be sending data
+    bool linger = false;
+    while (keep_alive) {
+        // Read the head of the next HTTP request from the connection
+        std::optional<http_server::http_request> req;
+        std::optional<http_server::http_response> rejection;
+        std::optional<http_server::http_response> direct;
+        route_params params;
+        response_key key;
+        admission_controller::ticket admission;
+        access_record rec;
+        // If reading the request fails, the status of the error response
+        std::optional<http_server::status_code> read_error;
+        try {
+            req = co_await read_request_head(cdata, reader);
+            if (req) {
+                rejection = check_request_head(cdata, *req, reader.body_size_, params);
+                if (!rejection) {
+                    rec.route_ = routes.path(params.index());
+                    // Don't take more work than we can handle in a reasonable time
+                    admission = cdata.shard_.admission_.try_admit();
+                    if (!admission)
+                        rejection = overloaded_response();
+                }
+                rec.request_body_size_ = static_cast<std::uint32_t>(reader.body_size_);
+                if (!rejection) {
+                    auto body_start = clock::now();
+                    req->body_ = co_await read_request_body(cdata, reader);
+                    rec.body_read_us_ = to_us(clock::now() - body_start);
+                    // Repeated requests are answered right here, without the worker pool
+                    key = response_key_of(*req, params);
+                    direct = answer_without_processing(cdata, *req, params, key);
+                    if (direct)
+                        admission = {};
+                }
+            }
+        } catch (const http_server::bad_request&) {
+            read_error = http_server::status_code::s_400_bad_request;
+        } catch (const http_server::not_implemented&) {
+            read_error = http_server::status_code::s_501_not_implemented;
+        } catch (...) {
+            read_error = http_server::status_code::s_500_internal_server_error;
+        }
+        if (!read_error && !req)
+            break; // The connection ended between requests
+        // If reading the head failed, its deadline is still armed; the error response has its own
+        reader.head_deadline_.disarm();
+
+        try {
+            if (read_error) {
+                // Try to tell the client about the error, and close the connection; we don't know
+                // where the next request would start
+                keep_alive = false;
+                rec.status_ = http_server::status_code_value(*read_error);
+                co_await write_http_response(cdata, http_server::create_response(*read_error));
+                log_access(cdata, rec);
+                linger = true;
+                continue;
+            }
+            bool at_limit = cdata.shard_.limits_.max_requests_ > 0
+                    && reader.num_requests_ >= cdata.shard_.limits_.max_requests_;
+            keep_alive = http_server::wants_keep_alive(*req) && !at_limit
+                    && !cdata.shard_.draining_.load(std::memory_order_relaxed);
+            if (rejection) {
+                // We can continue with the next request only if we can skip the body without
+                // reading it; we don't make the client upload a body that we don't need
+                keep_alive = keep_alive && reader.body_buffered();
+                if (keep_alive)
+                    reader.skip_body();
+                rec.status_ = http_server::status_code_value(rejection->status_code_);
+                rec.response_body_size_ = static_cast<std::uint32_t>(rejection->body_.size());
+                auto write_start = clock::now();
+                co_await write_http_response(cdata, std::move(*rejection), keep_alive);
+                rec.write_us_ = to_us(clock::now() - write_start);
+                // The client may still be uploading the body. Under overload, the client may also
+                // have more requests in flight; the 503 and its `Retry-After` must reach it.
+                bool overloaded = rec.status_ == 503;
+                linger = !keep_alive && (!reader.body_buffered() || overloaded);
+            } else {
+                auto resp = direct ? std::move(*direct)
+                                   : co_await process_request(cdata, std::move(*req),
+                                           std::move(params), key, admission);
+                auto write_start = clock::now();
+                if (admission.started_at() != clock::time_point{}) {
+                    rec.queue_us_ = to_us(admission.started_at() - admission.enqueued_at());
+                    rec.handle_us_ = to_us(write_start - admission.started_at());
+                }
+                rec.status_ = http_server::status_code_value(resp.status_code_);
+                rec.response_body_size_ = static_cast<std::uint32_t>(resp.body_.size());
+                co_await write_http_response(cdata, std::move(resp), keep_alive);
+                rec.write_us_ = to_us(clock::now() - write_start);
+            }
+            log_access(cdata, rec);
+        } catch (...) {
+            // If we couldn't write the response, the connection is gone; nothing left to do
+            break;
+        }
+    }
+    if (linger) {
+        try {
+            co_await linger_close(cdata, reader);
+        } catch (...) {
+            // The client reset the connection; we close it anyway
+        }
+    }
+    co_return true;
+}
+
+auto listener(int port, bool reuse_port, int accept_budget, shard_context& shard,
+        senders::async_scope& connections) -> task<bool> {
+    io::io_context& ctx = shard.io_ctx_;
     // Create a listening socket
-    io::listening_socket listen_sock;
+    io::listening_socket listen_sock{reuse_port};
     listen_sock.bind(port);
     listen_sock.listen();
 
-    while (!ctx.is_stopped()) {
-        // Accept one incoming connection
-        io::connection conn = co_await io::async_accept(ctx, listen_sock);
+    auto max_batch = static_cast<std::size_t>(accept_budget);
+    while (!ctx.is_stopped() && !shard.draining_.load(std::memory_order_relaxed)) {
+        // Accept all the pending incoming connections, up to our budget
+        std::vector<io::connection> conns =
+                co_await io::async_accept_batch(ctx, listen_sock, max_batch);
 
-        PROFILING_SCOPE_N("connection accepted");
+        PROFILING_SCOPE_N("connections accepted");
+        PROFILING_SET_TEXT_FMT(32, "count=%d", int(conns.size()));
 
-        // Create a connection data object with important objects for the connection
-        conn_data data{std::move(conn), ctx, pool};
+        for (io::connection& conn : conns) {
+            // Create a connection data object with important objects for the connection
+            conn_data data{
+                    std::move(conn), shard, g_next_conn_id.fetch_add(1, std::memory_order_relaxed)};
 
-        // Handle the logic for this connection
-        ex::sender auto snd =                                //
-                ex::just()                                   //
-                | ex::let_value([data = std::move(data)]() { //
-                      return handle_connection(data);
-                  });
-        ex::start_detached(std::move(snd));
+            // Handle the logic for this connection
+            ex::sender auto snd =                                //
+                    ex::just()                                   //
+                    | ex::let_value([data = std::move(data)]() { //
+                          return handle_connection(data);
+                      });
+            connections.spawn(std::move(snd));
+        }
     }
     co_return true;
 }
 
-static io::io_context* g_ctx{nullptr};
+//! Waits for SIGTERM, then shuts down the server gracefully: stops accepting new connections,
+//! gives the in-flight requests `grace` time to complete, cancels whatever is still running, and
+//! only then stops the I/O contexts. A second SIGTERM stops the I/O contexts right away.
+auto drain_on_sigterm(io::io_context& ctx, const io::signal_set& signals,
+        std::atomic<bool>& draining, const std::vector<io::io_context*>& contexts,
+        senders::async_scope& listeners, senders::async_scope& connections,
+        std::chrono::milliseconds grace) -> task<bool> {
+    co_await io::async_wait_signal(ctx, signals);
 
-auto sig_handler(int signo, siginfo_t* info, void* context) -> void {
-    PROFILING_SCOPE();
-    PROFILING_SET_TEXT_FMT(12, "sig=%d", signo);
-    if (signo == SIGTERM && g_ctx)
-        g_ctx->stop();
-}
+    // Stop accepting connections; this cancels the pending accept operations. The connections
+    // stop being kept alive.
+    draining.store(true, std::memory_order_relaxed);
+    listeners.request_stop();
+
+    // Let the in-flight requests complete, as long as they fit in the grace period; after it,
+    // cancel the requests that are still running. Work that is running on the worker pool
+    // completes first; the I/O after it is cancelled.
+    std::size_t num_cancelled{0};
+    senders::async_scope watchers;
+    watchers.spawn(io::async_sleep_for(ctx, grace) | ex::then([&] {
+        num_cancelled = connections.active();
+        connections.request_stop();
+    }));
+    watchers.spawn(io::async_wait_signal(ctx, signals) | ex::then([&contexts](int) {
+        for (io::io_context* c : contexts)
+            c->stop();
+    }));
+    co_await connections.on_empty();
+    co_await listeners.on_empty();
+    watchers.request_stop();
+    co_await watchers.on_empty();
+    std::printf("Shutdown: %zu in-flight connections cancelled after the grace period\n",
+            num_cancelled);
 
-auto set_sig_handler(io::io_context& ctx, int signo) -> void {
-    g_ctx = &ctx;
-    struct sigaction act {};
-    act.sa_flags = SA_SIGINFO;
-    act.sa_sigaction = &sig_handler;
-    int rc = sigaction(SIGTERM, &act, nullptr);
-    if (rc < 0)
-        throw std::system_error(std::error_code(errno, std::system_category()));
+    for (io::io_context* c : contexts)
+        c->stop();
+    co_return true;
 }
 
-auto get_main_sender() {
-    return ex::just() | ex::then([] {
+auto get_main_sender(const server_config& cfg) {
+    return ex::just() | ex::then([&cfg] {
         PROFILING_SCOPE();
-        int port = 8080;
+
+        // SIGTERM drains the server. It is read through the first I/O context, so it is blocked
+        // before we start any thread.
+        io::signal_set signals{SIGTERM};
+        std::atomic<bool> draining{false};
+
+        // The scopes tracking the listeners and the connections; they outlive all the work
+        senders::async_scope listeners;
+        senders::async_scope connections;
 
         // Create a pool of threads to handle most of the work
-        static_thread_pool pool{8};
+        static_thread_pool pool{static_cast<std::uint32_t>(cfg.num_worker_threads_)};
 
-        // Create the I/O context object, used to handle async I/O
-        io::io_context ctx;
-        set_sig_handler(ctx, SIGTERM);
+        // Limit the work that we give to the pool
+        admission_options admission_opts;
+        admission_opts.max_in_flight_ = static_cast<std::size_t>(cfg.max_inflight_requests_);
+        admission_opts.max_queued_ = static_cast<std::size_t>(cfg.max_queued_requests_);
+        admission_opts.target_delay_ = std::chrono::milliseconds{cfg.queue_delay_target_ms_};
+        admission_opts.interval_ = std::chrono::milliseconds{cfg.queue_delay_interval_ms_};
+        admission_controller admission{admission_opts};
 
-        // Start a listener on our I/O execution context
-        ex::sender auto snd = ex::on(ctx.get_scheduler(), listener(port, ctx, pool));
-        ex::start_detached(std::move(snd));
+        // Create the I/O context objects, used to handle async I/O; one per shard
+        io::io_options io_opts;
+        io_opts.max_spin_ = std::chrono::microseconds{cfg.busy_poll_us_};
+        std::vector<std::unique_ptr<io::io_context>> shards;
+        std::vector<io::io_context*> contexts;
+        for (int i = 0; i < cfg.num_io_threads_; i++) {
+            shards.push_back(std::make_unique<io::io_context>(io_opts));
+            contexts.push_back(shards.back().get());
+        }
 
-        // Run the I/O execution context until we are stopped (by a signal)
-        ctx.run();
+        // The deadlines and the limits for the connections
+        conn_timeouts timeouts{
+                std::chrono::milliseconds{cfg.header_timeout_ms_},
+                std::chrono::milliseconds{cfg.body_timeout_ms_},
+                std::chrono::milliseconds{cfg.write_timeout_ms_},
+                std::chrono::milliseconds{cfg.idle_timeout_ms_},
+                std::chrono::milliseconds{cfg.linger_timeout_ms_},
+        };
+        conn_limits limits{
+                static_cast<std::size_t>(cfg.max_requests_per_conn_),
+                static_cast<std::size_t>(cfg.max_body_size_),
+                static_cast<std::size_t>(cfg.max_linger_size_),
+        };
+
+        // HTTP/2 connections, if enabled, have the same limits as the HTTP/1.x ones
+        http_server::h2::session_options h2_opts;
+        h2_opts.max_concurrent_streams_ = static_cast<std::uint32_t>(cfg.h2_max_streams_);
+        h2_opts.max_body_size_ = limits.max_body_size_;
+
+        // The responses and the intermediate images are cached for all the shards; the worker
+        // threads fill the caches
+        std::optional<response_cache> cache;
+        if (cfg.response_cache_mb_ > 0)
+            cache.emplace(static_cast<std::size_t>(cfg.response_cache_mb_) * 1024 * 1024);
+        std::optional<image_cache> images;
+        if (cfg.image_cache_mb_ > 0)
+            images.emplace(static_cast<std::size_t>(cfg.image_cache_mb_) * 1024 * 1024);
+
+        // The access log has a ring per shard, written only from the I/O thread of the shard
+        constexpr std::size_t access_log_capacity = 4096;
+        std::optional<access_log> request_log;
+        if (cfg.access_log_ != 0)
+            request_log.emplace(contexts.size(), access_log_capacity, STDOUT_FILENO);
+
+        // Everything the connections of a shard use; the read buffers and the counters are owned
+        // by the shard, the rest is shared
+        std::vector<std::unique_ptr<shard_context>> shard_contexts;
+        for (std::size_t i = 0; i < contexts.size(); i++) {
+            shard_contexts.push_back(std::unique_ptr<shard_context>(new shard_context{
+                    .io_ctx_ = *contexts[i],
+                    .pool_ = pool,
+                    .admission_ = admission,
+                    .timeouts_ = timeouts,
+                    .limits_ = limits,
+                    .zerocopy_threshold_ = static_cast<std::size_t>(cfg.zerocopy_threshold_),
+                    .h2_options_ = cfg.h2c_ != 0 ? &h2_opts : nullptr,
+                    .cache_ = cache ? &*cache : nullptr,
+                    .images_ = images ? &*images : nullptr,
+                    .access_log_ = request_log ? &request_log->ring(i) : nullptr,
+                    .draining_ = draining,
+            }));
+        }
+
+        // Start a listener on each shard. With multiple shards, each listener has its own socket
+        // bound to the same port, and the kernel balances the connections between them.
+        bool reuse_port = cfg.num_io_threads_ > 1;
+        for (auto& shard : shard_contexts) {
+            ex::sender auto snd = ex::on(shard->io_ctx_.get_scheduler(),
+                    listener(cfg.port_, reuse_port, cfg.accept_budget_, *shard, connections));
+            listeners.spawn(std::move(snd));
+        }
+
+        // On SIGTERM, drain the server; this runs on the first shard
+        ex::sender auto drain_snd = ex::on(contexts[0]->get_scheduler(),
+                drain_on_sigterm(*contexts[0], signals, draining, contexts, listeners, connections,
+                        std::chrono::milliseconds{cfg.shutdown_grace_ms_}));
+        ex::start_detached(std::move(drain_snd));
+
+        // Run the I/O execution contexts until we are stopped (after draining).
+        // The first shard runs on the current thread.
+        std::vector<std::thread> io_threads;
+        for (std::size_t i = 1; i < contexts.size(); i++)
+            io_threads.emplace_back([ctx = contexts[i]] { ctx->run(); });
+        contexts[0]->run();
+        for (auto& t : io_threads)
+            t.join();
+
+        reap_counters total;
+        for (const auto& shard : shard_contexts) {
+            const reap_counters& r = shard->reaped_;
+            total.header_read_ += r.header_read_;
+            total.body_read_ += r.body_read_;
+            total.write_ += r.write_;
+            total.idle_ += r.idle_;
+        }
+        std::printf("Reaped connections: %llu on header read, %llu on body read, %llu on write\n",
+                static_cast<unsigned long long>(total.header_read_),
+                static_cast<unsigned long long>(total.body_read_),
+                static_cast<unsigned long long>(total.write_));
+        std::printf("Idle connections closed: %llu\n",
+                static_cast<unsigned long long>(total.idle_));
+
+        zerocopy_counters zerocopy_total;
+        for (const auto& shard : shard_contexts) {
+            zerocopy_total.sends_ += shard->zerocopy_stats_.sends_;
+            zerocopy_total.copied_ += shard->zerocopy_stats_.copied_;
+        }
+        std::printf("Zero-copy sends: %llu, copied by the kernel: %llu\n",
+                static_cast<unsigned long long>(zerocopy_total.sends_),
+                static_cast<unsigned long long>(zerocopy_total.copied_));
+
+        admission_stats adm_stats = admission.stats();
+        std::printf("Admission: %llu admitted, %llu rejected at the limits, %llu rejected on "
+                    "queueing delay\n",
+                static_cast<unsigned long long>(adm_stats.admitted_),
+                static_cast<unsigned long long>(adm_stats.rejected_limits_),
+                static_cast<unsigned long long>(adm_stats.rejected_delay_));
+
+        io::buffer_pool_stats pool_stats;
+        for (const auto& shard : shard_contexts) {
+            io::buffer_pool_stats s = shard->buffers_.stats();
+            pool_stats.hits_ += s.hits_;
+            pool_stats.misses_ += s.misses_;
+            pool_stats.high_water_bytes_ += s.high_water_bytes_;
+        }
+        std::printf("Read buffers: %llu pool hits, %llu allocations, %zu KB at peak\n",
+                static_cast<unsigned long long>(pool_stats.hits_),
+                static_cast<unsigned long long>(pool_stats.misses_),
+                pool_stats.high_water_bytes_ / 1024);
+
+        if (cache) {
+            cache_stats resp_stats = cache->stats();
+            std::printf("Response cache: %llu hits, %llu misses, %llu evictions, %zu KB used\n",
+                    static_cast<unsigned long long>(resp_stats.hits_),
+                    static_cast<unsigned long long>(resp_stats.misses_),
+                    static_cast<unsigned long long>(resp_stats.evictions_),
+                    resp_stats.size_ / 1024);
+        }
+        if (images) {
+            cache_stats img_stats = images->stats();
+            std::printf("Image cache: %llu hits, %llu misses, %llu evictions, %zu KB used\n",
+                    static_cast<unsigned long long>(img_stats.hits_),
+                    static_cast<unsigned long long>(img_stats.misses_),
+                    static_cast<unsigned long long>(img_stats.evictions_),
+                    img_stats.size_ / 1024);
+        }
+
+        if (request_log) {
+            std::uint64_t dropped = request_log->dropped();
+            request_log.reset(); // Writes the remaining records
+            std::printf("Access log: %llu records dropped\n",
+                    static_cast<unsigned long long>(dropped));
+        }
+
+        io::io_loop_stats loop_stats;
+        for (io::io_context* ctx : contexts) {
+            loop_stats.spin_hits_ += ctx->stats().spin_hits_;
+            loop_stats.parks_ += ctx->stats().parks_;
+        }
+        std::printf("I/O loops: %llu spin hits, %llu parks\n",
+                static_cast<unsigned long long>(loop_stats.spin_hits_),
+                static_cast<unsigned long long>(loop_stats.parks_));
         return 0;
     });
 }
 
-auto main() -> int {
-    auto [r] = std::this_thread::sync_wait(get_main_sender()).value();
+auto main(int argc, char** argv) -> int {
+    server_config cfg;
+    try {
+        cfg = parse_server_config(argc, argv);
+    } catch (const std::invalid_argument& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    auto [r] = std::this_thread::sync_wait(get_main_sender(cfg)).value();
     return r;
 }
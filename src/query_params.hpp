@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
+
+//! Describes an integer parameter that a handler accepts in the query string of the URI
+template <typename Params>
+struct param_spec {
+    //! The name of the parameter in the query string
+    std::string_view name_;
+    //! The field in which the value is stored
+    int Params::*field_;
+    //! The accepted range of values
+    int min_{INT_MIN};
+    int max_{INT_MAX};
+    //! Set if the value needs to be odd; e.g., the size of a kernel
+    bool odd_{false};
+    //! If not empty, the value is one of these words instead of a number; the field gets the
+    //! index of the word
+    std::span<const std::string_view> keywords_{};
+};
+
+//! Joins the parameter specs of a handler with specs shared by several handlers
+template <typename Params, std::size_t N, std::size_t M>
+constexpr auto join_schemas(const std::array<param_spec<Params>, N>& a,
+        const std::array<param_spec<Params>, M>& b) -> std::array<param_spec<Params>, N + M> {
+    std::array<param_spec<Params>, N + M> res{};
+    for (std::size_t i = 0; i < N; i++)
+        res[i] = a[i];
+    for (std::size_t i = 0; i < M; i++)
+        res[N + i] = b[i];
+    return res;
+}
+
+//! Parses the query string of a URI (the part after `?`) into the parameters of a handler.
+//!
+//! `Params` needs a static `schema()` function returning the array of `param_spec<Params>` that
+//! it accepts; the parameters that are missing keep the default values from `Params`. The values
+//! are decimal integers, or words for the parameters that take keywords.
+//! Returns an empty optional if the query has unknown parameters, or invalid values.
+template <typename Params>
+auto parse_query_params(std::string_view query) -> std::optional<Params> {
+    static constexpr auto schema = Params::schema();
+    Params res{};
+    // Parse the parameters in a single pass; they are separated by `&`, and have the form
+    // `name=value`
+    std::size_t i = 0;
+    std::size_t n = query.size();
+    while (i < n) {
+        std::size_t name_start = i;
+        while (i < n && query[i] != '=' && query[i] != '&')
+            i++;
+        auto name = query.substr(name_start, i - name_start);
+        if (i == n || query[i] == '&') {
+            if (!name.empty())
+                return std::nullopt; // No value
+            i++;
+            continue;
+        }
+        i++; // Skip the '='
+        std::size_t value_start = i;
+        while (i < n && query[i] != '&')
+            i++;
+        auto value_str = query.substr(value_start, i - value_start);
+        i++; // Skip the '&'
+
+        const param_spec<Params>* spec = nullptr;
+        for (const auto& s : schema) {
+            if (s.name_ == name) {
+                spec = &s;
+                break;
+            }
+        }
+        if (!spec)
+            return std::nullopt;
+
+        if (!spec->keywords_.empty()) {
+            std::size_t idx = 0;
+            while (idx < spec->keywords_.size() && spec->keywords_[idx] != value_str)
+                idx++;
+            if (idx == spec->keywords_.size())
+                return std::nullopt;
+            res.*(spec->field_) = static_cast<int>(idx);
+            continue;
+        }
+
+        // The value is a decimal integer
+        std::size_t j = 0;
+        bool negative = !value_str.empty() && value_str[0] == '-';
+        if (negative)
+            j++;
+        long long value = 0;
+        std::size_t num_digits = 0;
+        for (; j < value_str.size(); j++) {
+            char c = value_str[j];
+            if (c < '0' || c > '9' || num_digits == 10)
+                return std::nullopt;
+            value = value * 10 + (c - '0');
+            num_digits++;
+        }
+        if (num_digits == 0)
+            return std::nullopt;
+        if (negative)
+            value = -value;
+        if (value < spec->min_ || value > spec->max_ || (spec->odd_ && value % 2 == 0))
+            return std::nullopt;
+        res.*(spec->field_) = static_cast<int>(value);
+    }
+    return res;
+}
@@ -1,26 +1,281 @@
 #pragma once
 
+#include "conn_data.hpp"
 #include "http_server/request_parser.hpp"
+#include "http_server/h2/frame.hpp"
 #include "io/io_context.hpp"
 #include "io/connection.hpp"
+#include "io/connection_deadline.hpp"
 #include "io/async_read.hpp"
+#include "io/async_write.hpp"
+#include "io/buffer_pool.hpp"
 
 #include <task.hpp>
 
-auto read_http_request(io::io_context& ctx, const io::connection& conn)
-        -> task<http_server::http_request> {
-    { PROFILING_SCOPE_N("read_http_request -- start"); }
-    http_server::request_parser parser;
-    std::string buf;
-    buf.reserve(1024 * 1024);
-    io::out_buffer out_buf{buf};
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <sys/socket.h>
+
+//! The state kept between the requests read from the same connection.
+//! Must be used and destroyed on the I/O thread of the connection.
+//!
+//! The buffers come from the buffer pool of the I/O thread. Request heads are read into a small
+//! slab, moved to a large chunk only if they don't fit. The chunk for the body is taken only when
+//! we need to read the body from the connection, and given back as soon as the body is read.
+struct request_reader {
+    //! The maximum size of a request head
+    static constexpr std::size_t max_head_size = io::buffer_pool::large_size;
+
+    explicit request_reader(const conn_data& cdata)
+        : head_deadline_(cdata.shard_.io_ctx_, cdata.conn_)
+        , body_deadline_(cdata.shard_.io_ctx_, cdata.conn_) {}
+
+    //! The buffer in which we read the request heads. Requests point into it.
+    io::pooled_buffer buf_;
+    //! The range of `buf_` holding data that was read but not consumed yet; it belongs to the body
+    //! of the current request, and, with pipelining, to the next requests
+    std::size_t begin_{0};
+    std::size_t end_{0};
+    //! The number of requests read so far from the connection
+    std::size_t num_requests_{0};
+
+    //! The size of the body of the current request, and how much of it wasn't consumed yet
+    std::size_t body_size_{0};
+    std::size_t body_left_{0};
+    //! Set if the client waits for `100 Continue` before sending the body
+    bool expect_continue_{false};
+    //! Set once we started reading the body of the current request from the connection
+    bool reading_body_{false};
+    //! The deadline for reading the head of the current request. For the first request, it is
+    //! armed when the connection starts, and also covers the detection of the HTTP/2 preface.
+    io::connection_deadline head_deadline_;
+    //! The buffer in which we read the body chunks that were not already in `buf_`
+    io::pooled_buffer chunk_buf_;
+    //! The deadline for reading the body; kept between the body chunks
+    io::connection_deadline body_deadline_;
+
+    //! Check if the body of the current request is entirely in our buffer, so we can skip it
+    //! without reading from the connection
+    auto body_buffered() const noexcept -> bool { return body_left_ <= end_ - begin_; }
+    //! Skip the body of the current request; only valid if the body is buffered
+    auto skip_body() noexcept -> void {
+        begin_ += body_left_;
+        body_left_ = 0;
+    }
+};
+
+namespace detail {
+//! Check if the client sent `Expect: 100-continue`
+inline auto expects_continue(const http_server::http_request& req) -> bool {
+    if (req.version_ != http_server::http_version::http_1_1)
+        return false;
+    std::string_view value = req.headers_.find(http_server::header_field::expect);
+    return value.size() == 12 && strncasecmp(value.data(), "100-continue", 12) == 0;
+}
+} // namespace detail
+
+//! Check whether the client starts the connection with the HTTP/2 preface, as the clients do
+//! when they know that we speak HTTP/2 (h2c with prior knowledge).
+//! Reads just enough to tell: HTTP/1.x requests differ from the preface after a few bytes. The data
+//! read is kept in `reader`, for whichever protocol we continue with. Returns false if the
+//! connection ends first; the HTTP/1.x path then finds the end of the connection on its own, and
+//! counts it if the header deadline expired.
+//! Runs under the header deadline of the first request, which must be armed by the caller; it is
+//! disarmed if we continue with HTTP/2.
+auto detect_h2_preface(const conn_data& cdata, request_reader& reader) -> task<bool> {
+    using http_server::h2::client_preface;
+    if (!reader.buf_)
+        reader.buf_ = cdata.shard_.buffers_.acquire(io::buffer_pool::small_size);
     while (true) {
-        // Read the input request, in packets, and parse each packet
-        std::size_t n = co_await io::async_read(ctx, conn, out_buf);
-        PROFILING_SCOPE_N("read_http_request -- read some data");
-        auto data = std::string_view{buf.data(), n};
-        auto r = parser.parse_next_packet(data);
-        if (r)
-            co_return {std::move(r.value())};
-    }
-}
\ No newline at end of file
+        std::size_t n = std::min(reader.end_, client_preface.size());
+        if (std::string_view{reader.buf_.data(), n} != client_preface.substr(0, n))
+            co_return false;
+        if (n == client_preface.size()) {
+            reader.head_deadline_.disarm();
+            co_return true;
+        }
+        io::out_buffer out_buf{
+                reader.buf_.data() + reader.end_, reader.buf_.size() - reader.end_};
+        std::size_t num_read = co_await io::async_read(cdata.shard_.io_ctx_, cdata.conn_, out_buf);
+        if (num_read == 0)
+            co_return false;
+        reader.end_ += num_read;
+    }
+}
+
+//! Reads the head of the next HTTP request from the connection; the body is not read.
+//! The head is kept in the buffer of `reader`, and the returned request points into it; the
+//! request must be handled before reading the next one. After this, the body needs to be read
+//! with `read_body_chunk()`, or skipped, before the next request can be read.
+//! Returns an empty optional if the connection ends cleanly before a new request starts: the
+//! peer closed it, or it stayed idle for longer than the idle timeout.
+//! Fails if the connection is closed in the middle of a request, or if the header deadline
+//! expires. For the first request, the header deadline must be armed by the caller, when the
+//! connection starts; on failure, the caller disarms it.
+auto read_request_head(const conn_data& cdata, request_reader& reader)
+        -> task<std::optional<http_server::http_request>> {
+    { PROFILING_SCOPE_N("read_request_head -- start"); }
+    http_server::request_parser parser;
+    io::connection_deadline& deadline = reader.head_deadline_;
+    if (!reader.buf_)
+        reader.buf_ = cdata.shard_.buffers_.acquire(io::buffer_pool::small_size);
+
+    // The previous request is done; move the data that we didn't consume to the front
+    char* buf = reader.buf_.data();
+    if (reader.begin_ > 0) {
+        std::memmove(buf, buf + reader.begin_, reader.end_ - reader.begin_);
+        reader.end_ -= reader.begin_;
+        reader.begin_ = 0;
+    }
+    // If a large head made us switch to a large buffer, switch back once the data fits
+    if (reader.buf_.size() > io::buffer_pool::small_size
+            && reader.end_ <= io::buffer_pool::small_size) {
+        auto small_buf = cdata.shard_.buffers_.acquire(io::buffer_pool::small_size);
+        std::memcpy(small_buf.data(), buf, reader.end_);
+        reader.buf_ = std::move(small_buf);
+        buf = reader.buf_.data();
+    }
+
+    // Between requests, the connection may stay idle; the header deadline starts with the first
+    // byte of the request
+    bool started = reader.end_ > 0;
+    bool idle = !started && reader.num_requests_ > 0;
+    if (reader.num_requests_ > 0)
+        deadline.arm(idle ? cdata.shard_.timeouts_.idle_ : cdata.shard_.timeouts_.header_read_);
+
+    // Read until we have the complete head of the request
+    std::size_t head_size = started ? parser.parse_head({buf, reader.end_}) : 0;
+    while (head_size == 0) {
+        if (reader.end_ == reader.buf_.size()) {
+            if (reader.buf_.size() >= request_reader::max_head_size)
+                throw http_server::bad_request{};
+            // The head doesn't fit in the small buffer; move to a large one
+            auto large_buf = cdata.shard_.buffers_.acquire(request_reader::max_head_size);
+            std::memcpy(large_buf.data(), buf, reader.end_);
+            reader.buf_ = std::move(large_buf);
+            buf = reader.buf_.data();
+        }
+        io::out_buffer out_buf{buf + reader.end_, reader.buf_.size() - reader.end_};
+        std::size_t n = co_await io::async_read(cdata.shard_.io_ctx_, cdata.conn_, out_buf);
+        PROFILING_SCOPE_N("read_request_head -- read head data");
+        if (n == 0) {
+            // The connection was closed, either by the peer or because we timed out
+            if (idle) {
+                if (deadline.expired())
+                    cdata.shard_.reaped_.idle_++;
+                co_return std::nullopt;
+            }
+            if (!deadline.expired()) {
+                // The peer may close the connection before sending any request
+                if (!started && reader.num_requests_ == 0)
+                    co_return std::nullopt;
+                throw std::system_error(std::make_error_code(std::errc::connection_aborted));
+            }
+            cdata.shard_.reaped_.header_read_++;
+            throw std::system_error(std::make_error_code(std::errc::timed_out));
+        }
+        if (idle) {
+            // A new request is starting
+            idle = false;
+            deadline.arm(cdata.shard_.timeouts_.header_read_);
+        }
+        started = true;
+        reader.end_ += n;
+        head_size = parser.parse_head({buf, reader.end_});
+    }
+
+    deadline.disarm();
+
+    // What follows the head is the body, and then the next requests
+    reader.begin_ = head_size;
+    reader.body_size_ = parser.content_length();
+    reader.body_left_ = reader.body_size_;
+    reader.num_requests_++;
+    auto req = parser.make_request({});
+    reader.expect_continue_ = detail::expects_continue(req);
+    reader.reading_body_ = false;
+    co_return req;
+}
+
+//! Reads the next chunk of the body of the current request.
+//! The returned data is valid until the next call. Returns an empty chunk once the whole body was
+//! read. The part of the body that came with the head is returned without reading anything; if
+//! the client waits for `100 Continue`, we send it before reading the rest.
+//! Fails if the connection is closed before the body is complete, or if the body deadline
+//! expires.
+auto read_body_chunk(const conn_data& cdata, request_reader& reader) -> task<std::string_view> {
+    if (reader.body_left_ == 0) {
+        // The last chunk is no longer used
+        reader.chunk_buf_.reset();
+        co_return std::string_view{};
+    }
+
+    // Start with the data that we already have
+    if (reader.begin_ < reader.end_) {
+        std::size_t n = std::min(reader.body_left_, reader.end_ - reader.begin_);
+        std::string_view chunk{reader.buf_.data() + reader.begin_, n};
+        reader.begin_ += n;
+        reader.body_left_ -= n;
+        co_return chunk;
+    }
+
+    // The rest needs to be read from the connection; this is where the body deadline starts
+    if (!reader.reading_body_) {
+        reader.reading_body_ = true;
+        if (reader.expect_continue_) {
+            // The client waits for us to accept the request before sending the body
+            std::string_view cont{"HTTP/1.1 100 Continue\r\n\r\n"};
+            reader.body_deadline_.arm(cdata.shard_.timeouts_.write_);
+            while (!cont.empty())
+                cont.remove_prefix(
+                        co_await io::async_write(cdata.shard_.io_ctx_, cdata.conn_, cont));
+        }
+        reader.body_deadline_.arm(cdata.shard_.timeouts_.body_read_);
+    }
+    if (!reader.chunk_buf_)
+        reader.chunk_buf_ = cdata.shard_.buffers_.acquire(io::buffer_pool::large_size);
+
+    std::size_t to_read = std::min(reader.body_left_, reader.chunk_buf_.size());
+    io::out_buffer out_buf{reader.chunk_buf_.data(), to_read};
+    std::size_t n = co_await io::async_read(cdata.shard_.io_ctx_, cdata.conn_, out_buf);
+    PROFILING_SCOPE_N("read_body_chunk -- read body data");
+    if (n == 0) {
+        if (!reader.body_deadline_.expired())
+            throw std::system_error(std::make_error_code(std::errc::connection_aborted));
+        cdata.shard_.reaped_.body_read_++;
+        throw std::system_error(std::make_error_code(std::errc::timed_out));
+    }
+    reader.body_left_ -= n;
+    if (reader.body_left_ == 0)
+        reader.body_deadline_.disarm();
+    co_return std::string_view{reader.chunk_buf_.data(), n};
+}
+
+//! Closes our side of the connection after a response, when the client may still be sending data
+//! that we won't read: the body of a rejected request, or a request that we couldn't parse.
+//! Closing a socket with unread data resets the connection, and the client may lose the response
+//! before reading it. Instead, we shut down the sending side, and discard what the client sends
+//! until it closes its side, the linger timeout expires, or we discarded `max_linger_size_` bytes.
+//! The caller closes the connection afterwards.
+auto linger_close(const conn_data& cdata, request_reader& reader) -> task<bool> {
+    ::shutdown(cdata.conn_.fd(), SHUT_WR);
+    if (cdata.shard_.timeouts_.linger_ <= std::chrono::milliseconds::zero())
+        co_return true;
+    io::connection_deadline deadline{cdata.shard_.io_ctx_, cdata.conn_};
+    deadline.arm(cdata.shard_.timeouts_.linger_);
+    if (!reader.chunk_buf_)
+        reader.chunk_buf_ = cdata.shard_.buffers_.acquire(io::buffer_pool::large_size);
+    std::size_t left = cdata.shard_.limits_.max_linger_size_;
+    while (left > 0) {
+        io::out_buffer out_buf{reader.chunk_buf_.data(), std::min(left, reader.chunk_buf_.size())};
+        std::size_t n = co_await io::async_read(cdata.shard_.io_ctx_, cdata.conn_, out_buf);
+        if (n == 0)
+            break;
+        left -= n;
+    }
+    co_return true;
+}
@@ -0,0 +1,29 @@
+#include "response_cache.hpp"
+
+#include "profiling.hpp"
+
+namespace {
+
+//! The memory used by a cached response, including our bookkeeping
+auto entry_size(const http_server::http_response& resp) -> std::size_t {
+    std::size_t res = sizeof(http_server::http_response) + resp.body_.size() + 128;
+    for (const auto& h : resp.headers_)
+        res += sizeof(h) + h.name_.size() + h.value_.size();
+    return res;
+}
+
+} // namespace
+
+auto response_cache::find(const response_key& key)
+        -> std::shared_ptr<const http_server::http_response> {
+    PROFILING_SCOPE();
+    return entries_.find(key).value_or(nullptr);
+}
+
+auto response_cache::insert(const response_key& key, http_server::http_response resp) -> void {
+    PROFILING_SCOPE();
+    std::size_t size = entry_size(resp);
+    // Allocate outside of the lock
+    auto shared_resp = std::make_shared<const http_server::http_response>(std::move(resp));
+    entries_.insert(key, std::move(shared_resp), size);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "http_server/http_response.hpp"
+#include "sharded_lru_cache.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+//! Identifies a response by everything that it depends on: the hash of the request that produced
+//! it, and the size of the request body, which makes collisions even less likely
+struct response_key {
+    std::uint64_t hash_{0};
+    std::uint64_t body_size_{0};
+    //! The hash of the request body alone, which `hash_` is derived from; the images decoded from
+    //! the body are keyed by it (see `source_key()`)
+    std::uint64_t body_hash_{0};
+
+    auto operator==(const response_key& other) const noexcept -> bool = default;
+};
+
+//! A cache of responses, bounded by the memory that they use.
+//!
+//! The I/O threads look up the responses, and the worker threads add them. The responses are
+//! shared with the readers, so the locks are not held while they are copied.
+class response_cache {
+public:
+    //! Creates a cache that holds up to `capacity` bytes of responses
+    explicit response_cache(std::size_t capacity)
+        : entries_(capacity, num_shards, capacity / num_shards / 10) {}
+
+    //! Looks up the response for the key; marks it as recently used
+    auto find(const response_key& key) -> std::shared_ptr<const http_server::http_response>;
+
+    //! Adds the response for the key, evicting the least recently used responses to make room.
+    //! Responses larger than a tenth of a shard are not cached.
+    auto insert(const response_key& key, http_server::http_response resp) -> void;
+
+    //! Get the counters
+    auto stats() const -> cache_stats { return entries_.stats(); }
+
+private:
+    static constexpr std::size_t num_shards = 16;
+
+    struct key_hash {
+        auto operator()(const response_key& key) const noexcept -> std::size_t {
+            return static_cast<std::size_t>(key.hash_);
+        }
+    };
+    sharded_lru_cache<response_key, std::shared_ptr<const http_server::http_response>, key_hash>
+            entries_;
+};
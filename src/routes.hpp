@@ -0,0 +1,46 @@
+#pragma once
+
+#include "http_server/route_table.hpp"
+#include "query_params.hpp"
+#include "transform_params.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <variant>
+
+//! The routes that we serve
+constexpr http_server::route_table<6> routes{{
+        "/transform/blur",
+        "/transform/adaptthresh",
+        "/transform/reducecolors",
+        "/transform/cartoonify",
+        "/transform/oilpainting",
+        "/transform/contourpaint",
+}};
+
+//! The parameters of the handlers of the routes, in the same order as the routes
+using route_params = std::variant< //
+        blur_params,               //
+        adaptthresh_params,        //
+        reducecolors_params,       //
+        cartoonify_params,         //
+        oilpainting_params,        //
+        contourpaint_params>;
+static_assert(std::variant_size_v<route_params> == routes.size());
+
+namespace detail {
+//! Parses the query into the parameters of the route with index `I`, or the ones after it
+template <std::size_t I = 0>
+auto parse_route_params(std::size_t route_idx, std::string_view query)
+        -> std::optional<route_params> {
+    if constexpr (I < std::variant_size_v<route_params>) {
+        if (route_idx != I)
+            return parse_route_params<I + 1>(route_idx, query);
+        using params_t = std::variant_alternative_t<I, route_params>;
+        if (auto params = parse_query_params<params_t>(query))
+            return route_params{std::in_place_index<I>, *params};
+    }
+    return std::nullopt;
+}
+} // namespace detail
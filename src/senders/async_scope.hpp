@@ -0,0 +1,190 @@
+#pragma once
+
+#include <execution.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+namespace senders {
+
+//! A scope that keeps track of the work spawned into it.
+//!
+//! Like `start_detached()`, `spawn()` starts a sender without waiting for it, and ignores its
+//! value; just like `start_detached()`, an error terminates the program. But the scope counts the
+//! operations that are still in flight, so we can find out when all of them are done. The spawned
+//! operations get a stop token from the scope; calling `request_stop()` asks all of them to stop.
+//! `on_empty()` waits for all of them to complete.
+//!
+//! The scope must outlive all the work spawned into it.
+class async_scope {
+    struct spawn_state_base {
+        async_scope* scope_;
+
+        explicit spawn_state_base(async_scope* scope)
+            : scope_(scope) {}
+        virtual ~spawn_state_base() = default;
+
+        //! Called when the spawned operation completes; destroys the operation state
+        auto complete() noexcept -> void {
+            async_scope* scope = scope_;
+            delete this;
+            if (scope->count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                scope->notify_empty();
+        }
+        //! The stop token given to the spawned operation
+        auto get_stop_token() const noexcept -> std::in_place_stop_token {
+            return scope_->stop_source_.get_token();
+        }
+    };
+
+    struct spawn_receiver {
+        spawn_state_base* state_;
+
+        template <typename... Ts>
+        friend void tag_invoke(
+                std::execution::set_value_t, spawn_receiver&& self, Ts&&...) noexcept {
+            self.state_->complete();
+        }
+        template <typename E>
+        friend void tag_invoke(std::execution::set_error_t, spawn_receiver&&, E&&) noexcept {
+            std::terminate();
+        }
+        friend void tag_invoke(std::execution::set_stopped_t, spawn_receiver&& self) noexcept {
+            self.state_->complete();
+        }
+        friend auto tag_invoke(std::get_stop_token_t, const spawn_receiver& self) noexcept
+                -> std::in_place_stop_token {
+            return self.state_->get_stop_token();
+        }
+    };
+
+    template <typename S>
+    struct spawn_state : spawn_state_base {
+        std::execution::connect_result_t<S, spawn_receiver> op_;
+
+        spawn_state(async_scope* scope, S&& snd)
+            : spawn_state_base(scope)
+            , op_(std::execution::connect(std::move(snd), spawn_receiver{this})) {}
+    };
+
+    //! An operation started from `on_empty()`, waiting for the scope to become empty
+    struct empty_waiter {
+        empty_waiter* next_{nullptr};
+        virtual auto notify() noexcept -> void = 0;
+
+    protected:
+        ~empty_waiter() = default;
+    };
+
+    template <typename Recv>
+    class on_empty_oper : empty_waiter {
+        async_scope* scope_;
+        Recv recv_;
+
+        auto notify() noexcept -> void override { std::execution::set_value(std::move(recv_)); }
+        auto start() noexcept -> void {
+            if (!scope_->add_empty_waiter(this))
+                std::execution::set_value(std::move(recv_));
+        }
+
+    public:
+        on_empty_oper(async_scope* scope, Recv&& recv)
+            : scope_(scope)
+            , recv_(std::move(recv)) {}
+
+        friend void tag_invoke(std::execution::start_t, on_empty_oper& self) noexcept {
+            self.start();
+        }
+    };
+
+    struct on_empty_sender {
+        async_scope* scope_;
+
+        using completion_signatures =
+                std::execution::completion_signatures<std::execution::set_value_t()>;
+
+        template <std::execution::receiver Recv>
+        friend auto tag_invoke(std::execution::connect_t, on_empty_sender&& self, Recv&& recv)
+                -> on_empty_oper<std::remove_cvref_t<Recv>> {
+            return {self.scope_, std::forward<Recv>(recv)};
+        }
+    };
+
+    std::atomic<std::size_t> count_{0};
+    std::in_place_stop_source stop_source_;
+    //! Protects `waiters_`
+    std::mutex waiters_mutex_;
+    //! The operations waiting for the scope to become empty
+    empty_waiter* waiters_{nullptr};
+
+    //! Registers `w` to be notified when the scope becomes empty.
+    //! Returns false if the scope is already empty; `w` is not registered then.
+    auto add_empty_waiter(empty_waiter* w) noexcept -> bool {
+        std::scoped_lock lock{waiters_mutex_};
+        if (count_.load(std::memory_order_acquire) == 0)
+            return false;
+        w->next_ = waiters_;
+        waiters_ = w;
+        return true;
+    }
+
+    //! Called when the last operation completes; wakes up the waiters, unless more work was
+    //! spawned in the meantime (it wakes them up when it completes).
+    auto notify_empty() noexcept -> void {
+        empty_waiter* waiters = nullptr;
+        {
+            std::scoped_lock lock{waiters_mutex_};
+            if (count_.load(std::memory_order_acquire) != 0)
+                return;
+            waiters = std::exchange(waiters_, nullptr);
+        }
+        // The waiters may destroy the scope; don't touch it from here on
+        while (waiters) {
+            empty_waiter* next = waiters->next_;
+            waiters->notify();
+            waiters = next;
+        }
+    }
+
+public:
+    async_scope() = default;
+    ~async_scope() = default;
+    async_scope(const async_scope&) = delete;
+    async_scope& operator=(const async_scope&) = delete;
+
+    //! Starts the given sender, tracking it in this scope.
+    template <std::execution::sender S>
+    auto spawn(S&& snd) -> void {
+        using state_t = spawn_state<std::remove_cvref_t<S>>;
+        count_.fetch_add(1, std::memory_order_relaxed);
+        state_t* state = nullptr;
+        try {
+            state = new state_t(this, std::remove_cvref_t<S>(std::forward<S>(snd)));
+        } catch (...) {
+            count_.fetch_sub(1, std::memory_order_relaxed);
+            throw;
+        }
+        std::execution::start(state->op_);
+    }
+
+    //! Returns the number of spawned operations that haven't completed yet.
+    auto active() const noexcept -> std::size_t { return count_.load(std::memory_order_acquire); }
+    //! Returns true if all the spawned operations have completed.
+    auto empty() const noexcept -> bool { return active() == 0; }
+
+    //! Returns a sender that completes when all the spawned operations have completed; right away,
+    //! if there are none. It completes on the thread that completed the last operation, and can't
+    //! be cancelled.
+    auto on_empty() noexcept -> on_empty_sender { return {this}; }
+
+    //! Asks all the operations spawned in this scope to stop.
+    auto request_stop() noexcept -> void { stop_source_.request_stop(); }
+    //! Returns true if `request_stop()` was called.
+    auto stop_requested() const noexcept -> bool { return stop_source_.stop_requested(); }
+};
+
+} // namespace senders
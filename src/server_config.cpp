@@ -0,0 +1,76 @@
+#include "server_config.hpp"
+
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+
+//! A command line option, pointing to the field of the configuration that it sets
+struct config_option {
+    std::string_view name_;
+    int server_config::*field_;
+    int min_value_;
+};
+
+constexpr config_option all_options[] = {
+        {"port", &server_config::port_, 1},
+        {"io-threads", &server_config::num_io_threads_, 1},
+        {"worker-threads", &server_config::num_worker_threads_, 1},
+        {"accept-budget", &server_config::accept_budget_, 1},
+        {"busy-poll-us", &server_config::busy_poll_us_, 0},
+        {"header-timeout-ms", &server_config::header_timeout_ms_, 0},
+        {"body-timeout-ms", &server_config::body_timeout_ms_, 0},
+        {"write-timeout-ms", &server_config::write_timeout_ms_, 0},
+        {"idle-timeout-ms", &server_config::idle_timeout_ms_, 0},
+        {"linger-timeout-ms", &server_config::linger_timeout_ms_, 0},
+        {"max-linger-size", &server_config::max_linger_size_, 0},
+        {"max-requests-per-conn", &server_config::max_requests_per_conn_, 0},
+        {"max-body-size", &server_config::max_body_size_, 0},
+        {"max-inflight-requests", &server_config::max_inflight_requests_, 0},
+        {"max-queued-requests", &server_config::max_queued_requests_, 0},
+        {"queue-delay-target-ms", &server_config::queue_delay_target_ms_, 0},
+        {"queue-delay-interval-ms", &server_config::queue_delay_interval_ms_, 1},
+        {"zerocopy-threshold", &server_config::zerocopy_threshold_, 0},
+        {"access-log", &server_config::access_log_, 0},
+        {"h2c", &server_config::h2c_, 0},
+        {"h2-max-streams", &server_config::h2_max_streams_, 1},
+        {"response-cache-mb", &server_config::response_cache_mb_, 0},
+        {"image-cache-mb", &server_config::image_cache_mb_, 0},
+        {"shutdown-grace-ms", &server_config::shutdown_grace_ms_, 0},
+};
+
+auto bad_argument(std::string_view arg) -> std::invalid_argument {
+    return std::invalid_argument{"invalid argument: " + std::string{arg}};
+}
+
+} // namespace
+
+auto parse_server_config(int argc, char** argv) -> server_config {
+    server_config res;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+        // Arguments have the form `--name=value`
+        auto eq_pos = arg.find('=');
+        if (!arg.starts_with("--") || eq_pos == std::string_view::npos)
+            throw bad_argument(arg);
+        auto name = arg.substr(2, eq_pos - 2);
+        auto value_str = arg.substr(eq_pos + 1);
+
+        const config_option* opt = nullptr;
+        for (const auto& o : all_options)
+            if (o.name_ == name)
+                opt = &o;
+        if (!opt)
+            throw bad_argument(arg);
+
+        int value{0};
+        auto end = value_str.data() + value_str.size();
+        auto [ptr, ec] = std::from_chars(value_str.data(), end, value);
+        if (ec != std::errc{} || ptr != end || value < opt->min_value_)
+            throw bad_argument(arg);
+        res.*(opt->field_) = value;
+    }
+    return res;
+}
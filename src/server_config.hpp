@@ -0,0 +1,80 @@
+#pragma once
+
+//! The configuration of the server.
+//! All the values can be changed from the command line, with arguments like `--port=8080`.
+struct server_config {
+    //! The port on which we listen for connections
+    int port_{8080};
+    //! The number of I/O threads (shards). Each shard has its own I/O context and its own listening
+    //! socket; connections are handled on the shard that accepted them.
+    int num_io_threads_{1};
+    //! The number of threads used to process the requests
+    int num_worker_threads_{8};
+    //! The maximum number of connections accepted by a listener each time it is woken up
+    int accept_budget_{64};
+    //! Busy-polling: the maximum time, in microseconds, that an I/O thread spins looking for work
+    //! before it blocks. Lowers latency at the cost of CPU time. Zero disables busy-polling.
+    int busy_poll_us_{0};
+    //! The time, in milliseconds, allowed for a client to send the request line and the headers.
+    //! Zero means no limit.
+    int header_timeout_ms_{10000};
+    //! The time, in milliseconds, allowed for a client to send the body of the request.
+    //! Zero means no limit.
+    int body_timeout_ms_{60000};
+    //! The time, in milliseconds, allowed for writing the response to the client.
+    //! Zero means no limit.
+    int write_timeout_ms_{60000};
+    //! The time, in milliseconds, that a persistent connection may stay idle between requests.
+    //! Zero means no limit.
+    int idle_timeout_ms_{5000};
+    //! The time, in milliseconds, that we keep reading and discarding what the client sends, when we
+    //! close a connection after a response without reading the whole request (e.g., a rejected
+    //! upload); this lets the client read the response. Zero closes the connection right away.
+    int linger_timeout_ms_{2000};
+    //! The maximum number of bytes that we discard when closing a connection like this
+    int max_linger_size_{1024 * 1024};
+    //! The maximum number of requests served on a persistent connection. Zero means no limit.
+    int max_requests_per_conn_{1000};
+    //! The maximum size, in bytes, of a request body. Larger requests are rejected with 413 before
+    //! their body is uploaded. Zero means no limit.
+    int max_body_size_{64 * 1024 * 1024};
+    //! Admission control: the maximum number of requests in flight; more requests get 503
+    //! responses. Zero means no limit.
+    int max_inflight_requests_{0};
+    //! Admission control: the maximum number of requests waiting for a worker thread.
+    //! Zero means no limit.
+    int max_queued_requests_{256};
+    //! Admission control: if the requests wait longer than this, in milliseconds, for a worker
+    //! thread during a whole interval, new requests get 503 responses. Zero disables the check.
+    int queue_delay_target_ms_{100};
+    //! Admission control: the interval, in milliseconds, for the queueing delay check
+    int queue_delay_interval_ms_{1000};
+    //! Response bodies of at least this many bytes are sent with `MSG_ZEROCOPY`, avoiding the copy
+    //! into the kernel. Pays off for bodies of hundreds of KB and more. Zero disables it.
+    int zerocopy_threshold_{0};
+    //! A nonzero value writes the access log to the standard output; zero disables it.
+    //! The log is written in batches by a background thread; records are dropped rather than
+    //! slowing down the requests.
+    int access_log_{0};
+    //! A nonzero value also serves HTTP/2 on the same port, for the clients that start the
+    //! connection with the HTTP/2 preface (h2c with prior knowledge); zero serves only HTTP/1.x.
+    int h2c_{0};
+    //! HTTP/2: the maximum number of requests that a client can have in flight on a connection
+    int h2_max_streams_{100};
+    //! The memory, in MB, for caching the responses; a request that comes again with the same body
+    //! and parameters is answered from the cache, without processing it. The cache also gives the
+    //! responses an ETag, and answers `If-None-Match` with 304 (or 412). Zero (the default)
+    //! disables the cache, and all of this.
+    int response_cache_mb_{0};
+    //! The memory, in MB, for caching the decoded images and the intermediate results of the
+    //! transforms; the transforms applied to the same image share them. Zero (the default)
+    //! disables the cache.
+    int image_cache_mb_{0};
+    //! On SIGTERM, the time, in milliseconds, that in-flight requests are given to complete before
+    //! they are cancelled and the server exits.
+    int shutdown_grace_ms_{30000};
+};
+
+//! Parse the server configuration from the command line arguments.
+//! Throws `std::invalid_argument` on unknown arguments or invalid values.
+auto parse_server_config(int argc, char** argv) -> server_config;
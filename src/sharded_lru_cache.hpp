@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+//! Counters of a cache
+struct cache_stats {
+    std::uint64_t hits_{0};
+    std::uint64_t misses_{0};
+    std::uint64_t evictions_{0};
+    //! The memory used by the cached values, in bytes
+    std::size_t size_{0};
+};
+
+//! A cache bounded by the memory that its values use, with least-recently-used eviction.
+//!
+//! The cache is split into shards, each with its own lock and its own LRU list, so that the
+//! threads using it rarely contend. The values are returned by copy, so they should be cheap to
+//! copy; e.g., shared pointers, or reference-counted images. `Hash` needs to mix all the bits of
+//! the key, as the shard is chosen from the high bits of the hash.
+//!
+//! All the operations are thread-safe.
+template <typename Key, typename Value, typename Hash>
+class sharded_lru_cache {
+public:
+    //! Creates a cache that holds up to `capacity` bytes, split into `num_shards` shards of equal
+    //! capacity. Values larger than `max_value_size` are not cached, so that a few large values
+    //! can't flush the cache.
+    sharded_lru_cache(std::size_t capacity, std::size_t num_shards, std::size_t max_value_size)
+        : shard_capacity_(capacity / num_shards)
+        , max_value_size_(max_value_size)
+        , shards_(num_shards) {}
+
+    //! Looks up the value for the key; marks it as recently used
+    auto find(const Key& key) -> std::optional<Value> {
+        shard& s = shard_of(key);
+        std::lock_guard lock{s.mutex_};
+        auto it = s.index_.find(key);
+        if (it == s.index_.end()) {
+            s.misses_++;
+            return std::nullopt;
+        }
+        s.hits_++;
+        s.lru_.splice(s.lru_.begin(), s.lru_, it->second);
+        return it->second->value_;
+    }
+
+    //! Adds the value for the key, which uses `size` bytes, evicting the least recently used
+    //! values of the shard to make room. If the key is already present, the value is kept.
+    auto insert(const Key& key, Value value, std::size_t size) -> void {
+        if (size > max_value_size_ || size > shard_capacity_)
+            return;
+        shard& s = shard_of(key);
+        std::lock_guard lock{s.mutex_};
+        if (s.index_.contains(key))
+            return; // Another thread computed the same value in the meantime
+        while (!s.lru_.empty() && s.size_ + size > shard_capacity_) {
+            const entry& victim = s.lru_.back();
+            s.size_ -= victim.size_;
+            s.index_.erase(victim.key_);
+            s.lru_.pop_back();
+            s.evictions_++;
+        }
+        s.lru_.push_front({key, std::move(value), size});
+        s.index_.emplace(key, s.lru_.begin());
+        s.size_ += size;
+    }
+
+    //! Get the counters
+    auto stats() const -> cache_stats {
+        cache_stats res;
+        for (const shard& s : shards_) {
+            std::lock_guard lock{s.mutex_};
+            res.hits_ += s.hits_;
+            res.misses_ += s.misses_;
+            res.evictions_ += s.evictions_;
+            res.size_ += s.size_;
+        }
+        return res;
+    }
+
+private:
+    struct entry {
+        Key key_;
+        Value value_;
+        std::size_t size_;
+    };
+    struct shard {
+        mutable std::mutex mutex_;
+        //! The entries, the most recently used first
+        std::list<entry> lru_;
+        std::unordered_map<Key, typename std::list<entry>::iterator, Hash> index_;
+        std::size_t size_{0};
+        std::uint64_t hits_{0};
+        std::uint64_t misses_{0};
+        std::uint64_t evictions_{0};
+    };
+
+    std::size_t shard_capacity_;
+    std::size_t max_value_size_;
+    std::vector<shard> shards_;
+
+    auto shard_of(const Key& key) -> shard& {
+        // The low bits are used by the hash tables of the shards
+        auto h = static_cast<std::uint64_t>(Hash{}(key));
+        return shards_[(h >> 48) % shards_.size()];
+    }
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "query_params.hpp"
+
+#include <array>
+#include <string_view>
+
+//! The formats in which the transforms can encode the resulting image
+enum class image_format {
+    //! Chosen from the `Accept` header of the request, and the kind of image that we produce
+    automatic,
+    jpeg,
+    png,
+    webp,
+    //! A black-and-white PNG, with 1 bit per pixel; best for masks
+    mask,
+};
+
+//! The kind of image that a transform produces, which decides the format that encodes it best
+enum class image_kind {
+    //! Continuous tones, like the photos
+    photo,
+    //! Few colors, in flat areas
+    flat_colors,
+    //! Black and white
+    mask,
+};
+
+//! The names of the formats in the `format` parameter, in the order of `image_format`
+inline constexpr std::string_view image_format_names[] = {"auto", "jpeg", "png", "webp", "mask"};
+
+//! The parameters that choose how the resulting image is encoded; all the transforms take them.
+//! The zero values leave the choice to us.
+struct output_params {
+    //! The format of the image, as an `image_format`
+    int format_{0};
+    //! The quality of the lossy formats, JPEG and WebP; 100 is the best
+    int quality_{0};
+    //! A nonzero value makes progressive JPEGs, which are shown while they load
+    int progressive_{0};
+    //! The compression level of PNG images, from 0 (fastest) to 9 (smallest)
+    int compression_{-1};
+
+    template <typename Params>
+    static constexpr auto schema() {
+        using p = param_spec<Params>;
+        return std::array{
+                p{.name_ = "format", .field_ = &Params::format_, .keywords_ = image_format_names},
+                p{"quality", &Params::quality_, 1, 100},
+                p{"progressive", &Params::progressive_, 0, 1},
+                p{"compression", &Params::compression_, 0, 9},
+        };
+    }
+};
+
+// The parameters of the transform handlers, with the values that they accept
+
+struct blur_params : output_params {
+    int size_{3};
+
+    static constexpr image_kind kind = image_kind::photo;
+
+    static constexpr auto schema() {
+        return join_schemas(
+                std::array{
+                        param_spec<blur_params>{"size", &blur_params::size_, 1, 255, true},
+                },
+                output_params::schema<blur_params>());
+    }
+};
+
+struct adaptthresh_params : output_params {
+    int blur_size_{3};
+    int block_size_{5};
+    int diff_{5};
+
+    static constexpr image_kind kind = image_kind::mask;
+
+    static constexpr auto schema() {
+        using p = param_spec<adaptthresh_params>;
+        return join_schemas(
+                std::array{
+                        p{"blur_size", &adaptthresh_params::blur_size_, 1, 255, true},
+                        p{"block_size", &adaptthresh_params::block_size_, 3, 255, true},
+                        p{"diff", &adaptthresh_params::diff_, -255, 255},
+                },
+                output_params::schema<adaptthresh_params>());
+    }
+};
+
+struct reducecolors_params : output_params {
+    int num_colors_{5};
+
+    static constexpr image_kind kind = image_kind::flat_colors;
+
+    static constexpr auto schema() {
+        return join_schemas(
+                std::array{
+                        param_spec<reducecolors_params>{
+                                "num_colors", &reducecolors_params::num_colors_, 1, 256},
+                },
+                output_params::schema<reducecolors_params>());
+    }
+};
+
+struct cartoonify_params : output_params {
+    int blur_size_{3};
+    int num_colors_{5};
+    int block_size_{5};
+    int diff_{5};
+
+    static constexpr image_kind kind = image_kind::flat_colors;
+
+    static constexpr auto schema() {
+        using p = param_spec<cartoonify_params>;
+        return join_schemas(
+                std::array{
+                        p{"blur_size", &cartoonify_params::blur_size_, 1, 255, true},
+                        p{"num_colors", &cartoonify_params::num_colors_, 1, 256},
+                        p{"block_size", &cartoonify_params::block_size_, 3, 255, true},
+                        p{"diff", &cartoonify_params::diff_, -255, 255},
+                },
+                output_params::schema<cartoonify_params>());
+    }
+};
+
+struct oilpainting_params : output_params {
+    int size_{10};
+    int dyn_ratio_{1};
+
+    static constexpr image_kind kind = image_kind::photo;
+
+    static constexpr auto schema() {
+        using p = param_spec<oilpainting_params>;
+        return join_schemas(
+                std::array{
+                        p{"size", &oilpainting_params::size_, 1, 100},
+                        p{"dyn_ratio", &oilpainting_params::dyn_ratio_, 1, 100},
+                },
+                output_params::schema<oilpainting_params>());
+    }
+};
+
+struct contourpaint_params : output_params {
+    int blur_size_{3};
+    int block_size_{5};
+    int diff_{5};
+    int oil_size_{3};
+    int dyn_ratio_{5};
+
+    static constexpr image_kind kind = image_kind::photo;
+
+    static constexpr auto schema() {
+        using p = param_spec<contourpaint_params>;
+        return join_schemas(
+                std::array{
+                        p{"blur_size", &contourpaint_params::blur_size_, 1, 255, true},
+                        p{"block_size", &contourpaint_params::block_size_, 3, 255, true},
+                        p{"diff", &contourpaint_params::diff_, -255, 255},
+                        p{"oil_size", &contourpaint_params::oil_size_, 1, 100},
+                        p{"dyn_ratio", &contourpaint_params::dyn_ratio_, 1, 100},
+                },
+                output_params::schema<contourpaint_params>());
+    }
+};
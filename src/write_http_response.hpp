@@ -1,27 +1,102 @@
 #pragma once
 
+#include "conn_data.hpp"
 #include "http_server/http_response.hpp"
 #include "http_server/to_buffers.hpp"
 #include "io/io_context.hpp"
 #include "io/connection.hpp"
-#include "io/async_write.hpp"
+#include "io/connection_deadline.hpp"
+#include "io/async_writev.hpp"
+#include "io/zerocopy.hpp"
 
 #include <task.hpp>
 
-auto write_http_response(io::io_context& ctx, const io::connection& conn,
-        http_server::http_response resp) -> task<std::size_t> {
+#include <algorithm>
+#include <exception>
+#include <system_error>
+#include <strings.h>
+
+//! Returns the headers that tell the client whether the connection stays open.
+//! On a persistent connection, the client needs `Content-Length` to find the end of the response;
+//! except for the responses that never have a body (204 and 304).
+inline auto connection_headers(const http_server::http_response& resp, bool keep_alive)
+        -> http_server::headers {
+    http_server::headers res;
+    res.push_back({"Connection", keep_alive ? "keep-alive" : "close"});
+    auto has_length = std::any_of(resp.headers_.begin(), resp.headers_.end(), [](const auto& h) {
+        return strcasecmp(h.name_.c_str(), "content-length") == 0;
+    });
+    if (!has_length && http_server::has_content_length(resp.status_code_))
+        res.push_back({"Content-Length", std::to_string(resp.body_.size())});
+    return res;
+}
+
+//! Writes the HTTP response to the connection.
+//! If `keep_alive` is set, tells the client that the connection stays open for more requests.
+//! Must be started on the I/O thread of the connection, as it arms the write deadline.
+auto write_http_response(const conn_data& cdata, http_server::http_response resp,
+        bool keep_alive = false) -> task<std::size_t> {
     { PROFILING_SCOPE_N("write_http_response -- start"); }
+    io::connection_deadline deadline{cdata.shard_.io_ctx_, cdata.conn_};
+    deadline.arm(cdata.shard_.timeouts_.write_);
+    http_server::headers extra_headers = connection_headers(resp, keep_alive);
     std::vector<std::string_view> out_buffers;
-    http_server::to_buffers(resp, out_buffers);
+    http_server::to_buffers(resp, extra_headers, out_buffers);
+    // Large bodies are sent without copying them, if enabled and supported
+    std::size_t zerocopy_threshold = cdata.shard_.zerocopy_threshold_;
+    bool zerocopy = zerocopy_threshold > 0 && resp.body_.size() >= zerocopy_threshold
+                    && io::enable_zerocopy(cdata.conn_);
+    io::zerocopy_tracker zc;
+
+    // Write all the buffers at once; typically, this is a single syscall
     std::size_t bytes_written{0};
-    for (auto buf : out_buffers) {
-        while (!buf.empty()) {
-            auto n = co_await io::async_write(ctx, conn, buf);
-            PROFILING_SCOPE_N("write_http_response -- written some data");
-            bytes_written += n;
-            buf = buf.substr(n);
-            PROFILING_SET_TEXT_FMT(32, "cur=%d, sum=%d", int(n), int(bytes_written));
+    std::exception_ptr error;
+    try {
+        if (zerocopy) {
+            // If we are cancelled, we still need to wait for the kernel to release our buffers
+            bool cancelled = false;
+            bytes_written =
+                    co_await (io::async_writev(cdata.shard_.io_ctx_, cdata.conn_, out_buffers, zc)
+                              | std::execution::let_stopped([&cancelled] {
+                                    cancelled = true;
+                                    return std::execution::just(std::size_t{0});
+                                }));
+            if (cancelled)
+                throw std::system_error(std::make_error_code(std::errc::operation_canceled));
+        } else {
+            bytes_written =
+                    co_await io::async_writev(cdata.shard_.io_ctx_, cdata.conn_, out_buffers);
         }
+    } catch (...) {
+        // Writing fails after the connection is shut down by the deadline
+        if (deadline.expired())
+            cdata.shard_.reaped_.write_++;
+        error = std::current_exception();
+    }
+    // Whatever happened, the kernel may still use our buffers; they live in this frame.
+    // Once written, the data is released when the peer acknowledges it, within the write timeout.
+    if (zc.pending() && !error) {
+        co_await io::async_zerocopy_release(
+                cdata.shard_.io_ctx_, cdata.conn_, zc, cdata.shard_.timeouts_.write_);
+        if (zc.pending()) {
+            cdata.shard_.reaped_.write_++;
+            error = std::make_exception_ptr(
+                    std::system_error(std::make_error_code(std::errc::timed_out)));
+        }
+    }
+    if (zc.pending()) {
+        // The data won't be delivered. Reset the connection, so that the kernel drops the data and
+        // releases our buffers right away, instead of retransmitting it for minutes.
+        cdata.conn_.abort();
+        co_await io::async_zerocopy_release(cdata.shard_.io_ctx_, cdata.conn_, zc);
+    }
+    if (zerocopy) {
+        cdata.shard_.zerocopy_stats_.sends_ += zc.released_;
+        cdata.shard_.zerocopy_stats_.copied_ += zc.copied_;
     }
+    if (error)
+        std::rethrow_exception(error);
+    PROFILING_SCOPE_N("write_http_response -- written all data");
+    PROFILING_SET_TEXT_FMT(32, "sum=%d", int(bytes_written));
     co_return bytes_written;
-}
\ No newline at end of file
+}